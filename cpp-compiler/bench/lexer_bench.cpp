@@ -0,0 +1,282 @@
+// Lexer micro-benchmarks
+// ======================
+//
+// [lex]       Tokenizes generated scripts of a few sizes and reports MB/s,
+//             tokens/s and heap allocations per token: from an in-memory
+//             string (copied once into the Lexer) and from a file mapped
+//             with SourceBuffer::open. The scripts range from one-byte
+//             tokens through keyword-dense declarations to mostly
+//             comments and indentation, where the block scanning kernels
+//             (scan_ops.h) do most of the work.
+// [stream]    Pulls the same scripts token by token through a
+//             StreamingLexer reading the file in 64 KiB chunks, next to the
+//             whole-buffer Lexer, and reports the memory each one holds at
+//             its peak: the chunk buffer against the mapped source plus
+//             its token array.
+// [parallel]  Maps the large scripts and tokenizes them with ParallelLexer
+//             on 1, 2, 4 and 8 threads, next to the single-threaded Lexer,
+//             with the number of chunks and of chunks lexed again because
+//             a string literal ran across their first line.
+//
+//   lexbench [repetitions]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lexer.h"
+#include "parallel_lexer.h"
+#include "scan_ops.h"
+#include "source_buffer.h"
+#include "streaming_lexer.h"
+
+namespace {
+
+// Counts every heap allocation in the process
+std::atomic<uint64_t> allocations{0};
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+
+// Arithmetic statements, the bulk of generated scripts
+std::string makeExpressionScript(size_t bytes) {
+    std::string src = "a = 1; b = 2; c = 3; d = 4;\n";
+    while (src.size() < bytes) {
+        src += "a = (a + b * 3 - c) / 2;\n";
+        src += "b = b - a * (d + 7) / 5 + c;\n";
+        src += "c = (a < b) + (c * 2 + d) / 3 - 1;\n";
+        src += "d = -(a - b) * (c + 1) / 9 + (d >= 4);\n";
+    }
+    return src;
+}
+
+// Long names, floats, strings, comments and indentation
+std::string makeMixedScript(size_t bytes) {
+    std::string src;
+    for (uint32_t i = 0; src.size() < bytes; ++i) {
+        const std::string n = std::to_string(i % 997);
+        src += "// step " + n + ": accumulate the running totals\n";
+        src += "    total_count_" + n + " = total_count_" + n + " + 12345 * scale_factor;\n";
+        src += "    ratio = 3.14159 * radius_value / (offset_" + n + " - 0.5);\n";
+        src += "    label = \"record number " + n + "\";\n";
+        src += "    print(total_count_" + n + ");\n";
+    }
+    return src;
+}
+
+// Declarations and control flow: nearly every token is a name, and about
+// a third of the names are keywords
+std::string makeIdentifierScript(size_t bytes) {
+    std::string src;
+    for (uint32_t i = 0; src.size() < bytes; ++i) {
+        const std::string n = std::to_string(i % 97);
+        src += "int count" + n + " float ratio" + n + " bool done" + n + " char tag" + n + "\n";
+        src += "while done" + n + " if count" + n + " return ratio" + n + " else print total_value\n";
+        src += "for index" + n + " void callback_handler true false accumulator input_buffer\n";
+    }
+    return src;
+}
+
+// Generated code with doc comments and deep indentation: mostly bytes the
+// lexer skips
+std::string makeCommentedScript(size_t bytes) {
+    std::string src;
+    for (uint32_t i = 0; src.size() < bytes; ++i) {
+        const std::string n = std::to_string(i % 997);
+        src += "                // Block " + n + " of the generated schedule. Each block updates the\n";
+        src += "                // accumulator for its partition and records the partition label.\n";
+        src += "                accumulator_for_partition_" + n + " = accumulator_for_partition_" + n + " + 1;\n";
+        src += "                \n";
+    }
+    return src;
+}
+
+template <typename Fn>
+double timeRuns(int repetitions, Fn&& run) {
+    run(); // warm-up
+    auto begin = std::chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; ++r) run();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+void report(const std::string& label, size_t bytes, size_t tokens, uint64_t allocs, double seconds,
+            int repetitions) {
+    const double perRun = seconds / repetitions;
+    std::cout << std::left << std::setw(16) << label << std::right << std::fixed << std::setprecision(1)
+              << std::setw(8) << bytes / perRun / 1e6 << " MB/s " << std::setw(7) << tokens / perRun / 1e6
+              << " M tok/s " << std::setprecision(4) << std::setw(8) << double(allocs) / double(tokens)
+              << " allocs/tok\n";
+}
+
+void runLexBench(const std::string& name, const std::string& source, int repetitions) {
+    const std::string path = "lexbench_" + name + ".src";
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << source;
+    }
+
+    size_t tokenCount = 0;
+    uint64_t allocs = 0;
+    double stringSeconds = timeRuns(repetitions, [&] {
+        const uint64_t before = allocations.load(std::memory_order_relaxed);
+        Lexer lexer(source);
+        tokenCount = lexer.tokenize().size();
+        allocs = allocations.load(std::memory_order_relaxed) - before;
+    });
+    report(name + " string", source.size(), tokenCount, allocs, stringSeconds, repetitions);
+
+    size_t mappedCount = 0;
+    double mappedSeconds = timeRuns(repetitions, [&] {
+        const uint64_t before = allocations.load(std::memory_order_relaxed);
+        std::unique_ptr<SourceBuffer> buffer = SourceBuffer::open(path);
+        Lexer lexer(*buffer);
+        mappedCount = lexer.tokenize().size();
+        allocs = allocations.load(std::memory_order_relaxed) - before;
+    });
+    report(name + " mmap", source.size(), mappedCount, allocs, mappedSeconds, repetitions);
+    std::remove(path.c_str());
+    if (mappedCount != tokenCount) std::cerr << "token count mismatch on " << name << "\n";
+}
+
+void reportMemory(const std::string& label, size_t bytes) {
+    std::cout << std::left << std::setw(16) << label << std::right << std::setw(10) << bytes / 1024
+              << " KiB held at peak\n";
+}
+
+void runStreamBench(const std::string& name, const std::string& source, int repetitions) {
+    const std::string path = "lexbench_" + name + ".src";
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << source;
+    }
+
+    size_t wholeCount = 0;
+    size_t wholeBytes = 0;
+    uint64_t allocs = 0;
+    double wholeSeconds = timeRuns(repetitions, [&] {
+        const uint64_t before = allocations.load(std::memory_order_relaxed);
+        std::unique_ptr<SourceBuffer> buffer = SourceBuffer::open(path);
+        Lexer lexer(*buffer);
+        std::vector<Token> tokens = lexer.tokenize();
+        wholeCount = tokens.size();
+        wholeBytes = source.size() + tokens.capacity() * sizeof(Token);
+        allocs = allocations.load(std::memory_order_relaxed) - before;
+    });
+    report(name + " whole", source.size(), wholeCount, allocs, wholeSeconds, repetitions);
+
+    size_t streamCount = 0;
+    size_t streamBytes = 0;
+    double streamSeconds = timeRuns(repetitions, [&] {
+        const uint64_t before = allocations.load(std::memory_order_relaxed);
+        std::ifstream in(path, std::ios::binary);
+        StreamingLexer lexer(in);
+        streamCount = 1;
+        while (lexer.next().type != TokenType::END_OF_FILE) ++streamCount;
+        streamBytes = lexer.bufferSize();
+        allocs = allocations.load(std::memory_order_relaxed) - before;
+    });
+    report(name + " stream", source.size(), streamCount, allocs, streamSeconds, repetitions);
+    reportMemory(name + " whole", wholeBytes);
+    reportMemory(name + " stream", streamBytes);
+    std::remove(path.c_str());
+    if (streamCount != wholeCount) std::cerr << "token count mismatch on " << name << "\n";
+}
+
+// Long string literals, some spanning lines, so chunk cuts land inside them
+std::string makeMultilineStringScript(size_t bytes) {
+    std::string src;
+    for (uint32_t i = 0; src.size() < bytes; ++i) {
+        const std::string n = std::to_string(i % 997);
+        src += "    banner_" + n + " = \"generated section " + n + "\n";
+        src += "spanning a few lines of text\n";
+        src += "before it closes\";\n";
+        src += "    count_" + n + " = count_" + n + " + 1;\n";
+    }
+    return src;
+}
+
+void runParallelBench(const std::string& name, const std::string& source, int repetitions) {
+    const std::string path = "lexbench_" + name + ".src";
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << source;
+    }
+    std::unique_ptr<SourceBuffer> buffer = SourceBuffer::open(path);
+
+    size_t serialCount = 0;
+    uint64_t allocs = 0;
+    double serialSeconds = timeRuns(repetitions, [&] {
+        const uint64_t before = allocations.load(std::memory_order_relaxed);
+        Lexer lexer(*buffer);
+        serialCount = lexer.tokenize().size();
+        allocs = allocations.load(std::memory_order_relaxed) - before;
+    });
+    report(name + " serial", source.size(), serialCount, allocs, serialSeconds, repetitions);
+
+    for (size_t threads : {1, 2, 4, 8}) {
+        size_t count = 0;
+        size_t chunks = 0;
+        size_t relexed = 0;
+        double seconds = timeRuns(repetitions, [&] {
+            const uint64_t before = allocations.load(std::memory_order_relaxed);
+            ParallelLexer lexer(*buffer, threads);
+            count = lexer.tokenize().size();
+            chunks = lexer.lastChunkCount();
+            relexed = lexer.lastRelexedCount();
+            allocs = allocations.load(std::memory_order_relaxed) - before;
+        });
+        report(name + " x" + std::to_string(threads), source.size(), count, allocs, seconds, repetitions);
+        std::cout << std::setw(16) << "" << chunks << " chunks, " << relexed << " lexed again\n";
+        if (count != serialCount) std::cerr << "token count mismatch on " << name << "\n";
+    }
+    std::remove(path.c_str());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int repetitions = argc > 1 ? std::atoi(argv[1]) : 20;
+
+    std::cout << "[lex]  (" << scan::backendName() << " scanning)\n";
+    runLexBench("expr1M", makeExpressionScript(1 << 20), repetitions);
+    runLexBench("mixed1M", makeMixedScript(1 << 20), repetitions);
+    runLexBench("ident1M", makeIdentifierScript(1 << 20), repetitions);
+    runLexBench("comment1M", makeCommentedScript(1 << 20), repetitions);
+    runLexBench("mixed16M", makeMixedScript(16 << 20), std::max(1, repetitions / 8));
+
+    std::cout << "\n[stream]\n";
+    runStreamBench("mixed1M", makeMixedScript(1 << 20), repetitions);
+    runStreamBench("comment1M", makeCommentedScript(1 << 20), repetitions);
+    runStreamBench("mixed16M", makeMixedScript(16 << 20), std::max(1, repetitions / 8));
+
+    std::cout << "\n[parallel]  (" << std::thread::hardware_concurrency() << " hardware threads)\n";
+    runParallelBench("mixed16M", makeMixedScript(16 << 20), std::max(1, repetitions / 8));
+    runParallelBench("mlstr16M", makeMultilineStringScript(16 << 20), std::max(1, repetitions / 8));
+    return 0;
+}
@@ -0,0 +1,859 @@
+// VM micro-benchmarks
+// ===================
+//
+// [dispatch]  Builds arithmetic-heavy IR programs directly, runs them through
+//             the Assembler and VirtualMachine, and reports dispatched
+//             instructions per second for every available dispatch engine
+//             (switch, threaded, and threaded with top-of-stack caching).
+// [loops]     Counted loops with a call per iteration (jumps, calls and
+//             returns through resolved offsets), per dispatch engine.
+// [fusion]    Same programs with and without superinstruction fusion.
+// [compact]   Fixed-width packed bytecode vs the variable-length compact
+//             encoding of the same programs: code size, and run time of the
+//             threaded interpreter vs the compact engine.
+// [backend]   Compiles the same generated source programs for the stack VM
+//             and the register VM and compares dispatch counts and run time.
+// [jit]       Interpreter vs template JIT on the same bytecode (skipped when
+//             the platform has no JIT support).
+// [batch]     BatchRunner throughput on many short runs of one program as
+//             the worker count grows (1, 2, 4, ... hardware threads).
+// [trace]     Cost per step of the instruction trace ring.
+// [startup]   Time to get a runnable program: the whole front end from
+//             source vs mapping a precompiled .mcbc file.
+// [snapshot]  Warm start: a long prologue run cold vs restored from a VM
+//             snapshot taken right after it; save and restore times.
+// [tiered]    Short and long loops: interpreter vs eager JIT vs tiered
+//             execution (interpret until hot, then on-stack replacement).
+// [lanes]     Per-record programs over columnar inputs: one scalar VM run
+//             per record vs the LaneVM (records per second), with and
+//             without a data-dependent branch.
+// [slices]    Cost of resumable execution: one execute() vs run(budget) in
+//             slices of several sizes, interpreted and native; then many
+//             VMs time-sliced by the Scheduler vs run one after another.
+// [print]     Printing lines through iostream (flushed per line with
+//             std::endl, or buffered) vs the VM's PRINT opcode and its
+//             batched output buffer.
+//
+//   vmbench [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include "codegen.h"
+#include "assembler.h"
+#include "bytecode_file.h"
+#include "vm.h"
+#include "regvm.h"
+#include "batch_runner.h"
+#include "lanevm.h"
+#include "scheduler.h"
+
+namespace {
+
+struct BenchProgram {
+    std::string name;
+    std::vector<Instruction> ir;
+};
+
+// a = a + b * 3 - c; b = b - a / 7; c = c * 2 + a; ... repeated `statements` times
+BenchProgram makeArithmetic(int statements) {
+    BenchProgram p{"arith", {}};
+    p.ir.emplace_back(OpCode::PUSH, "1");  p.ir.emplace_back(OpCode::STORE, "a");
+    p.ir.emplace_back(OpCode::PUSH, "2");  p.ir.emplace_back(OpCode::STORE, "b");
+    p.ir.emplace_back(OpCode::PUSH, "3");  p.ir.emplace_back(OpCode::STORE, "c");
+    for (int i = 0; i < statements; ++i) {
+        p.ir.emplace_back(OpCode::LOAD, "a");
+        p.ir.emplace_back(OpCode::LOAD, "b");
+        p.ir.emplace_back(OpCode::PUSH, "3");
+        p.ir.emplace_back(OpCode::MUL);
+        p.ir.emplace_back(OpCode::ADD);
+        p.ir.emplace_back(OpCode::LOAD, "c");
+        p.ir.emplace_back(OpCode::SUB);
+        p.ir.emplace_back(OpCode::STORE, "a");
+
+        p.ir.emplace_back(OpCode::LOAD, "b");
+        p.ir.emplace_back(OpCode::LOAD, "a");
+        p.ir.emplace_back(OpCode::PUSH, "7");
+        p.ir.emplace_back(OpCode::DIV);
+        p.ir.emplace_back(OpCode::SUB);
+        p.ir.emplace_back(OpCode::STORE, "b");
+
+        p.ir.emplace_back(OpCode::LOAD, "c");
+        p.ir.emplace_back(OpCode::PUSH, "2");
+        p.ir.emplace_back(OpCode::MUL);
+        p.ir.emplace_back(OpCode::LOAD, "a");
+        p.ir.emplace_back(OpCode::ADD);
+        p.ir.emplace_back(OpCode::PUSH, "1000");
+        p.ir.emplace_back(OpCode::DIV);
+        p.ir.emplace_back(OpCode::STORE, "c");
+    }
+    return p;
+}
+
+// flag = (x < y) == (y >= z) != (x > z); x = x + 1; ... repeated
+BenchProgram makeCompare(int statements) {
+    BenchProgram p{"compare", {}};
+    p.ir.emplace_back(OpCode::PUSH, "5");  p.ir.emplace_back(OpCode::STORE, "x");
+    p.ir.emplace_back(OpCode::PUSH, "9");  p.ir.emplace_back(OpCode::STORE, "y");
+    p.ir.emplace_back(OpCode::PUSH, "7");  p.ir.emplace_back(OpCode::STORE, "z");
+    for (int i = 0; i < statements; ++i) {
+        p.ir.emplace_back(OpCode::LOAD, "x");
+        p.ir.emplace_back(OpCode::LOAD, "y");
+        p.ir.emplace_back(OpCode::CMP_LT);
+        p.ir.emplace_back(OpCode::LOAD, "y");
+        p.ir.emplace_back(OpCode::LOAD, "z");
+        p.ir.emplace_back(OpCode::CMP_GE);
+        p.ir.emplace_back(OpCode::CMP_EQ);
+        p.ir.emplace_back(OpCode::LOAD, "x");
+        p.ir.emplace_back(OpCode::LOAD, "z");
+        p.ir.emplace_back(OpCode::CMP_GT);
+        p.ir.emplace_back(OpCode::CMP_NE);
+        p.ir.emplace_back(OpCode::STORE, "flag");
+
+        p.ir.emplace_back(OpCode::LOAD, "x");
+        p.ir.emplace_back(OpCode::PUSH, "1");
+        p.ir.emplace_back(OpCode::ADD);
+        p.ir.emplace_back(OpCode::NEG);
+        p.ir.emplace_back(OpCode::NEG);
+        p.ir.emplace_back(OpCode::STORE, "x");
+    }
+    return p;
+}
+
+// i = 0; while (i < n) { acc = acc + i * 3 - (acc / 7); call mix; i = i + 1; }
+BenchProgram makeLoop(int iterations) {
+    BenchProgram p{"loop", {}};
+    p.ir.emplace_back(OpCode::PUSH, "0");  p.ir.emplace_back(OpCode::STORE, "i");
+    p.ir.emplace_back(OpCode::PUSH, "0");  p.ir.emplace_back(OpCode::STORE, "acc");
+    p.ir.emplace_back(OpCode::LABEL, "loop");
+    p.ir.emplace_back(OpCode::LOAD, "i");
+    p.ir.emplace_back(OpCode::PUSH, std::to_string(iterations));
+    p.ir.emplace_back(OpCode::CMP_LT);
+    p.ir.emplace_back(OpCode::JUMP_IF_FALSE, "done");
+    p.ir.emplace_back(OpCode::LOAD, "acc");
+    p.ir.emplace_back(OpCode::LOAD, "i");
+    p.ir.emplace_back(OpCode::PUSH, "3");
+    p.ir.emplace_back(OpCode::MUL);
+    p.ir.emplace_back(OpCode::ADD);
+    p.ir.emplace_back(OpCode::LOAD, "acc");
+    p.ir.emplace_back(OpCode::PUSH, "7");
+    p.ir.emplace_back(OpCode::DIV);
+    p.ir.emplace_back(OpCode::SUB);
+    p.ir.emplace_back(OpCode::STORE, "acc");
+    p.ir.emplace_back(OpCode::CALL, "mix");
+    p.ir.emplace_back(OpCode::LOAD, "i");
+    p.ir.emplace_back(OpCode::PUSH, "1");
+    p.ir.emplace_back(OpCode::ADD);
+    p.ir.emplace_back(OpCode::STORE, "i");
+    p.ir.emplace_back(OpCode::JUMP, "loop");
+    p.ir.emplace_back(OpCode::LABEL, "done");
+    p.ir.emplace_back(OpCode::RETURN);
+    // mix: m = (m + acc) * 5 / 4
+    p.ir.emplace_back(OpCode::LABEL, "mix");
+    p.ir.emplace_back(OpCode::LOAD, "m");
+    p.ir.emplace_back(OpCode::LOAD, "acc");
+    p.ir.emplace_back(OpCode::ADD);
+    p.ir.emplace_back(OpCode::PUSH, "5");
+    p.ir.emplace_back(OpCode::MUL);
+    p.ir.emplace_back(OpCode::PUSH, "4");
+    p.ir.emplace_back(OpCode::DIV);
+    p.ir.emplace_back(OpCode::STORE, "m");
+    p.ir.emplace_back(OpCode::RETURN);
+    return p;
+}
+
+// for (i = 0; i < lines; i++) print(i * 37 - 1000)
+BenchProgram makePrintLoop(int lines) {
+    BenchProgram p{"print", {}};
+    p.ir.emplace_back(OpCode::PUSH, "0");  p.ir.emplace_back(OpCode::STORE, "i");
+    p.ir.emplace_back(OpCode::LABEL, "loop");
+    p.ir.emplace_back(OpCode::LOAD, "i");
+    p.ir.emplace_back(OpCode::PUSH, "37");
+    p.ir.emplace_back(OpCode::MUL);
+    p.ir.emplace_back(OpCode::PUSH, "1000");
+    p.ir.emplace_back(OpCode::SUB);
+    p.ir.emplace_back(OpCode::PRINT);
+    p.ir.emplace_back(OpCode::LOAD, "i");
+    p.ir.emplace_back(OpCode::PUSH, "1");
+    p.ir.emplace_back(OpCode::ADD);
+    p.ir.emplace_back(OpCode::STORE, "i");
+    p.ir.emplace_back(OpCode::LOAD, "i");
+    p.ir.emplace_back(OpCode::PUSH, std::to_string(lines));
+    p.ir.emplace_back(OpCode::CMP_LT);
+    p.ir.emplace_back(OpCode::JUMP_IF_TRUE, "loop");
+    p.ir.emplace_back(OpCode::RETURN);
+    return p;
+}
+
+// Prologue: a loop of `iterations` filling t0..t3 and a string, then
+// `call work`, a short loop over the results. The prologue's back-edges
+// cost `iterations` x loop length, so running exactly that budget stops
+// at the entry of work (see runSnapshotBench).
+BenchProgram makeWarmStart(int iterations) {
+    BenchProgram p{"warm", {}};
+    p.ir.emplace_back(OpCode::PUSH, "\"table\"");  p.ir.emplace_back(OpCode::STORE, "name");
+    p.ir.emplace_back(OpCode::PUSH, "0");  p.ir.emplace_back(OpCode::STORE, "i");
+    p.ir.emplace_back(OpCode::LABEL, "init");
+    p.ir.emplace_back(OpCode::LOAD, "i");
+    p.ir.emplace_back(OpCode::PUSH, std::to_string(iterations));
+    p.ir.emplace_back(OpCode::CMP_LT);
+    p.ir.emplace_back(OpCode::JUMP_IF_FALSE, "ready");
+    const char* tables[] = {"t0", "t1", "t2", "t3"};
+    for (int t = 0; t < 4; ++t) {
+        p.ir.emplace_back(OpCode::LOAD, tables[t]);
+        p.ir.emplace_back(OpCode::LOAD, "i");
+        p.ir.emplace_back(OpCode::PUSH, std::to_string(t + 3));
+        p.ir.emplace_back(OpCode::MUL);
+        p.ir.emplace_back(OpCode::ADD);
+        p.ir.emplace_back(OpCode::PUSH, "7");
+        p.ir.emplace_back(OpCode::DIV);
+        p.ir.emplace_back(OpCode::STORE, tables[t]);
+    }
+    p.ir.emplace_back(OpCode::LOAD, "i");
+    p.ir.emplace_back(OpCode::PUSH, "1");
+    p.ir.emplace_back(OpCode::ADD);
+    p.ir.emplace_back(OpCode::STORE, "i");
+    p.ir.emplace_back(OpCode::JUMP, "init");
+    p.ir.emplace_back(OpCode::LABEL, "ready");
+    p.ir.emplace_back(OpCode::CALL, "work");
+    p.ir.emplace_back(OpCode::RETURN);
+    // work: acc = acc + t0 - t1 + t2 - t3, 10 times
+    p.ir.emplace_back(OpCode::LABEL, "work");
+    p.ir.emplace_back(OpCode::PUSH, "0");  p.ir.emplace_back(OpCode::STORE, "j");
+    p.ir.emplace_back(OpCode::LABEL, "step");
+    p.ir.emplace_back(OpCode::LOAD, "j");
+    p.ir.emplace_back(OpCode::PUSH, "10");
+    p.ir.emplace_back(OpCode::CMP_LT);
+    p.ir.emplace_back(OpCode::JUMP_IF_FALSE, "end");
+    p.ir.emplace_back(OpCode::LOAD, "acc");
+    for (int t = 0; t < 4; ++t) {
+        p.ir.emplace_back(OpCode::LOAD, tables[t]);
+        p.ir.emplace_back(t % 2 ? OpCode::SUB : OpCode::ADD);
+    }
+    p.ir.emplace_back(OpCode::STORE, "acc");
+    p.ir.emplace_back(OpCode::LOAD, "j");
+    p.ir.emplace_back(OpCode::PUSH, "1");
+    p.ir.emplace_back(OpCode::ADD);
+    p.ir.emplace_back(OpCode::STORE, "j");
+    p.ir.emplace_back(OpCode::JUMP, "step");
+    p.ir.emplace_back(OpCode::LABEL, "end");
+    p.ir.emplace_back(OpCode::RETURN);
+    return p;
+}
+
+// Per-record scoring over inputs x and y: a chain of arithmetic on the
+// record, optionally with an if/else on x > y (records diverge)
+BenchProgram makeRecord(bool branchy) {
+    BenchProgram p{branchy ? "branchy" : "straight", {}};
+    for (int i = 0; i < 8; ++i) {
+        p.ir.emplace_back(OpCode::LOAD, "x");
+        p.ir.emplace_back(OpCode::PUSH, std::to_string(i + 3));
+        p.ir.emplace_back(OpCode::MUL);
+        p.ir.emplace_back(OpCode::LOAD, "y");
+        p.ir.emplace_back(OpCode::ADD);
+        p.ir.emplace_back(OpCode::LOAD, "score");
+        p.ir.emplace_back(OpCode::SUB);
+        p.ir.emplace_back(OpCode::STORE, "score");
+    }
+    if (branchy) {
+        p.ir.emplace_back(OpCode::LOAD, "x");
+        p.ir.emplace_back(OpCode::LOAD, "y");
+        p.ir.emplace_back(OpCode::CMP_GT);
+        p.ir.emplace_back(OpCode::JUMP_IF_FALSE, "else");
+        p.ir.emplace_back(OpCode::LOAD, "score");
+        p.ir.emplace_back(OpCode::LOAD, "y");
+        p.ir.emplace_back(OpCode::PUSH, "2");
+        p.ir.emplace_back(OpCode::MUL);
+        p.ir.emplace_back(OpCode::SUB);
+        p.ir.emplace_back(OpCode::STORE, "score");
+        p.ir.emplace_back(OpCode::JUMP, "end");
+        p.ir.emplace_back(OpCode::LABEL, "else");
+        p.ir.emplace_back(OpCode::LOAD, "score");
+        p.ir.emplace_back(OpCode::LOAD, "x");
+        p.ir.emplace_back(OpCode::ADD);
+        p.ir.emplace_back(OpCode::STORE, "score");
+        p.ir.emplace_back(OpCode::LABEL, "end");
+    }
+    p.ir.emplace_back(OpCode::LOAD, "score");
+    p.ir.emplace_back(OpCode::PUSH, "50");
+    p.ir.emplace_back(OpCode::CMP_LT);
+    p.ir.emplace_back(OpCode::STORE, "low");
+    return p;
+}
+
+const char* dispatchName(DispatchMode mode) {
+    if (mode == DispatchMode::CachedTop) return "cached";
+    return mode == DispatchMode::Threaded ? "threaded" : "switch";
+}
+
+std::vector<DispatchMode> dispatchModes() {
+    std::vector<DispatchMode> modes{DispatchMode::Switch};
+    if (VirtualMachine::hasThreadedDispatch()) {
+        modes.push_back(DispatchMode::Threaded);
+        modes.push_back(DispatchMode::CachedTop);
+    }
+    return modes;
+}
+
+// Appended to the CachedTop row: its time relative to Threaded's
+std::string cachedGain(DispatchMode mode, double seconds, double threadedSeconds) {
+    if (mode != DispatchMode::CachedTop || threadedSeconds <= 0) return "";
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(0) << "  " << std::showpos
+        << (threadedSeconds / seconds - 1) * 100 << "% vs threaded";
+    return out.str();
+}
+
+void runDispatchBench(const BenchProgram& prog, int repetitions) {
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+
+    double threadedSeconds = 0;
+    for (DispatchMode mode : dispatchModes()) {
+        VirtualMachine vm;
+        vm.setDispatchMode(mode);
+        vm.execute(bytecode); // warm-up
+
+        auto begin = std::chrono::steady_clock::now();
+        for (int r = 0; r < repetitions; ++r) vm.execute(bytecode);
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - begin).count();
+        double instructions = static_cast<double>(bytecode.code.size()) * repetitions;
+        std::cout << std::left << std::setw(10) << prog.name
+                  << std::setw(10) << dispatchName(mode)
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << instructions / seconds / 1e6 << " M instr/s"
+                  << std::setw(10) << seconds * 1e3 << " ms" << cachedGain(mode, seconds, threadedSeconds) << "\n";
+        if (mode == DispatchMode::Threaded) threadedSeconds = seconds;
+    }
+}
+
+void runLoopBench(int iterations, int repetitions) {
+    BenchProgram prog = makeLoop(iterations);
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+
+    double threadedSeconds = 0;
+    for (DispatchMode mode : dispatchModes()) {
+        VirtualMachine vm;
+        vm.setDispatchMode(mode);
+        vm.execute(bytecode); // warm-up
+
+        auto begin = std::chrono::steady_clock::now();
+        for (int r = 0; r < repetitions; ++r) vm.execute(bytecode);
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - begin).count();
+        double loops = double(iterations) * repetitions;
+        std::cout << std::left << std::setw(10) << prog.name
+                  << std::setw(10) << dispatchName(mode)
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << loops / seconds / 1e6 << " M iter/s"
+                  << std::setw(10) << seconds * 1e3 << " ms" << cachedGain(mode, seconds, threadedSeconds) << "\n";
+        if (mode == DispatchMode::Threaded) threadedSeconds = seconds;
+    }
+}
+
+void runFusionBench(const BenchProgram& prog, int repetitions) {
+    for (bool fusion : {false, true}) {
+        Assembler assembler;
+        assembler.setFusion(fusion);
+        assembler.assemble(prog.ir);
+        const BytecodeProgram& bytecode = assembler.getBytecode();
+
+        VirtualMachine vm;
+        vm.execute(bytecode); // warm-up
+        auto begin = std::chrono::steady_clock::now();
+        for (int r = 0; r < repetitions; ++r) vm.execute(bytecode);
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - begin).count();
+        std::cout << std::left << std::setw(10) << prog.name
+                  << std::setw(10) << (fusion ? "fused" : "plain")
+                  << std::right << std::setw(8) << bytecode.code.size() << " instr"
+                  << std::fixed << std::setprecision(1) << std::setw(10) << seconds * 1e3 << " ms\n";
+    }
+}
+
+// Expression-heavy source: every statement mixes several operators
+std::string makeExpressionSource(int statements) {
+    std::string src = "a = 1; b = 2; c = 3; d = 4;\n";
+    for (int i = 0; i < statements; ++i) {
+        src += "a = (a + b * 3 - c) / 2;\n";
+        src += "b = b - a * (d + 7) / 5 + c;\n";
+        src += "c = (a < b) + (c * 2 + d) / 3 - 1;\n";
+        src += "d = -(a - b) * (c + 1) / 9 + (d >= 4);\n";
+    }
+    return src;
+}
+
+template <typename Fn>
+double timeRuns(int repetitions, Fn&& run) {
+    run(); // warm-up
+    auto begin = std::chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; ++r) run();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+void runBackendBench(const std::string& name, const std::string& source, int repetitions) {
+    Lexer lexer(source);
+    Parser parser(lexer.tokenize());
+    std::unique_ptr<ASTNode> ast = parser.parseProgram();
+    SemanticAnalyzer sema;
+    sema.analyze(ast);
+    CodeGenerator codegen;
+    codegen.setSymbolTable(&sema.getSymbolTable());
+    codegen.generate(ast);
+    codegen.generateThreeAddress(ast);
+
+    Assembler assembler;
+    assembler.assemble(codegen.getInstructions());
+    assembler.assembleRegister(codegen.getThreeAddressCode());
+    const BytecodeProgram& stackProgram = assembler.getBytecode();
+    const RegisterProgram& registerProgram = assembler.getRegisterProgram();
+
+    VirtualMachine stackVM;
+    RegisterVM registerVM;
+    double stackSeconds = timeRuns(repetitions, [&] { stackVM.execute(stackProgram); });
+    double registerSeconds = timeRuns(repetitions, [&] { registerVM.execute(registerProgram); });
+    if (stackVM.getVariable("d") != registerVM.getVariable("d")) {
+        std::cerr << "backend mismatch on " << name << "\n";
+    }
+
+    size_t stackCount = stackProgram.code.size();
+    size_t registerCount = registerProgram.code.size();
+    std::cout << std::left << std::setw(10) << name << std::right
+              << "stack " << std::setw(8) << stackCount << " instr " << std::fixed << std::setprecision(1)
+              << std::setw(8) << stackSeconds * 1e3 << " ms | register " << std::setw(8) << registerCount
+              << " instr " << std::setw(8) << registerSeconds * 1e3 << " ms | "
+              << std::setprecision(0) << 100.0 * (1.0 - double(registerCount) / double(stackCount))
+              << "% fewer dispatches\n";
+}
+
+void runCompactBench(const BenchProgram& prog, int repetitions) {
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+    CompactProgram compact = encodeCompact(bytecode);
+
+    std::vector<BytecodeInstruction> decoded = decodeCompact(compact);
+    bool same = decoded.size() == bytecode.code.size();
+    for (size_t ip = 0; same && ip < decoded.size(); ++ip) {
+        same = decoded[ip].opcode == bytecode.code[ip].opcode && decoded[ip].operand1 == bytecode.code[ip].operand1 &&
+               decoded[ip].operand2 == bytecode.code[ip].operand2;
+    }
+    if (!same) std::cerr << "compact round trip mismatch on " << prog.name << "\n";
+
+    VirtualMachine packedVM;
+    packedVM.setDispatchMode(DispatchMode::Threaded);
+    VirtualMachine compactVM;
+    double packedSeconds = timeRuns(repetitions, [&] { packedVM.execute(bytecode); });
+    double compactSeconds = timeRuns(repetitions, [&] { compactVM.execute(compact); });
+    if (packedVM.getGlobals() != compactVM.getGlobals()) std::cerr << "compact mismatch on " << prog.name << "\n";
+
+    const size_t packedBytes = bytecode.code.size() * sizeof(BytecodeInstruction);
+    std::cout << std::left << std::setw(10) << prog.name << std::right << std::fixed << std::setprecision(1)
+              << "packed " << std::setw(8) << packedBytes << " B " << std::setw(7) << packedSeconds * 1e3
+              << " ms | compact " << std::setw(8) << compact.code.size() << " B (" << std::setprecision(2)
+              << double(compact.code.size()) / bytecode.code.size() << " B/instr) " << std::setprecision(1)
+              << std::setw(7) << compactSeconds * 1e3 << " ms | " << std::setprecision(0) << std::showpos
+              << 100.0 * (packedSeconds / compactSeconds - 1.0) << std::noshowpos << "% speed\n";
+}
+
+void runBatchBench(int jobCount, int iterations) {
+    BenchProgram prog = makeLoop(iterations);
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+    std::vector<BatchJob> jobs(static_cast<size_t>(jobCount));
+
+    size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < hardware; threads *= 2) threadCounts.push_back(threads);
+    threadCounts.push_back(hardware);
+
+    double baseline = 0;
+    for (size_t threads : threadCounts) {
+        BatchRunner runner(threads);
+        double seconds = timeRuns(3, [&] { runner.run(bytecode, jobs); }) / 3;
+        if (threads == 1) baseline = seconds;
+        double speedup = baseline / seconds;
+        std::cout << std::left << std::setw(10) << (std::to_string(threads) + " thr") << std::right
+                  << std::fixed << std::setprecision(0) << std::setw(10) << jobCount / seconds << " jobs/s"
+                  << std::setprecision(2) << std::setw(8) << speedup << "x" << std::setprecision(0)
+                  << std::setw(6) << 100.0 * speedup / double(threads) << "% eff  steals "
+                  << runner.lastBatchSteals() << "\n";
+    }
+}
+
+void runTraceBench(int iterations, int repetitions) {
+    BenchProgram prog = makeLoop(iterations);
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+
+    VirtualMachine plain;
+    VirtualMachine traced;
+    traced.setTracing(true);
+    double plainSeconds = timeRuns(repetitions, [&] { plain.execute(bytecode); });
+    double tracedSeconds = timeRuns(repetitions, [&] { traced.execute(bytecode); });
+    uint64_t steps = traced.getTrace()->totalSteps() / uint64_t(repetitions + 1);
+
+    std::cout << std::left << std::setw(10) << prog.name << std::right << std::fixed << std::setprecision(2)
+              << "off " << std::setw(6) << plainSeconds / repetitions / steps * 1e9 << " ns/step | on "
+              << std::setw(6) << tracedSeconds / repetitions / steps * 1e9 << " ns/step | +"
+              << (tracedSeconds - plainSeconds) / repetitions / steps * 1e9 << " ns\n";
+}
+
+void compileSource(const std::string& source, Assembler& assembler) {
+    Lexer lexer(source);
+    Parser parser(lexer.tokenize());
+    std::unique_ptr<ASTNode> ast = parser.parseProgram();
+    SemanticAnalyzer sema;
+    sema.analyze(ast);
+    CodeGenerator codegen;
+    codegen.setSymbolTable(&sema.getSymbolTable());
+    codegen.generate(ast);
+    assembler.assemble(codegen.getInstructions());
+}
+
+void runStartupBench(const std::string& name, const std::string& source, int repetitions) {
+    const std::string path = "vmbench_startup.mcbc";
+    Assembler assembler;
+    compileSource(source, assembler);
+    writeBytecodeFile(path, assembler.getBytecode());
+
+    double compileSeconds = timeRuns(repetitions, [&] {
+        Assembler fresh;
+        compileSource(source, fresh);
+    });
+    size_t loaded = 0;
+    double loadSeconds = timeRuns(repetitions, [&] {
+        std::unique_ptr<BytecodeFile> file = BytecodeFile::open(path);
+        loaded = file->instructionCount();
+    });
+    std::remove(path.c_str());
+    if (loaded != assembler.getBytecode().code.size()) std::cerr << "startup mismatch on " << name << "\n";
+
+    std::cout << std::left << std::setw(10) << name << std::right << std::setw(8) << loaded << " instr | "
+              << std::fixed << std::setprecision(1) << "source " << std::setw(9)
+              << compileSeconds / repetitions * 1e6 << " us | .mcbc " << std::setw(7)
+              << loadSeconds / repetitions * 1e6 << " us\n";
+}
+
+void runSnapshotBench(int iterations, int repetitions) {
+    const std::string path = "vmbench_snapshot.mcvs";
+    BenchProgram prog = makeWarmStart(iterations);
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+
+    // The prologue loop is the first backward jump
+    int64_t loopLength = 0;
+    for (size_t ip = 0; ip < bytecode.code.size() && loopLength == 0; ++ip) {
+        const BytecodeInstruction& in = bytecode.code[ip];
+        if (in.opcode == VMOpCode::VM_JUMP && static_cast<size_t>(in.operand1) <= ip) {
+            loopLength = static_cast<int64_t>(ip) - in.operand1 + 1;
+        }
+    }
+    const int64_t prologueBudget = loopLength * iterations;
+
+    VirtualMachine cold;
+    double coldSeconds = timeRuns(repetitions, [&] { cold.execute(bytecode); });
+
+    VirtualMachine init;
+    init.load(bytecode);
+    init.run(prologueBudget);
+    double saveSeconds = timeRuns(repetitions, [&] { init.saveSnapshot(path); });
+
+    std::unique_ptr<VMSnapshot> snapshot;
+    VirtualMachine warm;
+    double openSeconds = timeRuns(repetitions, [&] { snapshot = VMSnapshot::open(path); });
+    double restoreSeconds = timeRuns(repetitions, [&] { warm.restore(bytecode, *snapshot); });
+    double warmSeconds = timeRuns(repetitions, [&] {
+        warm.restore(bytecode, *snapshot);
+        warm.run(INT64_MAX);
+    });
+    size_t bytes = 0;
+    if (FILE* file = std::fopen(path.c_str(), "rb")) {
+        std::fseek(file, 0, SEEK_END);
+        bytes = static_cast<size_t>(std::ftell(file));
+        std::fclose(file);
+    }
+    std::remove(path.c_str());
+    if (warm.getStatus() != RunStatus::Finished || warm.getGlobals() != cold.getGlobals()) {
+        std::cerr << "snapshot mismatch on " << prog.name << "\n";
+    }
+
+    std::cout << std::left << std::setw(10) << (std::to_string(iterations) + "x") << std::right << std::fixed
+              << std::setprecision(1) << "cold " << std::setw(8) << coldSeconds / repetitions * 1e6
+              << " us | save " << std::setw(5) << saveSeconds / repetitions * 1e6 << " us | open "
+              << std::setw(5) << openSeconds / repetitions * 1e6 << " us | restore " << std::setw(5)
+              << restoreSeconds / repetitions * 1e6 << " us | warm " << std::setw(6)
+              << warmSeconds / repetitions * 1e6 << " us | " << bytes << " bytes\n";
+}
+
+void runJitBench(const BenchProgram& prog, int repetitions) {
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+
+    VirtualMachine interpreter;
+    VirtualMachine jit;
+    jit.setExecutionMode(ExecutionMode::Jit);
+    double interpSeconds = timeRuns(repetitions, [&] { interpreter.execute(bytecode); });
+    double jitSeconds = timeRuns(repetitions, [&] { jit.execute(bytecode); });
+    if (!jit.lastRunUsedJit()) {
+        std::cout << std::left << std::setw(10) << prog.name << "not compiled\n";
+        return;
+    }
+    if (interpreter.getVariable(prog.ir[1].operand1) != jit.getVariable(prog.ir[1].operand1)) {
+        std::cerr << "jit mismatch on " << prog.name << "\n";
+    }
+
+    std::cout << std::left << std::setw(10) << prog.name << std::right << std::fixed << std::setprecision(1)
+              << "interp " << std::setw(8) << interpSeconds * 1e3 << " ms | jit "
+              << std::setw(8) << jitSeconds * 1e3 << " ms | "
+              << std::setprecision(2) << interpSeconds / jitSeconds << "x\n";
+}
+
+void runTieredBench(int iterations, int repetitions) {
+    BenchProgram prog = makeLoop(iterations);
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+
+    std::cout << std::left << std::setw(10) << (std::to_string(iterations) + "x") << std::right;
+    const ExecutionMode modes[] = {ExecutionMode::Interpret, ExecutionMode::Jit, ExecutionMode::Tiered};
+    const char* names[] = {"interp", "jit", "tiered"};
+    for (int m = 0; m < 3; ++m) {
+        // A fresh VM per run so every mode pays its own compilation cost
+        bool compiled = false;
+        double seconds = timeRuns(repetitions, [&] {
+            VirtualMachine vm;
+            vm.setExecutionMode(modes[m]);
+            vm.execute(bytecode);
+            compiled = vm.lastRunUsedJit();
+        });
+        std::cout << names[m] << " " << std::fixed << std::setprecision(1) << std::setw(8)
+                  << seconds * 1e3 << " ms" << (compiled ? "*" : " ") << (m < 2 ? " | " : "\n");
+    }
+}
+
+void runLanesBench(const BenchProgram& prog, size_t rows, int repetitions) {
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+
+    ColumnSet inputs;
+    std::vector<int32_t>& xs = inputs["x"];
+    std::vector<int32_t>& ys = inputs["y"];
+    for (size_t row = 0; row < rows; ++row) {
+        xs.push_back(static_cast<int32_t>(row * 7919 % 100));
+        ys.push_back(static_cast<int32_t>(row * 104729 % 100));
+    }
+    size_t xSlot = 0, ySlot = 0;
+    for (size_t slot = 0; slot < bytecode.slotNames.size(); ++slot) {
+        if (bytecode.slotNames[slot] == "x") xSlot = slot;
+        if (bytecode.slotNames[slot] == "y") ySlot = slot;
+    }
+
+    VirtualMachine vm;
+    std::vector<Value> record(bytecode.slotNames.size());
+    int32_t lastScalar = 0;
+    double scalarSeconds = timeRuns(repetitions, [&] {
+        for (size_t row = 0; row < rows; ++row) {
+            record[xSlot] = Value::integer(xs[row]);
+            record[ySlot] = Value::integer(ys[row]);
+            vm.execute(bytecode, record);
+        }
+        lastScalar = vm.getVariable("score").asInt();
+    });
+
+    LaneVM lanes;
+    double laneSeconds = timeRuns(repetitions, [&] { lanes.execute(bytecode, inputs, rows); });
+    if (lanes.getColumn("score").back() != lastScalar) std::cerr << "lanes mismatch on " << prog.name << "\n";
+
+    double total = static_cast<double>(rows) * repetitions;
+    std::cout << std::left << std::setw(10) << prog.name << std::right << std::fixed << std::setprecision(1)
+              << "scalar " << std::setw(8) << total / scalarSeconds / 1e6 << " M rec/s | lanes "
+              << std::setw(8) << total / laneSeconds / 1e6 << " M rec/s | "
+              << std::setprecision(2) << scalarSeconds / laneSeconds << "x\n";
+}
+
+void runSliceBench(int iterations, int repetitions) {
+    BenchProgram prog = makeLoop(iterations);
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+
+    const ExecutionMode modes[] = {ExecutionMode::Interpret, ExecutionMode::Jit};
+    const char* names[] = {"interp", "jit"};
+    for (int m = 0; m < (JitCompiler::isSupported() ? 2 : 1); ++m) {
+        VirtualMachine vm;
+        vm.setExecutionMode(modes[m]);
+        double whole = timeRuns(repetitions, [&] { vm.execute(bytecode); });
+        const Value expected = vm.getVariable("acc");
+        std::cout << std::left << std::setw(10) << names[m] << std::right << std::fixed << std::setprecision(1)
+                  << "execute " << std::setw(7) << whole * 1e3 << " ms";
+        for (int64_t slice : {100, 1000, 10000}) {
+            double seconds = timeRuns(repetitions, [&] {
+                vm.load(bytecode);
+                while (vm.run(slice) == RunStatus::Yielded) {}
+            });
+            if (vm.getVariable("acc") != expected) std::cerr << "slice mismatch at " << slice << "\n";
+            std::cout << " | " << slice << ": " << std::setw(6) << seconds * 1e3 << " ms ("
+                      << std::showpos << std::setprecision(0) << 100.0 * (seconds / whole - 1.0) << "%)"
+                      << std::noshowpos << std::setprecision(1);
+        }
+        std::cout << "\n";
+    }
+}
+
+// Printing the same lines to /dev/null: iostream with std::endl (a write
+// per line, as the old driver paths print), iostream with '\n' (buffered),
+// and the VM's PRINT with its batched output buffer
+void runPrintBench(int lines, int repetitions) {
+    BenchProgram prog = makePrintLoop(lines);
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+
+    std::ofstream devNull("/dev/null");
+    double endlSeconds = timeRuns(repetitions, [&] {
+        for (int i = 0; i < lines; ++i) devNull << i * 37 - 1000 << std::endl;
+    });
+    double newlineSeconds = timeRuns(repetitions, [&] {
+        for (int i = 0; i < lines; ++i) devNull << i * 37 - 1000 << '\n';
+        devNull.flush();
+    });
+    const int fd = ::open("/dev/null", O_WRONLY);
+    VirtualMachine vm;
+    vm.setOutputFd(fd);
+    double vmSeconds = timeRuns(repetitions, [&] { vm.execute(bytecode); });
+    vm.setOutputFd(1);
+    ::close(fd);
+
+    const double total = double(lines) * repetitions;
+    std::cout << std::left << std::setw(10) << (std::to_string(lines) + " ln") << std::right << std::fixed
+              << std::setprecision(1) << "endl " << std::setw(6) << total / endlSeconds / 1e6 << " M lines/s | '\\n' "
+              << std::setw(6) << total / newlineSeconds / 1e6 << " M lines/s | VM PRINT " << std::setw(6)
+              << total / vmSeconds / 1e6 << " M lines/s | " << std::setprecision(1) << endlSeconds / vmSeconds
+              << "x vs endl\n";
+}
+
+void runSchedulerBench(size_t vmCount, int iterations, int64_t slice) {
+    BenchProgram prog = makeLoop(iterations);
+    Assembler assembler;
+    assembler.assemble(prog.ir);
+    const BytecodeProgram& bytecode = assembler.getBytecode();
+    std::vector<VirtualMachine> vms(vmCount);
+
+    double serial = timeRuns(1, [&] {
+        for (VirtualMachine& vm : vms) vm.execute(bytecode);
+    });
+    Scheduler scheduler(0, slice);
+    uint64_t slices = 0;
+    double sliced = timeRuns(1, [&] {
+        const uint64_t before = scheduler.sliceCount();
+        for (VirtualMachine& vm : vms) {
+            vm.load(bytecode);
+            scheduler.submit(vm);
+        }
+        scheduler.wait();
+        slices = scheduler.sliceCount() - before;
+    });
+    for (VirtualMachine& vm : vms) {
+        if (vm.getStatus() != RunStatus::Finished) std::cerr << "scheduler: a VM did not finish\n";
+    }
+
+    std::cout << std::left << std::setw(10) << (std::to_string(vmCount) + " vm") << std::right << std::fixed
+              << std::setprecision(0) << "serial " << std::setw(8) << vmCount / serial << " vm/s | "
+              << scheduler.threadCount() << " thr, slice " << slice << " " << std::setw(8)
+              << vmCount / sliced << " vm/s | " << slices << " slices\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int repetitions = argc > 1 ? std::atoi(argv[1]) : 2000;
+
+    std::vector<BenchProgram> programs{makeArithmetic(2000), makeCompare(2000)};
+
+    std::cout << "[dispatch]\n";
+    for (const auto& prog : programs) runDispatchBench(prog, repetitions);
+
+    std::cout << "\n[loops]\n";
+    runLoopBench(100000, std::max(1, repetitions / 50));
+
+    std::cout << "\n[fusion]\n";
+    for (const auto& prog : programs) runFusionBench(prog, repetitions);
+
+    std::cout << "\n[compact]\n";
+    for (const auto& prog : programs) runCompactBench(prog, repetitions);
+    BenchProgram large = makeArithmetic(50000);
+    large.name = "arith50k";
+    runCompactBench(large, std::max(1, repetitions / 25));
+    runCompactBench(makeLoop(100000), std::max(1, repetitions / 50));
+
+    std::cout << "\n[backend]\n";
+    runBackendBench("expr", makeExpressionSource(500), repetitions);
+
+    std::cout << "\n[batch]  (" << std::max(1u, std::thread::hardware_concurrency()) << " hardware threads)\n";
+    runBatchBench(std::max(1, repetitions * 2), 2000);
+
+    std::cout << "\n[trace]\n";
+    runTraceBench(100000, std::max(1, repetitions / 50));
+
+    std::cout << "\n[startup]\n";
+    runStartupBench("expr50", makeExpressionSource(50), std::max(1, repetitions / 10));
+    runStartupBench("expr500", makeExpressionSource(500), std::max(1, repetitions / 10));
+
+    std::cout << "\n[snapshot]\n";
+    runSnapshotBench(10000, std::max(1, repetitions / 10));
+    runSnapshotBench(1000000, std::max(1, repetitions / 200));
+
+    std::cout << "\n[jit]\n";
+    if (JitCompiler::isSupported()) {
+        for (const auto& prog : programs) runJitBench(prog, repetitions);
+        runJitBench(makeLoop(100000), std::max(1, repetitions / 50));
+
+        std::cout << "\n[tiered]  (* = ran native code)\n";
+        runTieredBench(20, repetitions);
+        runTieredBench(100000, std::max(1, repetitions / 50));
+    } else {
+        std::cout << "not supported on this platform\n";
+    }
+
+    std::cout << "\n[lanes]  (" << LaneVM::simdBackend() << ", " << lanes::kWidth << " lanes)\n";
+    for (bool branchy : {false, true}) {
+        runLanesBench(makeRecord(branchy), 100000, std::max(1, repetitions / 200));
+    }
+
+    std::cout << "\n[slices]\n";
+    runSliceBench(100000, std::max(1, repetitions / 50));
+    runSchedulerBench(1000, 2000, 1000);
+
+    std::cout << "\n[print]\n";
+    runPrintBench(100000, std::max(1, repetitions / 100));
+    return 0;
+}
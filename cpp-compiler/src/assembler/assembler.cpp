@@ -1,21 +1,225 @@
 #include "assembler.h"
+#include "bytecode_verifier.h"
 #include <stdexcept>
 #include <iostream>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <sstream>
+
+const char* vmOpCodeName(VMOpCode op) {
+    static const char* const names[] = {
+#define VM_OPCODE_NAME(name) #name,
+        VM_OPCODE_LIST(VM_OPCODE_NAME)
+#undef VM_OPCODE_NAME
+    };
+    return names[static_cast<uint8_t>(op)] + 3;  // skip "VM_"
+}
+
+VMOperandKind vmOperandKind(VMOpCode op, int operand) {
+    const VMOperandKind None = VMOperandKind::None;
+    const VMOperandKind Imm = VMOperandKind::Immediate;
+    const VMOperandKind Slot = VMOperandKind::Slot;
+    const VMOperandKind Target = VMOperandKind::Target;
+    VMOperandKind first = None, second = None;
+    switch (op) {
+        case VMOpCode::VM_PUSH:
+            first = Imm;
+            break;
+        case VMOpCode::VM_PUSH_CONST:
+            first = VMOperandKind::Constant;
+            break;
+        case VMOpCode::VM_LOAD:
+        case VMOpCode::VM_STORE:
+        case VMOpCode::VM_ADD_STORE:
+            first = Slot;
+            break;
+        case VMOpCode::VM_JUMP:
+        case VMOpCode::VM_JUMP_IF_TRUE:
+        case VMOpCode::VM_JUMP_IF_FALSE:
+        case VMOpCode::VM_CALL:
+            first = Target;
+            break;
+        case VMOpCode::VM_INC_VAR:
+        case VMOpCode::VM_LOAD_PUSH_ADD:
+        case VMOpCode::VM_LOAD_PUSH_SUB:
+        case VMOpCode::VM_LOAD_PUSH_MUL:
+        case VMOpCode::VM_LOAD_PUSH_CMP_LT:
+            first = Slot;
+            second = Imm;
+            break;
+        case VMOpCode::VM_LOAD_LOAD_ADD:
+        case VMOpCode::VM_LOAD_LOAD_SUB:
+        case VMOpCode::VM_LOAD_LOAD_MUL:
+        case VMOpCode::VM_LOAD_LOAD_CMP_LT:
+        case VMOpCode::VM_STORE_LOAD:
+            first = Slot;
+            second = Slot;
+            break;
+        case VMOpCode::VM_PUSH_STORE:
+            first = Imm;
+            second = Slot;
+            break;
+        default:
+            break;
+    }
+    return operand == 1 ? first : second;
+}
+
+VMStackEffect vmStackEffect(VMOpCode op) {
+    switch (op) {
+        case VMOpCode::VM_PUSH:
+        case VMOpCode::VM_PUSH_CONST:
+        case VMOpCode::VM_LOAD:
+        case VMOpCode::VM_LOAD_LOAD_ADD:
+        case VMOpCode::VM_LOAD_LOAD_SUB:
+        case VMOpCode::VM_LOAD_LOAD_MUL:
+        case VMOpCode::VM_LOAD_LOAD_CMP_LT:
+        case VMOpCode::VM_LOAD_PUSH_ADD:
+        case VMOpCode::VM_LOAD_PUSH_SUB:
+        case VMOpCode::VM_LOAD_PUSH_MUL:
+        case VMOpCode::VM_LOAD_PUSH_CMP_LT:
+            return VMStackEffect{0, 1};
+        case VMOpCode::VM_POP:
+        case VMOpCode::VM_STORE:
+        case VMOpCode::VM_PRINT:
+        case VMOpCode::VM_JUMP_IF_TRUE:
+        case VMOpCode::VM_JUMP_IF_FALSE:
+            return VMStackEffect{1, 0};
+        case VMOpCode::VM_ADD:
+        case VMOpCode::VM_SUB:
+        case VMOpCode::VM_MUL:
+        case VMOpCode::VM_DIV:
+        case VMOpCode::VM_CMP_EQ:
+        case VMOpCode::VM_CMP_NE:
+        case VMOpCode::VM_CMP_LT:
+        case VMOpCode::VM_CMP_LE:
+        case VMOpCode::VM_CMP_GT:
+        case VMOpCode::VM_CMP_GE:
+            return VMStackEffect{2, 1};
+        case VMOpCode::VM_NEG:
+        case VMOpCode::VM_STORE_LOAD:
+            return VMStackEffect{1, 1};
+        case VMOpCode::VM_ADD_STORE:
+            return VMStackEffect{2, 0};
+        default:
+            return VMStackEffect{0, 0};
+    }
+}
+
+std::string disassemble(const BytecodeInstruction& instr, const std::vector<std::string>& slotNames,
+                        const std::vector<Value>* constants) {
+    std::string text = vmOpCodeName(instr.opcode);
+    const int32_t operands[] = {instr.operand1, instr.operand2};
+    for (int i = 0; i < 2; ++i) {
+        VMOperandKind kind = vmOperandKind(instr.opcode, i + 1);
+        if (kind == VMOperandKind::None) break;
+        text += i == 0 ? " " : ", ";
+        int32_t value = operands[i];
+        if (kind == VMOperandKind::Target) {
+            text += "@" + std::to_string(value);
+        } else if (kind == VMOperandKind::Slot && value >= 0 &&
+                   static_cast<size_t>(value) < slotNames.size() && !slotNames[value].empty()) {
+            text += slotNames[value];
+        } else if (kind == VMOperandKind::Slot) {
+            text += "$" + std::to_string(value);
+        } else if (kind == VMOperandKind::Constant && constants && value >= 0 &&
+                   static_cast<size_t>(value) < constants->size()) {
+            std::ostringstream literal;
+            literal << (*constants)[value];
+            text += literal.str();
+        } else if (kind == VMOperandKind::Constant) {
+            text += "#" + std::to_string(value);
+        } else {
+            text += std::to_string(value);
+        }
+    }
+    return text;
+}
 
 Assembler::Assembler() = default;
 
 void Assembler::assemble(const std::vector<Instruction>& irCode) {
     vmInstructions.clear();
+    bytecode.code.clear();
+    bytecode.slotNames.clear();
+    bytecode.constants.clear();
+    bytecode.stackBounds = StackBounds();
+    bytecode.cachedVariants = false;
+    bytecode.codeHash = 0;
+    slotIndex.clear();
+    constantIndex.clear();
+    labelNames.clear();
+    labelIndex.clear();
     for (const auto& instr : irCode) {
         VMOpCode vmOp = mapOpCode(instr.opcode);
         emit(vmOp, instr.operand1, instr.operand2, instr.label);
     }
+    // Slots chosen by the SemanticAnalyzer come first; names without one
+    // (hand-written IR) are appended after them in resolveSlot.
+    for (const auto& instr : vmInstructions) {
+        if ((instr.opcode == VMOpCode::VM_LOAD || instr.opcode == VMOpCode::VM_STORE) &&
+            !instr.operand2.empty()) {
+            bindSlot(instr.operand1, parseImmediate(instr.operand2));
+        }
+    }
+    bytecode.code.reserve(vmInstructions.size());
+    for (const auto& instr : vmInstructions) {
+        bytecode.code.push_back(encode(instr));
+    }
+    if (fusionEnabled) fuseSuperinstructions(bytecode.code);
+    bytecode.code.emplace_back(VMOpCode::VM_HALT);
+    resolveLabels(bytecode.code);
+    verify(bytecode);
+}
+
+// Rejects code that could unbalance the stack, records the bounds the VM
+// sizes its stack from and picks the variants of the caching interpreter
+void Assembler::verify(BytecodeProgram& program) const {
+    StackVerification result = verifyStack(program.code.data(), program.code.size());
+    for (auto& instr : program.code) {
+        if (instr.opcode != VMOpCode::VM_CALL) continue;
+        auto it = result.frameDepths.find(static_cast<size_t>(instr.operand1));
+        instr.operand2 = it == result.frameDepths.end() ? 0 : static_cast<int32_t>(it->second);
+    }
+    program.stackBounds = result.bounds;
+
+    std::vector<uint8_t> variants;
+    program.cachedVariants = chooseCachedVariants(program.code.data(), program.code.size(), result, variants);
+    for (size_t ip = 0; ip < program.code.size(); ++ip) {
+        program.code[ip].cachedVariant = program.cachedVariants ? variants[ip] : 0;
+    }
+    program.codeHash = vmCodeHash(program.code.data(), program.code.size());
+}
+
+uint64_t vmCodeHash(const BytecodeInstruction* code, size_t count) {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint32_t word) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            hash = (hash ^ ((word >> shift) & 0xFF)) * 1099511628211ull;
+        }
+    };
+    for (size_t ip = 0; ip < count; ++ip) {
+        mix(static_cast<uint32_t>(code[ip].opcode));
+        mix(static_cast<uint32_t>(code[ip].operand1));
+        mix(static_cast<uint32_t>(code[ip].operand2));
+    }
+    return hash;
 }
 
 const std::vector<VMInstruction>& Assembler::getVMInstructions() const {
     return vmInstructions;
 }
 
+const BytecodeProgram& Assembler::getBytecode() const {
+    return bytecode;
+}
+
+void Assembler::setFusion(bool enabled) {
+    fusionEnabled = enabled;
+}
+
 void Assembler::emit(VMOpCode opcode,
                      const std::string& operand1,
                      const std::string& operand2,
@@ -46,9 +250,294 @@ VMOpCode Assembler::mapOpCode(OpCode op) const {
         case OpCode::LABEL:          return VMOpCode::VM_LABEL;
         case OpCode::CALL:           return VMOpCode::VM_CALL;
         case OpCode::RETURN:         return VMOpCode::VM_RETURN;
+        case OpCode::PRINT:          return VMOpCode::VM_PRINT;
         // Extend here as you add more OpCodes
         default:
             std::cerr << "Unknown OpCode in assembler (possibly not mapped): " << static_cast<int>(op) << "\n";
             throw std::runtime_error("Unknown OpCode mapping in Assembler.");
     }
 }
+
+void Assembler::assembleRegister(const std::vector<TACInstruction>& tac) {
+    registerProgram = RegisterProgram();
+
+    // Literals start with a digit, a sign or a quote; everything else names a register
+    auto isConstant = [](const std::string& operand) {
+        return !operand.empty() &&
+               (std::isdigit(static_cast<unsigned char>(operand[0])) || operand[0] == '-' || operand[0] == '"');
+    };
+
+    // Pass 1: named registers in first-use order
+    std::unordered_map<std::string, size_t> named;
+    auto nameRegister = [&](const std::string& operand) {
+        if (operand.empty() || isConstant(operand) || named.count(operand)) return;
+        named.emplace(operand, registerProgram.registerNames.size());
+        registerProgram.registerNames.push_back(operand);
+    };
+    for (const auto& instr : tac) {
+        nameRegister(instr.arg1);
+        nameRegister(instr.arg2);
+        nameRegister(instr.result);
+    }
+
+    // Pass 2: encode; constants are pooled after the named registers
+    std::unordered_map<int32_t, size_t> constantRegister;
+    auto reg = [&](const std::string& operand) -> uint16_t {
+        size_t index;
+        if (operand.empty()) {
+            index = 0;
+        } else if (isConstant(operand)) {
+            int32_t value = parseImmediate(operand);
+            auto it = constantRegister.find(value);
+            if (it == constantRegister.end()) {
+                it = constantRegister.emplace(value, registerProgram.constants.size()).first;
+                registerProgram.constants.push_back(value);
+            }
+            index = registerProgram.registerNames.size() + it->second;
+        } else {
+            index = named.at(operand);
+        }
+        if (index > UINT16_MAX) throw std::runtime_error("Assembler: register file exceeds 65536 registers");
+        return static_cast<uint16_t>(index);
+    };
+    registerProgram.code.reserve(tac.size() + 1);
+    for (const auto& instr : tac) {
+        registerProgram.code.emplace_back(mapRegOpCode(instr.opcode), reg(instr.result), reg(instr.arg1), reg(instr.arg2));
+    }
+    registerProgram.code.emplace_back(RegOpCode::REG_HALT);
+}
+
+const RegisterProgram& Assembler::getRegisterProgram() const {
+    return registerProgram;
+}
+
+RegOpCode Assembler::mapRegOpCode(OpCode op) const {
+    switch (op) {
+        case OpCode::LOAD:           return RegOpCode::REG_MOV;
+        case OpCode::ADD:            return RegOpCode::REG_ADD;
+        case OpCode::SUB:            return RegOpCode::REG_SUB;
+        case OpCode::MUL:            return RegOpCode::REG_MUL;
+        case OpCode::DIV:            return RegOpCode::REG_DIV;
+        case OpCode::NEG:            return RegOpCode::REG_NEG;
+        case OpCode::CMP_EQ:         return RegOpCode::REG_CMP_EQ;
+        case OpCode::CMP_NE:         return RegOpCode::REG_CMP_NE;
+        case OpCode::CMP_LT:         return RegOpCode::REG_CMP_LT;
+        case OpCode::CMP_LE:         return RegOpCode::REG_CMP_LE;
+        case OpCode::CMP_GT:         return RegOpCode::REG_CMP_GT;
+        case OpCode::CMP_GE:         return RegOpCode::REG_CMP_GE;
+        default:
+            std::cerr << "OpCode has no register form: " << static_cast<int>(op) << "\n";
+            throw std::runtime_error("Unknown OpCode mapping in register Assembler.");
+    }
+}
+
+// Fusion rules, longest first. The set comes from tools/opcode_ngrams run
+// over test_programs/: read-modify-write of one variable, binary ops on two
+// loaded operands or a variable and a constant, and the assignment tails.
+namespace {
+struct FusionRule {
+    VMOpCode fused;
+    size_t length;
+    VMOpCode sequence[4];
+};
+
+const FusionRule fusionRules[] = {
+    {VMOpCode::VM_INC_VAR,          4, {VMOpCode::VM_LOAD, VMOpCode::VM_PUSH, VMOpCode::VM_ADD, VMOpCode::VM_STORE}},
+    {VMOpCode::VM_LOAD_LOAD_ADD,    3, {VMOpCode::VM_LOAD, VMOpCode::VM_LOAD, VMOpCode::VM_ADD}},
+    {VMOpCode::VM_LOAD_LOAD_SUB,    3, {VMOpCode::VM_LOAD, VMOpCode::VM_LOAD, VMOpCode::VM_SUB}},
+    {VMOpCode::VM_LOAD_LOAD_MUL,    3, {VMOpCode::VM_LOAD, VMOpCode::VM_LOAD, VMOpCode::VM_MUL}},
+    {VMOpCode::VM_LOAD_LOAD_CMP_LT, 3, {VMOpCode::VM_LOAD, VMOpCode::VM_LOAD, VMOpCode::VM_CMP_LT}},
+    {VMOpCode::VM_LOAD_PUSH_ADD,    3, {VMOpCode::VM_LOAD, VMOpCode::VM_PUSH, VMOpCode::VM_ADD}},
+    {VMOpCode::VM_LOAD_PUSH_SUB,    3, {VMOpCode::VM_LOAD, VMOpCode::VM_PUSH, VMOpCode::VM_SUB}},
+    {VMOpCode::VM_LOAD_PUSH_MUL,    3, {VMOpCode::VM_LOAD, VMOpCode::VM_PUSH, VMOpCode::VM_MUL}},
+    {VMOpCode::VM_LOAD_PUSH_CMP_LT, 3, {VMOpCode::VM_LOAD, VMOpCode::VM_PUSH, VMOpCode::VM_CMP_LT}},
+    {VMOpCode::VM_PUSH_STORE,       2, {VMOpCode::VM_PUSH, VMOpCode::VM_STORE}},
+    {VMOpCode::VM_STORE_LOAD,       2, {VMOpCode::VM_STORE, VMOpCode::VM_LOAD}},
+    {VMOpCode::VM_ADD_STORE,        2, {VMOpCode::VM_ADD, VMOpCode::VM_STORE}},
+};
+
+bool hasOperand(VMOpCode op) {
+    return op == VMOpCode::VM_PUSH || op == VMOpCode::VM_LOAD || op == VMOpCode::VM_STORE;
+}
+} // namespace
+
+// The fused instruction takes the operands of the PUSH/LOAD/STORE it replaces,
+// in order: INC_VAR x k, LOAD_LOAD_op a b, LOAD_PUSH_op x k, PUSH_STORE k x,
+// STORE_LOAD x y, ADD_STORE x. Labels are separate instructions, so a
+// sequence never spans a jump target.
+void Assembler::fuseSuperinstructions(std::vector<BytecodeInstruction>& code) const {
+    std::vector<BytecodeInstruction> fused;
+    fused.reserve(code.size());
+    size_t i = 0;
+    while (i < code.size()) {
+        const FusionRule* match = nullptr;
+        for (const auto& rule : fusionRules) {
+            if (i + rule.length > code.size()) continue;
+            bool same = true;
+            for (size_t k = 0; k < rule.length && same; ++k) same = code[i + k].opcode == rule.sequence[k];
+            // INC_VAR only when the STORE writes back the variable it loaded
+            if (same && rule.fused == VMOpCode::VM_INC_VAR) same = code[i].operand1 == code[i + 3].operand1;
+            if (same) { match = &rule; break; }
+        }
+        if (!match) {
+            fused.push_back(code[i++]);
+            continue;
+        }
+        int32_t operands[2] = {0, 0};
+        size_t count = 0;
+        for (size_t k = 0; k < match->length && count < 2; ++k) {
+            if (hasOperand(code[i + k].opcode)) operands[count++] = code[i + k].operand1;
+        }
+        fused.emplace_back(match->fused, operands[0], operands[1]);
+        i += match->length;
+    }
+    code.swap(fused);
+}
+
+BytecodeInstruction Assembler::encode(const VMInstruction& instr) {
+    switch (instr.opcode) {
+        case VMOpCode::VM_PUSH:
+            return encodePush(instr.operand1);
+        case VMOpCode::VM_LOAD:
+        case VMOpCode::VM_STORE:
+            // LOAD/STORE name [slot]: the slot was bound before encoding
+            return BytecodeInstruction(instr.opcode, resolveSlot(instr.operand1));
+        case VMOpCode::VM_LABEL:
+            // LABEL name (the IR's label field is accepted as well)
+            return BytecodeInstruction(instr.opcode,
+                                       labelId(instr.operand1.empty() ? instr.label : instr.operand1));
+        case VMOpCode::VM_JUMP:
+        case VMOpCode::VM_JUMP_IF_TRUE:
+        case VMOpCode::VM_JUMP_IF_FALSE:
+        case VMOpCode::VM_CALL:
+            // Label id for now; resolveLabels turns it into an offset
+            return BytecodeInstruction(instr.opcode, labelId(instr.operand1));
+        default:
+            return BytecodeInstruction(instr.opcode);
+    }
+}
+
+int32_t Assembler::labelId(const std::string& name) {
+    if (name.empty()) throw std::runtime_error("Assembler: missing label name");
+    auto it = labelIndex.find(name);
+    if (it != labelIndex.end()) return it->second;
+    int32_t id = static_cast<int32_t>(labelNames.size());
+    labelIndex.emplace(name, id);
+    labelNames.push_back(name);
+    return id;
+}
+
+// Runs after fusion, so offsets refer to the final instruction stream. A
+// label resolves to the instruction that follows it (HALT for a trailing
+// label), and jumps then execute without any runtime search.
+void Assembler::resolveLabels(std::vector<BytecodeInstruction>& code) const {
+    const int32_t unresolved = -1;
+    std::vector<int32_t> offsets(labelNames.size(), unresolved);
+    int32_t next = 0;
+    for (const auto& instr : code) {
+        if (instr.opcode != VMOpCode::VM_LABEL) {
+            ++next;
+            continue;
+        }
+        if (offsets[instr.operand1] != unresolved) {
+            throw std::runtime_error("Assembler: duplicate label '" + labelNames[instr.operand1] + "'");
+        }
+        offsets[instr.operand1] = next;
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        BytecodeInstruction instr = code[i];
+        switch (instr.opcode) {
+            case VMOpCode::VM_LABEL:
+                continue;
+            case VMOpCode::VM_JUMP:
+            case VMOpCode::VM_JUMP_IF_TRUE:
+            case VMOpCode::VM_JUMP_IF_FALSE:
+            case VMOpCode::VM_CALL:
+                if (offsets[instr.operand1] == unresolved) {
+                    throw std::runtime_error("Assembler: undefined label '" + labelNames[instr.operand1] + "'");
+                }
+                instr.operand1 = offsets[instr.operand1];
+                break;
+            default:
+                break;
+        }
+        code[out++] = instr;
+    }
+    code.erase(code.begin() + static_cast<std::ptrdiff_t>(out), code.end());
+}
+
+int32_t Assembler::parseImmediate(const std::string& text) const {
+    const char* begin = text.c_str();
+    char* end = nullptr;
+    errno = 0;
+    long value = std::strtol(begin, &end, 10);
+    if (end == begin || *end != '\0' || errno == ERANGE || value < INT32_MIN || value > INT32_MAX) {
+        throw std::runtime_error("Assembler: operand is not an integer constant: '" + text + "'");
+    }
+    return static_cast<int32_t>(value);
+}
+
+// Integers that fit int32 stay immediates, so PUSH and the fused
+// LOAD_PUSH_* forms keep working on them; other numbers become float
+// constants and quoted text (as CodeGenerator emits string literals)
+// string constants.
+BytecodeInstruction Assembler::encodePush(const std::string& text) {
+    if (text.size() >= 2 && text.front() == '"' && text.back() == '"') {
+        return BytecodeInstruction(VMOpCode::VM_PUSH_CONST,
+                                   addConstant(Value::string(text.substr(1, text.size() - 2))));
+    }
+    const char* begin = text.c_str();
+    char* end = nullptr;
+    errno = 0;
+    long integer = std::strtol(begin, &end, 10);
+    if (end != begin && *end == '\0') {
+        if (errno == ERANGE || integer < INT32_MIN || integer > INT32_MAX) {
+            throw std::runtime_error("Assembler: integer constant out of range: '" + text + "'");
+        }
+        return BytecodeInstruction(VMOpCode::VM_PUSH, static_cast<int32_t>(integer));
+    }
+    double number = std::strtod(begin, &end);
+    if (end == begin || *end != '\0') {
+        throw std::runtime_error("Assembler: operand is not a constant: '" + text + "'");
+    }
+    return BytecodeInstruction(VMOpCode::VM_PUSH_CONST, addConstant(Value::number(number)));
+}
+
+int32_t Assembler::addConstant(Value value) {
+    auto it = constantIndex.find(value.raw());
+    if (it != constantIndex.end()) return it->second;
+    int32_t index = static_cast<int32_t>(bytecode.constants.size());
+    bytecode.constants.push_back(value);
+    constantIndex.emplace(value.raw(), index);
+    return index;
+}
+
+int32_t Assembler::resolveSlot(const std::string& name) {
+    auto it = slotIndex.find(name);
+    if (it != slotIndex.end()) return it->second;
+    int32_t slot = static_cast<int32_t>(bytecode.slotNames.size());
+    bindSlot(name, slot);
+    return slot;
+}
+
+void Assembler::bindSlot(const std::string& name, int32_t slot) {
+    auto it = slotIndex.find(name);
+    if (it != slotIndex.end()) {
+        if (it->second != slot) {
+            throw std::runtime_error("Assembler: variable '" + name + "' bound to two slots");
+        }
+        return;
+    }
+    if (slot < 0) throw std::runtime_error("Assembler: negative slot for '" + name + "'");
+    if (static_cast<size_t>(slot) >= bytecode.slotNames.size()) {
+        bytecode.slotNames.resize(static_cast<size_t>(slot) + 1);
+    }
+    if (!bytecode.slotNames[slot].empty()) {
+        throw std::runtime_error("Assembler: slot " + std::to_string(slot) + " shared by '" +
+                                 bytecode.slotNames[slot] + "' and '" + name + "'");
+    }
+    bytecode.slotNames[slot] = name;
+    slotIndex.emplace(name, slot);
+}
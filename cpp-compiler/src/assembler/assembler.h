@@ -1,37 +1,65 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <unordered_map>
 #include "codegen.h"
+#include "value.h"
 
-// Enum for the virtual machine opcodes
-enum class VMOpCode {
-    VM_PUSH,
-    VM_POP,
-    VM_LOAD,
-    VM_STORE,
-    VM_ADD,
-    VM_SUB,
-    VM_MUL,
-    VM_DIV,
-    VM_NEG,
-    VM_CMP_EQ,
-    VM_CMP_NE,
-    VM_CMP_LT,
-    VM_CMP_LE,
-    VM_CMP_GT,
-    VM_CMP_GE,
-    VM_JUMP,
-    VM_JUMP_IF_TRUE,
-    VM_JUMP_IF_FALSE,
-    VM_LABEL,
-    VM_CALL,
-    VM_RETURN
+// Virtual machine opcodes. The list drives both the enum and the VM's
+// threaded dispatch table, so the two can never disagree on ordering.
+#define VM_OPCODE_LIST(X) \
+    X(VM_PUSH)            \
+    X(VM_PUSH_CONST)      \
+    X(VM_POP)             \
+    X(VM_LOAD)            \
+    X(VM_STORE)           \
+    X(VM_ADD)             \
+    X(VM_SUB)             \
+    X(VM_MUL)             \
+    X(VM_DIV)             \
+    X(VM_NEG)             \
+    X(VM_CMP_EQ)          \
+    X(VM_CMP_NE)          \
+    X(VM_CMP_LT)          \
+    X(VM_CMP_LE)          \
+    X(VM_CMP_GT)          \
+    X(VM_CMP_GE)          \
+    X(VM_JUMP)            \
+    X(VM_JUMP_IF_TRUE)    \
+    X(VM_JUMP_IF_FALSE)   \
+    X(VM_LABEL)           \
+    X(VM_CALL)            \
+    X(VM_RETURN)          \
+    X(VM_HALT)            \
+    X(VM_PRINT)           \
+    /* superinstructions (see Assembler::fuseSuperinstructions) */ \
+    X(VM_INC_VAR)         \
+    X(VM_LOAD_LOAD_ADD)   \
+    X(VM_LOAD_LOAD_SUB)   \
+    X(VM_LOAD_LOAD_MUL)   \
+    X(VM_LOAD_LOAD_CMP_LT) \
+    X(VM_LOAD_PUSH_ADD)   \
+    X(VM_LOAD_PUSH_SUB)   \
+    X(VM_LOAD_PUSH_MUL)   \
+    X(VM_LOAD_PUSH_CMP_LT) \
+    X(VM_PUSH_STORE)      \
+    X(VM_STORE_LOAD)      \
+    X(VM_ADD_STORE)
     // Extend this list to match all supported instructions
+
+// Enum for the virtual machine opcodes (one byte in packed bytecode)
+enum class VMOpCode : uint8_t {
+#define VM_OPCODE_ENUM(name) name,
+    VM_OPCODE_LIST(VM_OPCODE_ENUM)
+#undef VM_OPCODE_ENUM
 };
 
-// VM instruction structure
+// Opcode mnemonic without the VM_ prefix (e.g. "LOAD_LOAD_ADD")
+const char* vmOpCodeName(VMOpCode op);
+
+// VM instruction structure (symbolic form, kept for listings and debugging)
 struct VMInstruction {
     VMOpCode opcode;
     std::string operand1;
@@ -45,6 +73,129 @@ struct VMInstruction {
         : opcode(code), operand1(op1), operand2(op2), label(lbl) {}
 };
 
+// Packed instruction executed by the VM. Operands are decoded at assembly
+// time: PUSH carries its integer immediate, PUSH_CONST the index of a float
+// or string literal in the constant pool, LOAD/STORE a variable slot index
+// (taken from the IR's operand2 when the SemanticAnalyzer assigned one), and
+// JUMP/JUMP_IF_*/CALL the absolute index of their target instruction. CALL's
+// operand2 is the stack room its callee needs, set by the verifier.
+// cachedVariant selects the handler in the top-of-stack caching interpreter
+// (see vmCachedVariant); it occupies what would otherwise be padding.
+struct BytecodeInstruction {
+    VMOpCode opcode;
+    uint8_t cachedVariant;
+    int32_t operand1;
+    int32_t operand2;
+
+    BytecodeInstruction(VMOpCode code, int32_t op1 = 0, int32_t op2 = 0)
+        : opcode(code), cachedVariant(0), operand1(op1), operand2(op2) {}
+};
+
+// The top-of-stack caching interpreter (DispatchMode::CachedTop) keeps the
+// top value of the running routine's stack in a register whenever that stack
+// is not empty. Since every instruction has one verified stack depth, whether
+// the top is cached before and after it is fixed, and the Assembler picks the
+// opcode variant for that pair of states; this is its dispatch index.
+inline uint8_t vmCachedVariant(VMOpCode op, bool cachedBefore, bool cachedAfter) {
+    return static_cast<uint8_t>(static_cast<unsigned>(op) << 2 | unsigned(cachedBefore) << 1 | unsigned(cachedAfter));
+}
+inline bool vmCachedBefore(uint8_t variant) { return (variant & 2) != 0; }
+
+// Operand stack sizes proven by the verifier (see bytecode_verifier.h)
+struct StackBounds {
+    uint32_t maxDepth = 0;      // deepest the stack gets in any run, or
+                                // kUnboundedStackDepth through recursion
+    uint32_t maxFrameDepth = 0; // most values any one routine holds above
+                                // its entry depth, not counting its callees
+};
+
+// Assembled program: instruction stream, the slot -> variable name table and
+// the constant pool of literals that do not fit an int32 immediate.
+// The stream always ends with VM_HALT, so the VM never bounds-checks ip, and
+// contains no VM_LABEL pseudo-ops (labels are resolved to offsets). It has
+// passed stack verification, which also filled in stackBounds and, unless
+// some routine pops values its caller pushed, each cachedVariant.
+// codeHash is vmCodeHash of the finished stream.
+struct BytecodeProgram {
+    std::vector<BytecodeInstruction> code;
+    std::vector<std::string> slotNames;
+    std::vector<Value> constants;
+    StackBounds stackBounds;
+    bool cachedVariants = false;
+    uint64_t codeHash = 0;
+};
+
+// FNV-1a over the opcodes and operands of an instruction stream
+uint64_t vmCodeHash(const BytecodeInstruction* code, size_t count);
+
+// Meaning of a packed operand for a given opcode
+enum class VMOperandKind : uint8_t {
+    None,       // unused
+    Immediate,  // integer constant
+    Slot,       // variable slot index
+    Target,     // absolute instruction index
+    Constant    // constant pool index
+};
+
+// Kind of operand1 (`operand` == 1) or operand2 (`operand` == 2) of `op`
+VMOperandKind vmOperandKind(VMOpCode op, int operand);
+
+// Operand-stack effect of an opcode: values it pops, then values it pushes.
+// Control flow (jump targets, calls, returns) is not part of it.
+struct VMStackEffect {
+    int pops;
+    int pushes;
+};
+VMStackEffect vmStackEffect(VMOpCode op);
+
+// One-line listing of a packed instruction, e.g. "LOAD_PUSH_ADD i, 3";
+// slots print as their variable names when known, targets as "@ip",
+// constants as their value when the pool is given and as "#index" otherwise
+std::string disassemble(const BytecodeInstruction& instr, const std::vector<std::string>& slotNames,
+                        const std::vector<Value>* constants = nullptr);
+
+// Register VM opcodes (three-address form: dst = a op b)
+#define REG_OPCODE_LIST(X) \
+    X(REG_MOV)             \
+    X(REG_ADD)             \
+    X(REG_SUB)             \
+    X(REG_MUL)             \
+    X(REG_DIV)             \
+    X(REG_NEG)             \
+    X(REG_CMP_EQ)          \
+    X(REG_CMP_NE)          \
+    X(REG_CMP_LT)          \
+    X(REG_CMP_LE)          \
+    X(REG_CMP_GT)          \
+    X(REG_CMP_GE)          \
+    X(REG_HALT)
+
+enum class RegOpCode : uint8_t {
+#define REG_OPCODE_ENUM(name) name,
+    REG_OPCODE_LIST(REG_OPCODE_ENUM)
+#undef REG_OPCODE_ENUM
+};
+
+// Packed register instruction; every operand is a register index
+struct RegInstruction {
+    RegOpCode opcode;
+    uint16_t dst;
+    uint16_t a;
+    uint16_t b;
+
+    RegInstruction(RegOpCode code, uint16_t d = 0, uint16_t x = 0, uint16_t y = 0)
+        : opcode(code), dst(d), a(x), b(y) {}
+};
+
+// Assembled register program. The register file holds the named values
+// (variables and temporaries) first, followed by one register per distinct
+// constant that the VM preloads before running. Ends with REG_HALT.
+struct RegisterProgram {
+    std::vector<RegInstruction> code;
+    std::vector<std::string> registerNames;
+    std::vector<int32_t> constants;
+};
+
 class Assembler {
 public:
     Assembler();
@@ -54,6 +205,16 @@ public:
 
     const std::vector<VMInstruction>& getVMInstructions() const;
 
+    // Packed bytecode for the VM, built alongside the symbolic listing
+    const BytecodeProgram& getBytecode() const;
+
+    // Superinstruction fusion in assemble(); on by default
+    void setFusion(bool enabled);
+
+    // Register backend: three-address code -> register VM program
+    void assembleRegister(const std::vector<TACInstruction>& tac);
+    const RegisterProgram& getRegisterProgram() const;
+
 private:
     void emit(VMOpCode opcode,
               const std::string& operand1 = "",
@@ -63,5 +224,34 @@ private:
     // Maps IR OpCode to VMOpCode
     VMOpCode mapOpCode(OpCode op) const;
 
+    RegOpCode mapRegOpCode(OpCode op) const;
+
+    // Second pass: label ids -> instruction offsets, LABELs removed
+    void resolveLabels(std::vector<BytecodeInstruction>& code) const;
+    int32_t labelId(const std::string& name);
+
+    // Rewrites common opcode sequences into fused superinstructions
+    void fuseSuperinstructions(std::vector<BytecodeInstruction>& code) const;
+
+    // Last pass: stack verification and cached-top variants
+    // (bytecode_verifier.h)
+    void verify(BytecodeProgram& program) const;
+
+    // Decodes string operands into packed immediates / slot indices
+    BytecodeInstruction encode(const VMInstruction& instr);
+    int32_t parseImmediate(const std::string& text) const;
+    // PUSH operand: int32 immediate, or a pooled float/"string" literal
+    BytecodeInstruction encodePush(const std::string& text);
+    int32_t addConstant(Value value);
+    int32_t resolveSlot(const std::string& name);
+    void bindSlot(const std::string& name, int32_t slot);
+
     std::vector<VMInstruction> vmInstructions;
+    BytecodeProgram bytecode;
+    std::unordered_map<std::string, int32_t> slotIndex;
+    std::unordered_map<uint64_t, int32_t> constantIndex;    // Value bits -> pool index
+    std::vector<std::string> labelNames;  // label id -> name, for error messages
+    std::unordered_map<std::string, int32_t> labelIndex;
+    RegisterProgram registerProgram;
+    bool fusionEnabled = true;
 };
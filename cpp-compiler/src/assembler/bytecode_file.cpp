@@ -0,0 +1,281 @@
+#include "bytecode_file.h"
+#include "bytecode_verifier.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MYCOMPILER_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define MYCOMPILER_HAS_MMAP 0
+#endif
+
+namespace {
+
+// The code section is the in-memory instruction array, so its layout is part
+// of the format; changing it requires a major version bump
+static_assert(sizeof(BytecodeInstruction) == 12, "BytecodeInstruction layout changed");
+static_assert(offsetof(BytecodeInstruction, cachedVariant) == 1, "BytecodeInstruction layout changed");
+static_assert(offsetof(BytecodeInstruction, operand1) == 4, "BytecodeInstruction layout changed");
+static_assert(offsetof(BytecodeInstruction, operand2) == 8, "BytecodeInstruction layout changed");
+static_assert(sizeof(McbcHeader) == 64, "McbcHeader layout changed");
+static_assert(sizeof(McbcConstant) == 16, "McbcConstant layout changed");
+
+uint64_t alignUp(uint64_t value) {
+    return (value + 7) & ~uint64_t(7);
+}
+
+void appendBytes(std::vector<uint8_t>& out, const void* src, size_t n) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(src);
+    out.insert(out.end(), bytes, bytes + n);
+}
+
+void padTo(std::vector<uint8_t>& out, uint64_t offset) {
+    out.resize(static_cast<size_t>(offset), 0);
+}
+
+const char* const kOpcodeNames[] = {
+#define VM_OPCODE_NAME(name) #name,
+    VM_OPCODE_LIST(VM_OPCODE_NAME)
+#undef VM_OPCODE_NAME
+};
+
+[[noreturn]] void reject(const std::string& path, const std::string& why) {
+    throw std::runtime_error("Invalid bytecode file " + path + ": " + why);
+}
+
+} // namespace
+
+uint32_t mcbcOpcodeSetHash() {
+    uint32_t hash = 2166136261u;  // FNV-1a over "NAME\0NAME\0..."
+    for (const char* name : kOpcodeNames) {
+        for (const char* c = name; ; ++c) {
+            hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+            if (*c == '\0') break;
+        }
+    }
+    return hash;
+}
+
+void writeBytecodeFile(const std::string& path, const BytecodeProgram& program) {
+    std::string pool;
+    std::vector<uint32_t> slotTable;
+    for (const auto& name : program.slotNames) {
+        slotTable.push_back(static_cast<uint32_t>(pool.size()));
+        slotTable.push_back(static_cast<uint32_t>(name.size()));
+        pool += name;
+    }
+    std::vector<McbcConstant> constantTable;
+    for (Value value : program.constants) {
+        McbcConstant entry = {static_cast<uint32_t>(value.type()), 0, value.raw()};
+        if (value.isString()) {
+            const std::string& text = value.asString();
+            entry.length = static_cast<uint32_t>(text.size());
+            entry.payload = pool.size();
+            pool += text;
+        }
+        constantTable.push_back(entry);
+    }
+
+    McbcHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "MCBC", 4);
+    header.versionMajor = kMcbcVersionMajor;
+    header.versionMinor = kMcbcVersionMinor;
+    header.byteOrder = kMcbcByteOrder;
+    header.opcodeSetHash = mcbcOpcodeSetHash();
+    header.instructionCount = static_cast<uint32_t>(program.code.size());
+    header.slotCount = static_cast<uint32_t>(program.slotNames.size());
+    header.stringPoolSize = static_cast<uint32_t>(pool.size());
+    header.constantCount = static_cast<uint32_t>(constantTable.size());
+    header.slotTableOffset = alignUp(sizeof(McbcHeader));
+    header.constantTableOffset = alignUp(header.slotTableOffset + slotTable.size() * sizeof(uint32_t));
+    header.stringPoolOffset = alignUp(header.constantTableOffset + constantTable.size() * sizeof(McbcConstant));
+    header.codeOffset = alignUp(header.stringPoolOffset + pool.size());
+
+    std::vector<uint8_t> out;
+    out.reserve(static_cast<size_t>(header.codeOffset + program.code.size() * sizeof(BytecodeInstruction)));
+    appendBytes(out, &header, sizeof(header));
+    padTo(out, header.slotTableOffset);
+    appendBytes(out, slotTable.data(), slotTable.size() * sizeof(uint32_t));
+    padTo(out, header.constantTableOffset);
+    appendBytes(out, constantTable.data(), constantTable.size() * sizeof(McbcConstant));
+    padTo(out, header.stringPoolOffset);
+    appendBytes(out, pool.data(), pool.size());
+    padTo(out, header.codeOffset);
+    for (const auto& instr : program.code) {
+        // Field by field, so struct padding is written as zeros
+        uint8_t record[sizeof(BytecodeInstruction)] = {};
+        record[offsetof(BytecodeInstruction, opcode)] = static_cast<uint8_t>(instr.opcode);
+        record[offsetof(BytecodeInstruction, cachedVariant)] = instr.cachedVariant;
+        std::memcpy(record + offsetof(BytecodeInstruction, operand1), &instr.operand1, sizeof(int32_t));
+        std::memcpy(record + offsetof(BytecodeInstruction, operand2), &instr.operand2, sizeof(int32_t));
+        appendBytes(out, record, sizeof(record));
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) throw std::runtime_error("Cannot write " + path);
+    file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+    if (!file) throw std::runtime_error("Cannot write " + path);
+}
+
+BytecodeFile::~BytecodeFile() {
+#if MYCOMPILER_HAS_MMAP
+    if (mapped) {
+        munmap(const_cast<uint8_t*>(data), size);
+        return;
+    }
+#endif
+    delete[] data;
+}
+
+std::unique_ptr<BytecodeFile> BytecodeFile::open(const std::string& path) {
+    std::unique_ptr<BytecodeFile> file(new BytecodeFile());
+#if MYCOMPILER_HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    file->size = static_cast<size_t>(info.st_size);
+    if (file->size > 0) {
+        void* memory = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED) throw std::runtime_error("Cannot map " + path);
+        file->data = static_cast<const uint8_t*>(memory);
+        file->mapped = true;
+    } else {
+        ::close(fd);
+    }
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) throw std::runtime_error("Cannot open " + path);
+    file->size = static_cast<size_t>(in.tellg());
+    uint8_t* buffer = new uint8_t[file->size ? file->size : 1];
+    file->data = buffer;
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(file->size));
+    if (!in) throw std::runtime_error("Cannot read " + path);
+#endif
+    file->validate(path);
+    return file;
+}
+
+// Structural checks only: everything the VM would otherwise index without
+// bounds checks (sections, slots, jump targets) must be in range, and the
+// stream must end in HALT so execution can never run off the end
+void BytecodeFile::validate(const std::string& path) {
+    if (size < sizeof(McbcHeader)) reject(path, "truncated header");
+    McbcHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, "MCBC", 4) != 0) reject(path, "bad magic");
+    if (header.byteOrder != kMcbcByteOrder) reject(path, "written with a different byte order");
+    if (header.versionMajor != kMcbcVersionMajor) {
+        reject(path, "unsupported version " + std::to_string(header.versionMajor) + "." +
+                     std::to_string(header.versionMinor));
+    }
+    if (header.opcodeSetHash != mcbcOpcodeSetHash()) reject(path, "encoded for a different opcode set");
+
+    // offset + bytes could wrap on crafted 64-bit offsets; compare against
+    // what is left after the offset instead
+    auto fits = [this](uint64_t offset, uint64_t bytes) { return offset <= size && bytes <= size - offset; };
+    if (!fits(header.slotTableOffset, uint64_t(header.slotCount) * 2 * sizeof(uint32_t)) ||
+        !fits(header.constantTableOffset, uint64_t(header.constantCount) * sizeof(McbcConstant)) ||
+        !fits(header.stringPoolOffset, header.stringPoolSize) ||
+        !fits(header.codeOffset, uint64_t(header.instructionCount) * sizeof(BytecodeInstruction)) ||
+        header.slotTableOffset % alignof(uint32_t) != 0 ||
+        header.codeOffset % alignof(BytecodeInstruction) != 0) {
+        reject(path, "section out of bounds");
+    }
+
+    const char* pool = reinterpret_cast<const char*>(data + header.stringPoolOffset);
+    names.clear();
+    names.reserve(header.slotCount);
+    for (uint32_t slot = 0; slot < header.slotCount; ++slot) {
+        uint32_t entry[2];
+        std::memcpy(entry, data + header.slotTableOffset + slot * sizeof(entry), sizeof(entry));
+        if (uint64_t(entry[0]) + entry[1] > header.stringPoolSize) reject(path, "slot name out of bounds");
+        names.emplace_back(pool + entry[0], entry[1]);
+    }
+
+    constantPool.clear();
+    constantPool.reserve(header.constantCount);
+    for (uint32_t index = 0; index < header.constantCount; ++index) {
+        McbcConstant entry;
+        std::memcpy(&entry, data + header.constantTableOffset + index * sizeof(entry), sizeof(entry));
+        if (entry.type == static_cast<uint32_t>(Value::Type::String)) {
+            if (entry.payload > header.stringPoolSize || entry.length > header.stringPoolSize - entry.payload) {
+                reject(path, "string constant out of bounds");
+            }
+            constantPool.push_back(Value::string(std::string(pool + entry.payload, entry.length)));
+        } else if (entry.type == static_cast<uint32_t>(Value::Type::Double)) {
+            double number;
+            std::memcpy(&number, &entry.payload, sizeof number);
+            constantPool.push_back(Value::number(number));
+        } else {
+            reject(path, "bad constant type " + std::to_string(entry.type));
+        }
+    }
+
+    instructions = reinterpret_cast<const BytecodeInstruction*>(data + header.codeOffset);
+    count = header.instructionCount;
+    if (count == 0 || instructions[count - 1].opcode != VMOpCode::VM_HALT) {
+        reject(path, "code does not end with HALT");
+    }
+
+    const int64_t slots = header.slotCount;
+    const int64_t constants = header.constantCount;
+    const int64_t targets = static_cast<int64_t>(count);
+    auto inRange = [](int32_t operand, int64_t limit) { return operand >= 0 && operand < limit; };
+    const size_t opcodeCount = sizeof(kOpcodeNames) / sizeof(kOpcodeNames[0]);
+    for (size_t ip = 0; ip < count; ++ip) {
+        const BytecodeInstruction& in = instructions[ip];
+        if (static_cast<size_t>(in.opcode) >= opcodeCount) {
+            reject(path, "unknown opcode " + std::to_string(static_cast<int>(in.opcode)) +
+                         " at " + std::to_string(ip));
+        }
+        const int32_t operands[] = {in.operand1, in.operand2};
+        for (int i = 0; i < 2; ++i) {
+            VMOperandKind kind = vmOperandKind(in.opcode, i + 1);
+            bool ok = kind == VMOperandKind::Slot ? inRange(operands[i], slots)
+                    : kind == VMOperandKind::Target ? inRange(operands[i], targets)
+                    : kind == VMOperandKind::Constant ? inRange(operands[i], constants)
+                    : true;
+            if (!ok) {
+                reject(path, std::string("operand out of range in ") + vmOpCodeName(in.opcode) +
+                             " at " + std::to_string(ip));
+            }
+        }
+    }
+
+    StackVerification verified;
+    try {
+        verified = verifyStack(instructions, count);
+    } catch (const std::runtime_error& e) {
+        reject(path, e.what());
+    }
+    for (size_t ip = 0; ip < count; ++ip) {
+        const BytecodeInstruction& in = instructions[ip];
+        if (in.opcode != VMOpCode::VM_CALL) continue;
+        auto it = verified.frameDepths.find(static_cast<size_t>(in.operand1));
+        if (it != verified.frameDepths.end() && (in.operand2 < 0 || static_cast<uint32_t>(in.operand2) < it->second)) {
+            reject(path, "CALL at " + std::to_string(ip) + " reserves too little stack");
+        }
+    }
+    bounds = verified.bounds;
+
+    std::vector<uint8_t> variants;
+    variantsValid = chooseCachedVariants(instructions, count, verified, variants);
+    for (size_t ip = 0; variantsValid && ip < count; ++ip) {
+        variantsValid = instructions[ip].cachedVariant == variants[ip];
+    }
+    hash = vmCodeHash(instructions, count);
+}
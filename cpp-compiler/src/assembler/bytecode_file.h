@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "assembler.h"
+
+// .mcbc: versioned container for assembled stack VM code, so a script can be
+// compiled once and started later without lexing, parsing or assembling.
+//
+// Layout (native byte order, checked on load; every section 8-byte aligned):
+//   McbcHeader
+//   slot table      slotCount x {uint32 offset, uint32 length} into the pool
+//   constant table  constantCount x McbcConstant
+//   string pool     stringPoolSize bytes of name/string data
+//   code            instructionCount x BytecodeInstruction, stored exactly as
+//                   the VM holds it in memory
+// The instruction stream is used in place from the mapped file: loading
+// checks the header, section bounds and operand ranges, but never decodes
+// or copies instructions. Only the (usually few) float and string constants
+// are decoded, since strings have to be interned in the running process.
+// The code is stack-verified on load like freshly assembled code; a CALL
+// must reserve at least the room its callee is proven to need. Instruction
+// variants for the top-of-stack caching interpreter are checked, not
+// trusted; a file whose variants are off runs in the plain interpreter.
+
+struct McbcHeader {
+    char magic[4];              // "MCBC"
+    uint16_t versionMajor;      // readers reject other major versions
+    uint16_t versionMinor;      // additions that old readers can ignore
+    uint32_t byteOrder;         // kMcbcByteOrder as written by the producer
+    uint32_t opcodeSetHash;     // hash of the VM opcode list that encoded it
+    uint32_t instructionCount;
+    uint32_t slotCount;
+    uint32_t stringPoolSize;
+    uint32_t constantCount;
+    uint64_t slotTableOffset;
+    uint64_t constantTableOffset;
+    uint64_t stringPoolOffset;
+    uint64_t codeOffset;
+};
+
+// One constant pool entry: a float as its bits, or a string in the pool
+struct McbcConstant {
+    uint32_t type;              // Value::Type
+    uint32_t length;            // string: byte length
+    uint64_t payload;           // float: IEEE bits; string: pool offset
+};
+
+const uint16_t kMcbcVersionMajor = 2;
+const uint16_t kMcbcVersionMinor = 2;     // 1: CALL operand2 = callee stack room
+                                          // 2: cachedVariant in instruction byte 1
+const uint32_t kMcbcByteOrder = 0x01020304;
+
+// Identifies the VMOpCode numbering; files from a build with a different
+// opcode list are rejected instead of being misinterpreted
+uint32_t mcbcOpcodeSetHash();
+
+// Serializes an assembled program. Throws std::runtime_error on I/O errors.
+void writeBytecodeFile(const std::string& path, const BytecodeProgram& program);
+
+// A loaded .mcbc file. The instruction stream points into a read-only
+// mapping of the file that lives as long as this object.
+class BytecodeFile {
+public:
+    ~BytecodeFile();
+    BytecodeFile(const BytecodeFile&) = delete;
+    BytecodeFile& operator=(const BytecodeFile&) = delete;
+
+    // Maps and validates a file. Throws std::runtime_error when it cannot be
+    // read or is not a well-formed .mcbc for this VM.
+    static std::unique_ptr<BytecodeFile> open(const std::string& path);
+
+    const BytecodeInstruction* code() const { return instructions; }
+    size_t instructionCount() const { return count; }
+    const std::vector<std::string>& slotNames() const { return names; }
+    const std::vector<Value>& constants() const { return constantPool; }
+    const StackBounds& stackBounds() const { return bounds; }
+    // True when every instruction carries the cachedVariant its verified
+    // depth calls for (files from before minor version 2 do not)
+    bool cachedVariants() const { return variantsValid; }
+    // vmCodeHash of the instruction stream, computed once on load
+    uint64_t codeHash() const { return hash; }
+
+private:
+    BytecodeFile() = default;
+    void validate(const std::string& path);
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;                // false: data is owned heap memory
+    const BytecodeInstruction* instructions = nullptr;
+    size_t count = 0;
+    std::vector<std::string> names;
+    std::vector<Value> constantPool;
+    StackBounds bounds;
+    bool variantsValid = false;
+    uint64_t hash = 0;
+};
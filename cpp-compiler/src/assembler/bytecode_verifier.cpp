@@ -0,0 +1,222 @@
+#include "bytecode_verifier.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Beyond this the depth is treated as unbounded; also keeps the int64
+// arithmetic below far from overflow
+const int64_t kDepthCap = int64_t(1) << 32;
+
+// What a routine does to the stack, relative to its entry depth
+struct RoutineSummary {
+    bool returns = false;       // some RETURN has been reached; `net` is valid
+    int64_t net = 0;            // depth every RETURN leaves
+    int64_t lowest = 0;         // lowest depth reached, callees included (<= 0)
+    int64_t frame = 0;          // highest depth reached, callees excluded
+    int64_t deepest = 0;        // highest depth reached, callees included
+
+    bool operator==(const RoutineSummary& other) const {
+        return returns == other.returns && net == other.net && lowest == other.lowest &&
+               frame == other.frame && deepest == other.deepest;
+    }
+};
+
+[[noreturn]] void fail(size_t ip, const BytecodeInstruction& in, const std::string& why) {
+    throw std::runtime_error("Bytecode verifier: " + why + " at @" + std::to_string(ip) + " (" +
+                             vmOpCodeName(in.opcode) + ")");
+}
+
+class StackVerifier {
+public:
+    StackVerifier(const BytecodeInstruction* code, size_t count)
+        : code(code), count(count), depthAt(count, kUnvisited) {}
+
+    StackVerification run() {
+        routineOf(0);
+        // Summaries only grow as more paths are explored, so a pass with no
+        // change is the fixpoint. Without recursion through growing depths
+        // that takes at most one pass per routine (plus one to confirm);
+        // depths still rising after that keep rising forever.
+        for (size_t pass = 0;; ++pass) {
+            bool changed = false;
+            bool netChanged = false;
+            std::vector<size_t> rising;
+            for (size_t r = 0; r < entries.size(); ++r) {
+                RoutineSummary before = summaries[r];
+                analyze(r);
+                if (summaries[r] == before) continue;
+                changed = true;
+                if (summaries[r].returns != before.returns) netChanged = true;
+                if (summaries[r].deepest != before.deepest) rising.push_back(r);
+                if (summaries[r].lowest != before.lowest && pass > entries.size()) {
+                    fail(entries[r], code[entries[r]], "stack underflow through recursive calls");
+                }
+            }
+            if (!changed) break;
+            if (pass > entries.size() && !netChanged) {
+                for (size_t r : rising) summaries[r].deepest = kDepthCap;
+            }
+        }
+
+        StackVerification result;
+        const RoutineSummary& main = summaries[0];
+        result.bounds.maxDepth = main.deepest >= kDepthCap ? kUnboundedStackDepth
+                                                           : static_cast<uint32_t>(main.deepest);
+        int64_t maxFrame = 0;
+        for (size_t r = 0; r < entries.size(); ++r) {
+            maxFrame = std::max(maxFrame, summaries[r].frame);
+            result.frameDepths.emplace(entries[r], static_cast<uint32_t>(summaries[r].frame));
+        }
+        result.bounds.maxFrameDepth = static_cast<uint32_t>(maxFrame);
+
+        // One more walk per routine (summaries no longer change) to record
+        // the depth at each instruction
+        result.depths.assign(count, kUnreachedDepth);
+        for (size_t r = 0; r < entries.size(); ++r) {
+            analyze(r);
+            for (size_t ip : touched) {
+                int64_t& depth = result.depths[ip];
+                if (depth == kUnreachedDepth) depth = depthAt[ip];
+                else if (depth != depthAt[ip]) depth = kMixedDepth;
+            }
+        }
+        return result;
+    }
+
+private:
+    static constexpr int64_t kUnvisited = INT64_MIN;
+
+    size_t routineOf(size_t entry) {
+        auto it = routineIndex.find(entry);
+        if (it != routineIndex.end()) return it->second;
+        routineIndex.emplace(entry, entries.size());
+        entries.push_back(entry);
+        summaries.emplace_back();
+        return entries.size() - 1;
+    }
+
+    // One walk over routine r with the callee summaries known so far; a CALL
+    // whose callee has not returned yet is not followed past
+    void analyze(size_t r) {
+        const bool isMain = r == 0;
+        RoutineSummary summary;
+        for (size_t ip : touched) depthAt[ip] = kUnvisited;
+        touched.clear();
+        work.clear();
+        work.emplace_back(entries[r], 0);
+
+        while (!work.empty()) {
+            size_t ip = work.back().first;
+            int64_t depth = work.back().second;
+            work.pop_back();
+            const BytecodeInstruction& in = code[ip];
+            if (depthAt[ip] != kUnvisited) {
+                if (depthAt[ip] != depth) {
+                    fail(ip, in, "stack depth " + std::to_string(depth) + " here on one path and " +
+                                 std::to_string(depthAt[ip]) + " on another");
+                }
+                continue;
+            }
+            depthAt[ip] = depth;
+            touched.push_back(ip);
+
+            VMStackEffect effect = vmStackEffect(in.opcode);
+            int64_t low = depth - effect.pops;
+            if (isMain && low < 0) fail(ip, in, "stack underflow");
+            int64_t next = std::min(low + effect.pushes, kDepthCap);
+            summary.lowest = std::min(summary.lowest, low);
+            summary.frame = std::max(summary.frame, std::max(depth, next));
+            summary.deepest = std::max(summary.deepest, std::max(depth, next));
+            if (summary.frame >= kDepthCap) fail(ip, in, "stack depth out of range");
+
+            switch (in.opcode) {
+                case VMOpCode::VM_JUMP:
+                    follow(ip, static_cast<size_t>(in.operand1), next);
+                    break;
+                case VMOpCode::VM_JUMP_IF_TRUE:
+                case VMOpCode::VM_JUMP_IF_FALSE:
+                    follow(ip, static_cast<size_t>(in.operand1), next);
+                    follow(ip, ip + 1, next);
+                    break;
+                case VMOpCode::VM_CALL: {
+                    size_t target = static_cast<size_t>(in.operand1);
+                    if (target >= count) fail(ip, in, "jump target out of range");
+                    const RoutineSummary callee = summaries[routineOf(target)];
+                    if (isMain && depth + callee.lowest < 0) fail(ip, in, "stack underflow in the callee");
+                    summary.lowest = std::min(summary.lowest, depth + callee.lowest);
+                    summary.deepest = std::min(kDepthCap, std::max(summary.deepest, depth + callee.deepest));
+                    if (callee.returns) follow(ip, ip + 1, depth + callee.net);
+                    break;
+                }
+                case VMOpCode::VM_RETURN:
+                    // RETURN in the main routine ends the program
+                    if (isMain) break;
+                    if (summary.returns && summary.net != depth) {
+                        fail(ip, in, "RETURN leaves stack depth " + std::to_string(depth) +
+                                     ", another RETURN of the routine " + std::to_string(summary.net));
+                    }
+                    summary.returns = true;
+                    summary.net = depth;
+                    break;
+                case VMOpCode::VM_HALT:
+                    break;
+                default:
+                    follow(ip, ip + 1, next);
+                    break;
+            }
+        }
+        summaries[r] = summary;
+    }
+
+    void follow(size_t from, size_t to, int64_t depth) {
+        if (to >= count) fail(from, code[from], "control flow leaves the code");
+        if (depth >= kDepthCap) fail(from, code[from], "stack depth out of range");
+        work.emplace_back(to, depth);
+    }
+
+    const BytecodeInstruction* code;
+    size_t count;
+    std::vector<int64_t> depthAt;       // per ip, for the routine being walked
+    std::vector<size_t> touched;        // entries of depthAt to reset
+    std::vector<std::pair<size_t, int64_t>> work;
+    std::vector<size_t> entries;        // routine entry ips; 0 is main
+    std::vector<RoutineSummary> summaries;
+    std::unordered_map<size_t, size_t> routineIndex;
+};
+
+} // namespace
+
+StackVerification verifyStack(const BytecodeInstruction* code, size_t count) {
+    if (count == 0) return StackVerification();
+    return StackVerifier(code, count).run();
+}
+
+bool chooseCachedVariants(const BytecodeInstruction* code, size_t count, const StackVerification& verified,
+                          std::vector<uint8_t>& variants) {
+    variants.assign(count, 0);
+    for (size_t ip = 0; ip < count; ++ip) {
+        const VMOpCode op = code[ip].opcode;
+        const int64_t depth = verified.depths[ip];
+        // Never runs, so any variant will do
+        if (depth == kUnreachedDepth) continue;
+        VMStackEffect effect = vmStackEffect(op);
+        if (depth == kMixedDepth || depth < effect.pops) return false;
+
+        const bool before = depth > 0;
+        bool after = depth - effect.pops + effect.pushes > 0;
+        if (op == VMOpCode::VM_CALL) {
+            // After the call returns: the depth the continuation runs at
+            const int64_t next = ip + 1 < count ? verified.depths[ip + 1] : kUnreachedDepth;
+            after = next == kUnreachedDepth ? before : next > 0;
+        } else if (op == VMOpCode::VM_RETURN) {
+            after = before;
+        }
+        variants[ip] = vmCachedVariant(op, before, after);
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "assembler.h"
+
+// Operand-stack verification for packed bytecode.
+//
+// A routine is the code run from instruction 0, or from a CALL target until
+// its RETURN. Each routine is walked from its entry with a relative stack
+// depth of 0, following jumps and falling through, using vmStackEffect for
+// every instruction and the callee's summary for every CALL. The walk
+// proves that
+//   - every instruction is reached with one stack depth, whatever the path
+//     (so each basic block has a fixed entry depth and a fixed balance),
+//   - the program never pops below the bottom of the stack, and
+//   - all RETURNs of a routine leave the same depth (its net effect).
+// Mutually dependent routines (recursion) are summarized by iterating to a
+// fixpoint. Unreachable code is not checked; it never runs.
+//
+// With the bounds proven the VM can run on a preallocated stack without
+// checking for underflow or overflow per push and pop. The only check left
+// is at CALL, which makes sure the callee's frame fits, since recursion can
+// make the total depth unbounded.
+
+// Depth of a program whose stack can keep growing through recursion
+const uint32_t kUnboundedStackDepth = UINT32_MAX;
+
+// StackVerification::depths entries that are not depths
+const int64_t kUnreachedDepth = INT64_MIN;      // no routine runs it
+const int64_t kMixedDepth = INT64_MIN + 1;      // routines sharing it disagree
+
+struct StackVerification {
+    StackBounds bounds;
+    // Routine entry ip -> most values that routine holds above its entry
+    // depth, not counting its callees (the room a CALL to it must find)
+    std::unordered_map<size_t, uint32_t> frameDepths;
+    // Per ip: stack depth before the instruction, relative to the entry of
+    // the routine running it (negative where a routine pops its caller's
+    // values)
+    std::vector<int64_t> depths;
+};
+
+// Throws std::runtime_error naming the first offending instruction
+StackVerification verifyStack(const BytecodeInstruction* code, size_t count);
+
+// Picks each instruction's cachedVariant (assembler.h) from the verified
+// depths: the top is cached wherever the routine's own stack is not empty.
+// Returns false, leaving `variants` unspecified, for code the caching
+// interpreter cannot run: routines that pop their caller's values or share
+// instructions at different depths.
+bool chooseCachedVariants(const BytecodeInstruction* code, size_t count, const StackVerification& verified,
+                          std::vector<uint8_t>& variants);
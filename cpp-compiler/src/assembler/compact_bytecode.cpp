@@ -0,0 +1,192 @@
+#include "compact_bytecode.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Operands an instruction carries in the compact encoding
+int operandCount(VMOpCode op) {
+    if (op == VMOpCode::VM_CALL) return 2;  // target, callee stack room
+    if (vmOperandKind(op, 2) != VMOperandKind::None) return 2;
+    return vmOperandKind(op, 1) != VMOperandKind::None ? 1 : 0;
+}
+
+bool hasTarget(VMOpCode op) {
+    return vmOperandKind(op, 1) == VMOperandKind::Target;
+}
+
+// Smallest operand width that holds `value`
+int widthFor(int64_t value) {
+    if (value >= INT8_MIN && value <= INT8_MAX) return 1;
+    if (value >= INT16_MIN && value <= INT16_MAX) return 2;
+    return 4;
+}
+
+// Short opcode for `in`, or -1 when it needs the general form
+int shortForm(const BytecodeInstruction& in) {
+    switch (in.opcode) {
+        case VMOpCode::VM_PUSH:
+            if (in.operand1 == 0) return static_cast<int>(CompactOpCode::CM_PUSH_0);
+            if (in.operand1 == 1) return static_cast<int>(CompactOpCode::CM_PUSH_1);
+            break;
+        case VMOpCode::VM_LOAD:
+            if (in.operand1 >= 0 && in.operand1 < 4) return static_cast<int>(CompactOpCode::CM_LOAD_S0) + in.operand1;
+            break;
+        case VMOpCode::VM_STORE:
+            if (in.operand1 >= 0 && in.operand1 < 4) return static_cast<int>(CompactOpCode::CM_STORE_S0) + in.operand1;
+            break;
+        default:
+            break;
+    }
+    return -1;
+}
+
+BytecodeInstruction expandShortForm(CompactOpCode op) {
+    const int n = static_cast<int>(op);
+    if (op == CompactOpCode::CM_PUSH_0 || op == CompactOpCode::CM_PUSH_1) {
+        return BytecodeInstruction(VMOpCode::VM_PUSH, n - static_cast<int>(CompactOpCode::CM_PUSH_0));
+    }
+    if (op >= CompactOpCode::CM_LOAD_S0 && op <= CompactOpCode::CM_LOAD_S3) {
+        return BytecodeInstruction(VMOpCode::VM_LOAD, n - static_cast<int>(CompactOpCode::CM_LOAD_S0));
+    }
+    return BytecodeInstruction(VMOpCode::VM_STORE, n - static_cast<int>(CompactOpCode::CM_STORE_S0));
+}
+
+void appendOperand(std::vector<uint8_t>& out, int32_t value, int width) {
+    uint8_t bytes[4];
+    if (width == 1) {
+        bytes[0] = static_cast<uint8_t>(static_cast<int8_t>(value));
+    } else if (width == 2) {
+        int16_t narrow = static_cast<int16_t>(value);
+        std::memcpy(bytes, &narrow, sizeof(narrow));
+    } else {
+        std::memcpy(bytes, &value, sizeof(value));
+    }
+    out.insert(out.end(), bytes, bytes + width);
+}
+
+int32_t readOperand(const uint8_t* p, int width) {
+    if (width == 1) return compactOperand<1>(p);
+    if (width == 2) return compactOperand<2>(p);
+    return compactOperand<4>(p);
+}
+
+[[noreturn]] void malformed(size_t offset, const std::string& why) {
+    throw std::runtime_error("Compact bytecode: " + why + " at byte " + std::to_string(offset));
+}
+
+} // namespace
+
+CompactProgram encodeCompact(const BytecodeProgram& program) {
+    const std::vector<BytecodeInstruction>& code = program.code;
+    const size_t count = code.size();
+
+    // Operand width per instruction; 0 marks a short form
+    std::vector<int> width(count, 1);
+    for (size_t ip = 0; ip < count; ++ip) {
+        const BytecodeInstruction& in = code[ip];
+        if (shortForm(in) >= 0) {
+            width[ip] = 0;
+            continue;
+        }
+        const int operands = operandCount(in.opcode);
+        if (operands >= 1 && !hasTarget(in.opcode)) width[ip] = widthFor(in.operand1);
+        if (operands == 2) width[ip] = std::max(width[ip], widthFor(in.operand2));
+    }
+    auto sizeOf = [&](size_t ip) -> size_t {
+        if (width[ip] == 0) return 1;
+        return (width[ip] > 1 ? 1 : 0) + 1 + static_cast<size_t>(operandCount(code[ip].opcode) * width[ip]);
+    };
+
+    // Widening a jump can only push other targets further away, so growing
+    // widths until nothing changes settles on the smallest consistent layout
+    std::vector<size_t> offset(count + 1, 0);
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t ip = 0; ip < count; ++ip) offset[ip + 1] = offset[ip] + sizeOf(ip);
+        if (offset[count] > INT32_MAX) throw std::runtime_error("Compact bytecode: program too large");
+        for (size_t ip = 0; ip < count; ++ip) {
+            if (!hasTarget(code[ip].opcode)) continue;
+            int64_t distance = static_cast<int64_t>(offset[code[ip].operand1]) - static_cast<int64_t>(offset[ip]);
+            int needed = widthFor(distance);
+            if (needed > width[ip]) {
+                width[ip] = needed;
+                changed = true;
+            }
+        }
+    }
+
+    CompactProgram result;
+    result.code.reserve(offset[count]);
+    for (size_t ip = 0; ip < count; ++ip) {
+        const BytecodeInstruction& in = code[ip];
+        if (width[ip] == 0) {
+            result.code.push_back(static_cast<uint8_t>(shortForm(in)));
+            continue;
+        }
+        if (width[ip] == 2) result.code.push_back(static_cast<uint8_t>(CompactOpCode::CM_WIDE16));
+        if (width[ip] == 4) result.code.push_back(static_cast<uint8_t>(CompactOpCode::CM_WIDE32));
+        result.code.push_back(static_cast<uint8_t>(in.opcode));
+        const int operands = operandCount(in.opcode);
+        if (operands >= 1) {
+            int32_t first = in.operand1;
+            if (hasTarget(in.opcode)) {
+                first = static_cast<int32_t>(static_cast<int64_t>(offset[in.operand1]) - static_cast<int64_t>(offset[ip]));
+            }
+            appendOperand(result.code, first, width[ip]);
+        }
+        if (operands == 2) appendOperand(result.code, in.operand2, width[ip]);
+    }
+    result.instructionCount = count;
+    result.slotNames = program.slotNames;
+    result.constants = program.constants;
+    result.stackBounds = program.stackBounds;
+    return result;
+}
+
+std::vector<BytecodeInstruction> decodeCompact(const CompactProgram& program) {
+    const std::vector<uint8_t>& bytes = program.code;
+    std::vector<BytecodeInstruction> code;
+    code.reserve(program.instructionCount);
+    std::vector<size_t> starts;                         // instruction -> byte offset
+    std::vector<int32_t> indexAt(bytes.size() + 1, -1); // byte offset -> instruction
+
+    for (size_t at = 0; at < bytes.size();) {
+        indexAt[at] = static_cast<int32_t>(code.size());
+        starts.push_back(at);
+        size_t opAt = at;
+        int width = 1;
+        if (bytes[at] >= kVMOpCodeCount) {
+            const CompactOpCode op = static_cast<CompactOpCode>(bytes[at]);
+            if (op > CompactOpCode::CM_WIDE32) malformed(at, "unknown opcode " + std::to_string(bytes[at]));
+            if (op != CompactOpCode::CM_WIDE16 && op != CompactOpCode::CM_WIDE32) {
+                code.push_back(expandShortForm(op));
+                ++at;
+                continue;
+            }
+            width = op == CompactOpCode::CM_WIDE16 ? 2 : 4;
+            opAt = at + 1;
+            if (opAt >= bytes.size() || bytes[opAt] >= kVMOpCodeCount) malformed(at, "prefix without an opcode");
+        }
+        const VMOpCode opcode = static_cast<VMOpCode>(bytes[opAt]);
+        const int operands = operandCount(opcode);
+        const size_t end = opAt + 1 + static_cast<size_t>(operands * width);
+        if (end > bytes.size()) malformed(at, "truncated instruction");
+        code.emplace_back(opcode,
+                          operands >= 1 ? readOperand(&bytes[opAt + 1], width) : 0,
+                          operands == 2 ? readOperand(&bytes[opAt + 1 + width], width) : 0);
+        at = end;
+    }
+
+    for (size_t ip = 0; ip < code.size(); ++ip) {
+        if (!hasTarget(code[ip].opcode)) continue;
+        int64_t target = static_cast<int64_t>(starts[ip]) + code[ip].operand1;
+        if (target < 0 || target >= static_cast<int64_t>(bytes.size()) || indexAt[target] < 0) {
+            malformed(starts[ip], "jump into the middle of an instruction");
+        }
+        code[ip].operand1 = indexAt[target];
+    }
+    return code;
+}
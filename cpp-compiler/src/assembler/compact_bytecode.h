@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "assembler.h"
+
+// Variable-length encoding of assembled stack VM code, for large programs
+// whose fixed 12-byte BytecodeInstructions crowd the instruction cache.
+//
+// Every instruction starts with a one-byte opcode:
+//   0 .. kVMOpCodeCount-1   a VMOpCode whose operands follow as 1 byte each
+//   COMPACT_OPCODE_LIST     short forms with the operand implied by the
+//                           opcode (PUSH_0, LOAD_S0, ...), and the prefixes
+//   CM_WIDE16 / CM_WIDE32   the next byte is a VMOpCode whose operands are
+//                           2 / 4 bytes each
+// Operands are signed and stored in native byte order, in the order of the
+// packed instruction; CALL also carries its callee's stack room (operand2).
+// Jump and call targets are byte offsets relative to the start of the
+// jumping instruction (prefix included), so most loops need one byte.
+//
+// Compact code is only ever produced in memory by encodeCompact from
+// verified bytecode; the VM's compact engine trusts it like the packed form.
+
+#define COMPACT_OPCODE_LIST(X) \
+    X(CM_PUSH_0)               \
+    X(CM_PUSH_1)               \
+    X(CM_LOAD_S0)              \
+    X(CM_LOAD_S1)              \
+    X(CM_LOAD_S2)              \
+    X(CM_LOAD_S3)              \
+    X(CM_STORE_S0)             \
+    X(CM_STORE_S1)             \
+    X(CM_STORE_S2)             \
+    X(CM_STORE_S3)             \
+    X(CM_WIDE16)               \
+    X(CM_WIDE32)
+
+#define VM_OPCODE_COUNT_ONE(name) +1
+const unsigned kVMOpCodeCount = 0 VM_OPCODE_LIST(VM_OPCODE_COUNT_ONE);
+#undef VM_OPCODE_COUNT_ONE
+
+// Compact opcodes past the VMOpCode range
+enum class CompactOpCode : uint8_t {
+    CM_LAST_VM_OPCODE = kVMOpCodeCount - 1,
+#define COMPACT_OPCODE_ENUM(name) name,
+    COMPACT_OPCODE_LIST(COMPACT_OPCODE_ENUM)
+#undef COMPACT_OPCODE_ENUM
+};
+
+// Operand of `Width` bytes at p, sign-extended
+template <int Width>
+inline int32_t compactOperand(const uint8_t* p);
+template <>
+inline int32_t compactOperand<1>(const uint8_t* p) {
+    return static_cast<int8_t>(*p);
+}
+template <>
+inline int32_t compactOperand<2>(const uint8_t* p) {
+    int16_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+template <>
+inline int32_t compactOperand<4>(const uint8_t* p) {
+    int32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// A BytecodeProgram in the compact encoding. Like the packed stream, the
+// code always ends with HALT and has passed stack verification.
+struct CompactProgram {
+    std::vector<uint8_t> code;
+    size_t instructionCount = 0;
+    std::vector<std::string> slotNames;
+    std::vector<Value> constants;
+    StackBounds stackBounds;
+};
+
+// Encodes `program` choosing the smallest form of every instruction; jump
+// widths are settled by growing them until every target fits
+CompactProgram encodeCompact(const BytecodeProgram& program);
+
+// Decodes compact code back into packed instructions (targets become
+// instruction indices again; cachedVariant is left 0), e.g. for listings
+std::vector<BytecodeInstruction> decodeCompact(const CompactProgram& program);
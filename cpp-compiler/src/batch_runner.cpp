@@ -0,0 +1,164 @@
+#include "batch_runner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+
+namespace {
+
+uint64_t pack(uint32_t begin, uint32_t end) {
+    return (uint64_t(begin) << 32) | end;
+}
+
+uint32_t rangeBegin(uint64_t bounds) {
+    return static_cast<uint32_t>(bounds >> 32);
+}
+
+uint32_t rangeEnd(uint64_t bounds) {
+    return static_cast<uint32_t>(bounds);
+}
+
+} // namespace
+
+BatchRunner::BatchRunner(size_t threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) workers.emplace_back(new Worker());
+    dispatchMode = workers.front()->vm.getDispatchMode();
+    for (size_t i = 0; i < threads; ++i) {
+        workers[i]->thread = std::thread(&BatchRunner::workerLoop, this, i);
+    }
+}
+
+BatchRunner::~BatchRunner() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    startSignal.notify_all();
+    for (auto& worker : workers) worker->thread.join();
+}
+
+void BatchRunner::setExecutionMode(ExecutionMode mode) {
+    std::lock_guard<std::mutex> lock(mutex);
+    executionMode = mode;
+}
+
+void BatchRunner::setDispatchMode(DispatchMode mode) {
+    std::lock_guard<std::mutex> lock(mutex);
+    dispatchMode = mode;
+}
+
+std::vector<BatchResult> BatchRunner::run(const BytecodeProgram& program, const std::vector<BatchJob>& jobs) {
+    Executor executor = [&program](VirtualMachine& vm, const std::vector<Value>& inputs) {
+        vm.execute(program, inputs);
+    };
+    return runBatch(jobs, executor);
+}
+
+std::vector<BatchResult> BatchRunner::run(const BytecodeFile& file, const std::vector<BatchJob>& jobs) {
+    Executor executor = [&file](VirtualMachine& vm, const std::vector<Value>& inputs) {
+        vm.execute(file, inputs);
+    };
+    return runBatch(jobs, executor);
+}
+
+std::vector<BatchResult> BatchRunner::runBatch(const std::vector<BatchJob>& jobs, const Executor& executor) {
+    const size_t jobCount = jobs.size();
+    if (jobCount > UINT32_MAX) throw std::runtime_error("BatchRunner: too many jobs in one batch");
+    std::vector<BatchResult> results(jobCount);
+    if (jobCount == 0) return results;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    batchJobs = &jobs;
+    batchResults = &results;
+    batchExecutor = &executor;
+    steals.store(0, std::memory_order_relaxed);
+    const size_t count = workers.size();
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t begin = static_cast<uint32_t>(jobCount * i / count);
+        uint32_t end = static_cast<uint32_t>(jobCount * (i + 1) / count);
+        workers[i]->range.store(pack(begin, end), std::memory_order_relaxed);
+    }
+    activeWorkers = count;
+    ++generation;
+    startSignal.notify_all();
+    doneSignal.wait(lock, [this] { return activeWorkers == 0; });
+
+    batchJobs = nullptr;
+    batchResults = nullptr;
+    batchExecutor = nullptr;
+    return results;
+}
+
+void BatchRunner::workerLoop(size_t index) {
+    Worker& self = *workers[index];
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            startSignal.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            self.vm.setExecutionMode(executionMode);
+            self.vm.setDispatchMode(dispatchMode);
+        }
+
+        uint32_t job;
+        while (takeOwn(index, job) || steal(index, job)) runJob(self, job);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--activeWorkers == 0) doneSignal.notify_one();
+    }
+}
+
+// Owner end: the front of its own range
+bool BatchRunner::takeOwn(size_t index, uint32_t& job) {
+    std::atomic<uint64_t>& bounds = workers[index]->range;
+    uint64_t current = bounds.load(std::memory_order_acquire);
+    while (rangeBegin(current) < rangeEnd(current)) {
+        if (bounds.compare_exchange_weak(current, pack(rangeBegin(current) + 1, rangeEnd(current)),
+                                         std::memory_order_acq_rel)) {
+            job = rangeBegin(current);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Thief end: the back half of the first non-empty range after the thief's.
+// The thief runs the first stolen job and keeps the rest as its new range;
+// its own range is empty here, so no other thread can be changing it.
+bool BatchRunner::steal(size_t thief, uint32_t& job) {
+    const size_t count = workers.size();
+    for (size_t offset = 1; offset < count; ++offset) {
+        std::atomic<uint64_t>& victim = workers[(thief + offset) % count]->range;
+        uint64_t current = victim.load(std::memory_order_acquire);
+        while (rangeBegin(current) < rangeEnd(current)) {
+            uint32_t begin = rangeBegin(current);
+            uint32_t end = rangeEnd(current);
+            uint32_t take = (end - begin + 1) / 2;
+            if (victim.compare_exchange_weak(current, pack(begin, end - take), std::memory_order_acq_rel)) {
+                job = end - take;
+                workers[thief]->range.store(pack(job + 1, end), std::memory_order_release);
+                steals.fetch_add(take, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void BatchRunner::runJob(Worker& worker, uint32_t job) {
+    BatchResult& result = (*batchResults)[job];
+    try {
+        (*batchExecutor)(worker.vm, (*batchJobs)[job].inputs);
+        result.ok = true;
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    result.globals = worker.vm.getGlobals();
+    // The worker's VM lets go of its strings at the next job
+    for (Value value : result.globals) result.strings.retain(value);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vm.h"
+
+// Runs one assembled program many times, over different inputs, on a pool
+// of worker threads.
+//
+// The program (a BytecodeProgram or a mapped BytecodeFile) is shared
+// read-only by all workers; each worker owns a VirtualMachine, so stacks,
+// globals and any JIT code are per thread and reused from job to job. A
+// batch is split into one contiguous range of jobs per worker. A worker
+// takes jobs from the front of its own range and, once that is empty,
+// steals the back half of another worker's range, so uneven jobs still
+// keep every core busy. Both ends of a range share one atomic word; taking
+// and stealing are single compare-and-swaps with no locks. Locks are only
+// used to start a batch and to wait for it.
+
+// One run of the shared program
+struct BatchJob {
+    std::vector<Value> inputs;  // initial variable values by slot; may be empty
+};
+
+struct BatchResult {
+    bool ok = false;
+    std::string error;          // VM error message when !ok
+    std::vector<Value> globals; // final variable values by slot
+    StringOwner strings;        // keeps the strings in globals alive
+};
+
+class BatchRunner {
+public:
+    // threads == 0 uses one worker per hardware thread
+    explicit BatchRunner(size_t threads = 0);
+    ~BatchRunner();
+    BatchRunner(const BatchRunner&) = delete;
+    BatchRunner& operator=(const BatchRunner&) = delete;
+
+    size_t threadCount() const { return workers.size(); }
+
+    // Applied to every worker's VM from the next batch on
+    void setExecutionMode(ExecutionMode mode);
+    void setDispatchMode(DispatchMode mode);
+
+    // Runs every job and returns the results in job order. Blocks until the
+    // whole batch is done; call from one thread at a time.
+    std::vector<BatchResult> run(const BytecodeProgram& program, const std::vector<BatchJob>& jobs);
+    std::vector<BatchResult> run(const BytecodeFile& file, const std::vector<BatchJob>& jobs);
+
+    // Jobs taken from another worker's range during the last batch
+    uint64_t lastBatchSteals() const { return steals.load(std::memory_order_relaxed); }
+
+private:
+    typedef std::function<void(VirtualMachine&, const std::vector<Value>&)> Executor;
+
+    // Workers are allocated separately and each holds a whole VM, so the
+    // ranges other threads CAS on never share a cache line
+    struct Worker {
+        std::thread thread;
+        VirtualMachine vm;
+        // Remaining jobs [begin, end), packed as begin << 32 | end
+        std::atomic<uint64_t> range{0};
+    };
+
+    std::vector<BatchResult> runBatch(const std::vector<BatchJob>& jobs, const Executor& executor);
+    void workerLoop(size_t index);
+    bool takeOwn(size_t index, uint32_t& job);
+    bool steal(size_t thief, uint32_t& job);
+    void runJob(Worker& worker, uint32_t job);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    ExecutionMode executionMode = ExecutionMode::Interpret;
+    DispatchMode dispatchMode;
+
+    // Current batch; written by run() before the start signal
+    const std::vector<BatchJob>* batchJobs = nullptr;
+    std::vector<BatchResult>* batchResults = nullptr;
+    const Executor* batchExecutor = nullptr;
+    std::atomic<uint64_t> steals{0};
+
+    std::mutex mutex;
+    std::condition_variable startSignal;
+    std::condition_variable doneSignal;
+    uint64_t generation = 0;    // bumped once per batch
+    size_t activeWorkers = 0;
+    bool stopping = false;
+};
@@ -1,8 +1,10 @@
 #include "codegen.h"
+#include <stdexcept>
 
-// Utility: construct temp variable names
+// Utility: construct temp variable names. '%' cannot appear in an
+// identifier, so a temporary never shares a register with a user variable.
 std::string CodeGenerator::makeTempVar() {
-    return "_t" + std::to_string(tempVarCounter++);
+    return "%t" + std::to_string(tempVarCounter++);
 }
 
 CodeGenerator::CodeGenerator() : tempVarCounter(0), symbolTable(nullptr) {}
@@ -11,6 +13,18 @@ void CodeGenerator::setSymbolTable(const std::unordered_map<std::string, Symbol>
     symbolTable = table;
 }
 
+// Slot assigned by the SemanticAnalyzer, or -1 when no symbol table is linked
+int CodeGenerator::slotOf(const std::string& name) const {
+    if (!symbolTable) return -1;
+    auto it = symbolTable->find(name);
+    return it != symbolTable->end() ? it->second.slot : -1;
+}
+
+// LOAD/STORE carry the slot in operand2; empty lets the Assembler assign one
+std::string CodeGenerator::slotOperand(int slot) {
+    return slot >= 0 ? std::to_string(slot) : std::string();
+}
+
 void CodeGenerator::generate(const std::unique_ptr<ASTNode>& root) {
     instructions.clear();
     tempVarCounter = 0;
@@ -21,6 +35,24 @@ const std::vector<Instruction>& CodeGenerator::getInstructions() const {
     return instructions;
 }
 
+void CodeGenerator::generateThreeAddress(const std::unique_ptr<ASTNode>& root) {
+    threeAddressCode.clear();
+    tempVarCounter = 0;
+    if (auto prog = dynamic_cast<const ProgramNode*>(root.get())) {
+        for (const auto& stmt : prog->statements) {
+            // Temporaries never outlive a statement, so their registers are reused
+            tempVarCounter = 0;
+            lowerThreeAddress(stmt.get(), "");
+        }
+    } else {
+        lowerThreeAddress(root.get(), "");
+    }
+}
+
+const std::vector<TACInstruction>& CodeGenerator::getThreeAddressCode() const {
+    return threeAddressCode;
+}
+
 void CodeGenerator::visit(const ASTNode* node) {
     if (!node) return;
     if (auto prog = dynamic_cast<const ProgramNode*>(node)) {
@@ -37,17 +69,24 @@ void CodeGenerator::visit(const ASTNode* node) {
         visitNumberLiteral(num);
     } else if (auto str = dynamic_cast<const StringLiteralNode*>(node)) {
         visitStringLiteral(str);
+    } else if (auto print = dynamic_cast<const PrintNode*>(node)) {
+        visitPrint(print);
     }
     // Add more else-if's as your AST expands
 }
 
 void CodeGenerator::visitProgram(const ProgramNode* prog) {
     for (const auto& stmt : prog->statements) {
-        visit(stmt.get());
+        // A statement-level assignment's value is discarded, so skip the reload
+        if (auto assign = dynamic_cast<const AssignmentNode*>(stmt.get())) {
+            visitAssignment(assign, false);
+        } else {
+            visit(stmt.get());
+        }
     }
 }
 
-void CodeGenerator::visitAssignment(const AssignmentNode* assign) {
+void CodeGenerator::visitAssignment(const AssignmentNode* assign, bool keepValue) {
     // Assume simple variable = expression
     const auto* lhsIdent = dynamic_cast<IdentifierNode*>(assign->lhs.get());
     if (!lhsIdent) return;
@@ -56,47 +95,104 @@ void CodeGenerator::visitAssignment(const AssignmentNode* assign) {
     visit(assign->rhs.get());
 
     // Store top of stack (result) in variable
-    instructions.emplace_back(OpCode::STORE, lhsIdent->name);
-    variables[lhsIdent->name] = VariableInfo{lhsIdent->name};  // Optionally, set offset/location
+    int slot = slotOf(lhsIdent->name);
+    instructions.emplace_back(OpCode::STORE, lhsIdent->name, slotOperand(slot));
+    variables[lhsIdent->name] = VariableInfo{lhsIdent->name, slot};
+
+    // Used as an expression (a = b = 3), the assignment yields the stored value
+    if (keepValue) {
+        instructions.emplace_back(OpCode::LOAD, lhsIdent->name, slotOperand(slot));
+    }
 }
 
 void CodeGenerator::visitBinaryOp(const BinaryOpNode* bin) {
     // Post-order / left-right for stack machine
     visit(bin->left.get());
     visit(bin->right.get());
-    // Map operator to OpCode
-    OpCode op = OpCode::ADD;
-    if      (bin->op == "+") op = OpCode::ADD;
-    else if (bin->op == "-") op = OpCode::SUB;
-    else if (bin->op == "*") op = OpCode::MUL;
-    else if (bin->op == "/") op = OpCode::DIV;
-    else if (bin->op == "==") op = OpCode::CMP_EQ;
-    else if (bin->op == "!=") op = OpCode::CMP_NE;
-    else if (bin->op == "<")  op = OpCode::CMP_LT;
-    else if (bin->op == "<=") op = OpCode::CMP_LE;
-    else if (bin->op == ">")  op = OpCode::CMP_GT;
-    else if (bin->op == ">=") op = OpCode::CMP_GE;
+    instructions.emplace_back(binaryOpCode(bin->op));
+}
+
+// Map operator to OpCode
+OpCode CodeGenerator::binaryOpCode(const std::string& op) {
+    if      (op == "+") return OpCode::ADD;
+    else if (op == "-") return OpCode::SUB;
+    else if (op == "*") return OpCode::MUL;
+    else if (op == "/") return OpCode::DIV;
+    else if (op == "==") return OpCode::CMP_EQ;
+    else if (op == "!=") return OpCode::CMP_NE;
+    else if (op == "<")  return OpCode::CMP_LT;
+    else if (op == "<=") return OpCode::CMP_LE;
+    else if (op == ">")  return OpCode::CMP_GT;
+    else if (op == ">=") return OpCode::CMP_GE;
     // Add more operators as needed
-    instructions.emplace_back(op);
+    return OpCode::ADD;
 }
 
 void CodeGenerator::visitUnaryOp(const UnaryOpNode* unary) {
     visit(unary->operand.get());
-    OpCode op = OpCode::NEG;
-    if (unary->op == "-") op = OpCode::NEG;
-    else if (unary->op == "!") op = OpCode::CMP_EQ; // Or custom unary-not opcode
-    instructions.emplace_back(op);
+    if (unary->op == "!") {
+        // !x is x == 0, as in the three-address lowering
+        instructions.emplace_back(OpCode::PUSH, "0");
+        instructions.emplace_back(OpCode::CMP_EQ);
+        return;
+    }
+    instructions.emplace_back(OpCode::NEG);
 }
 
 void CodeGenerator::visitIdentifier(const IdentifierNode* ident) {
     // Load variable onto stack
-    instructions.emplace_back(OpCode::LOAD, ident->name);
+    instructions.emplace_back(OpCode::LOAD, ident->name, slotOperand(slotOf(ident->name)));
 }
 
 void CodeGenerator::visitNumberLiteral(const NumberLiteralNode* num) {
     instructions.emplace_back(OpCode::PUSH, num->value);
 }
 
+// Quoted, as in three-address code, so the Assembler can tell "12" from 12
 void CodeGenerator::visitStringLiteral(const StringLiteralNode* str) {
-    instructions.emplace_back(OpCode::PUSH, str->value);
+    instructions.emplace_back(OpCode::PUSH, "\"" + str->value + "\"");
+}
+
+void CodeGenerator::visitPrint(const PrintNode* print) {
+    visit(print->value.get());
+    instructions.emplace_back(OpCode::PRINT);
+}
+
+std::string CodeGenerator::lowerThreeAddress(const ASTNode* node, const std::string& target) {
+    if (!node) return "";
+    if (auto assign = dynamic_cast<const AssignmentNode*>(node)) {
+        const auto* lhsIdent = dynamic_cast<IdentifierNode*>(assign->lhs.get());
+        if (!lhsIdent) return "";
+        // The right-hand side's last operation writes the variable directly
+        std::string value = lowerThreeAddress(assign->rhs.get(), lhsIdent->name);
+        if (value != lhsIdent->name) {
+            threeAddressCode.emplace_back(OpCode::LOAD, lhsIdent->name, value);
+        }
+        variables[lhsIdent->name] = VariableInfo{lhsIdent->name, slotOf(lhsIdent->name)};
+        return lhsIdent->name;
+    } else if (auto bin = dynamic_cast<const BinaryOpNode*>(node)) {
+        std::string lhs = lowerThreeAddress(bin->left.get(), "");
+        std::string rhs = lowerThreeAddress(bin->right.get(), "");
+        std::string result = target.empty() ? makeTempVar() : target;
+        threeAddressCode.emplace_back(binaryOpCode(bin->op), result, lhs, rhs);
+        return result;
+    } else if (auto unary = dynamic_cast<const UnaryOpNode*>(node)) {
+        std::string operand = lowerThreeAddress(unary->operand.get(), "");
+        std::string result = target.empty() ? makeTempVar() : target;
+        if (unary->op == "!") {
+            threeAddressCode.emplace_back(OpCode::CMP_EQ, result, operand, "0");
+        } else {
+            threeAddressCode.emplace_back(OpCode::NEG, result, operand);
+        }
+        return result;
+    } else if (auto ident = dynamic_cast<const IdentifierNode*>(node)) {
+        return ident->name;
+    } else if (auto num = dynamic_cast<const NumberLiteralNode*>(node)) {
+        return num->value;
+    } else if (auto str = dynamic_cast<const StringLiteralNode*>(node)) {
+        return "\"" + str->value + "\"";  // quoted so it can't be taken for a variable
+    } else if (dynamic_cast<const PrintNode*>(node)) {
+        throw std::runtime_error("print is not supported by the register VM");
+    }
+    return "";
 }
@@ -5,6 +5,7 @@
 #include <unordered_map>
 #include <memory>
 #include "ast.h"
+#include "semantic.h"
 
 // Enum for the intermediate code opcodes
 enum class OpCode {
@@ -29,6 +30,7 @@ enum class OpCode {
     LABEL,
     CALL,
     RETURN,
+    PRINT,      // pops a value and prints it on a line of its own
     // Add more as your language requires
 };
 
@@ -43,10 +45,23 @@ struct Instruction {
         : opcode(op), operand1(op1), operand2(op2), label(lbl), comment(cmt) {}
 };
 
+// Three-address instruction for the register VM: result = arg1 op arg2.
+// Reuses the arithmetic/compare OpCodes, with LOAD meaning a plain copy
+// (result = arg1). Operands are variable names, temporaries from
+// makeTempVar(), or integer literals.
+struct TACInstruction {
+    OpCode opcode;
+    std::string result;
+    std::string arg1;
+    std::string arg2;
+    TACInstruction(OpCode op, const std::string& res, const std::string& a1 = "", const std::string& a2 = "")
+        : opcode(op), result(res), arg1(a1), arg2(a2) {}
+};
+
 // Variable metadata (for codegen and storage)
 struct VariableInfo {
     std::string name;
-    int offset = 0; // stack offset or memory position, if relevant
+    int offset = 0; // stack offset or memory position (global slot), if relevant
 };
 
 class CodeGenerator {
@@ -57,24 +72,38 @@ public:
 
     const std::vector<Instruction>& getInstructions() const;
 
+    // Register backend: lowers the same AST to three-address code
+    void generateThreeAddress(const std::unique_ptr<ASTNode>& root);
+    const std::vector<TACInstruction>& getThreeAddressCode() const;
+
     // Usually links to symbols for easier mapping
     void setSymbolTable(const std::unordered_map<std::string, Symbol>* table);
 
 private:
     void visit(const ASTNode* node);
     void visitProgram(const ProgramNode* prog);
-    void visitAssignment(const AssignmentNode* assign);
+    void visitAssignment(const AssignmentNode* assign, bool keepValue = true);
     void visitBinaryOp(const BinaryOpNode* bin);
     void visitUnaryOp(const UnaryOpNode* unary);
     void visitIdentifier(const IdentifierNode* ident);
     void visitNumberLiteral(const NumberLiteralNode* num);
     void visitStringLiteral(const StringLiteralNode* str);
+    void visitPrint(const PrintNode* print);
+
+    // Returns the operand holding the node's value; `target` names the
+    // variable the outermost operation should write to directly, if any
+    std::string lowerThreeAddress(const ASTNode* node, const std::string& target);
+    static OpCode binaryOpCode(const std::string& op);
 
     std::vector<Instruction> instructions;
+    std::vector<TACInstruction> threeAddressCode;
     std::unordered_map<std::string, VariableInfo> variables;
 
     const std::unordered_map<std::string, Symbol>* symbolTable = nullptr;
 
+    int slotOf(const std::string& name) const;
+    static std::string slotOperand(int slot);
+
     std::string makeTempVar();
     int tempVarCounter = 0;
 };
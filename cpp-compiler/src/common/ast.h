@@ -36,6 +36,13 @@ public:
     explicit StringLiteralNode(const std::string& val) : value(val) {}
 };
 
+// print(value);
+class PrintNode : public ASTNode {
+public:
+    std::unique_ptr<ASTNode> value;
+    explicit PrintNode(std::unique_ptr<ASTNode> value) : value(std::move(value)) {}
+};
+
 class AssignmentNode : public ASTNode {
 public:
     std::unique_ptr<ASTNode> lhs;
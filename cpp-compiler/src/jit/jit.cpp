@@ -0,0 +1,775 @@
+#include "jit.h"
+#include "bytecode_verifier.h"
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <stdexcept>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__))
+#define MYCOMPILER_JIT_X64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define MYCOMPILER_JIT_X64 0
+#endif
+
+// Generated code reads JitState through fixed displacements from r15
+static_assert(offsetof(JitState, globals) == 0, "JitState layout");
+static_assert(offsetof(JitState, stackBase) == 8, "JitState layout");
+static_assert(offsetof(JitState, stackTop) == 16, "JitState layout");
+static_assert(offsetof(JitState, stackLimit) == 24, "JitState layout");
+static_assert(offsetof(JitState, frameBase) == 32, "JitState layout");
+static_assert(offsetof(JitState, frameTop) == 40, "JitState layout");
+static_assert(offsetof(JitState, frameLimit) == 48, "JitState layout");
+static_assert(offsetof(JitState, ipToNative) == 56, "JitState layout");
+static_assert(offsetof(JitState, exitIp) == 64, "JitState layout");
+static_assert(offsetof(JitState, constants) == 72, "JitState layout");
+static_assert(offsetof(JitState, budget) == 80, "JitState layout");
+static_assert(offsetof(JitState, output) == 88, "JitState layout");
+static_assert(sizeof(Value) == 8, "JIT templates assume 8-byte Values");
+
+JitCode::~JitCode() {
+#if MYCOMPILER_JIT_X64
+    if (memory) munmap(memory, mapped);
+#endif
+}
+
+JitExit JitCode::run(JitState& state, size_t entryIp) const {
+#if MYCOMPILER_JIT_X64
+    typedef int (*Entry)(JitState*, const void*);
+    state.exitIp = entryIp;
+    // Mid-block the slot registers would have to be rebuilt from nothing
+    if (!enterable[entryIp]) return JitExit::Deopt;
+    state.ipToNative = ipToNative.data();
+    Entry entry = reinterpret_cast<Entry>(memory);
+    switch (entry(&state, ipToNative[entryIp])) {
+        case 0: return JitExit::Halted;
+        case 2: return JitExit::Yielded;
+        case 3: return JitExit::Error;
+        default: return JitExit::Deopt;
+    }
+#else
+    state.exitIp = entryIp;
+    return JitExit::Deopt;
+#endif
+}
+
+bool JitCompiler::isSupported() {
+    return MYCOMPILER_JIT_X64 != 0;
+}
+
+#if MYCOMPILER_JIT_X64
+namespace {
+
+enum : uint8_t {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15
+};
+enum : uint8_t { EAX = RAX, ECX = RCX, EDX = RDX };
+
+// Register assignment inside generated code:
+//   rbx = globals     r12 = base of the running routine's stack slots
+//   r14 = frame top   r15 = JitState*            rbp = ip -> native table
+//   rsi, rdi, r11, r13 = stack slots 0..3 of the routine (kSlotRegs)
+// rax/rcx/rdx are scratch; r8/r9 hold the int/bool tags and r10d the int
+// tag's high dword. Stack slots from 4 up and globals are 8-byte Values in
+// memory: int and bool payloads are read as the low dword and type checks
+// compare the high dword, but results are always boxed in rax and written
+// as a whole qword.
+const uint8_t kSlotRegs[] = {RSI, RDI, R11, R13};
+const size_t kSlotRegCount = sizeof kSlotRegs;
+
+class X64Emitter {
+public:
+    std::vector<uint8_t> buf;
+
+    size_t pos() const { return buf.size(); }
+    void bytes(std::initializer_list<uint8_t> list) { buf.insert(buf.end(), list.begin(), list.end()); }
+    void imm32(int32_t value) {
+        uint8_t raw[4];
+        std::memcpy(raw, &value, 4);
+        buf.insert(buf.end(), raw, raw + 4);
+    }
+    void imm32(uint32_t value) { imm32(static_cast<int32_t>(value)); }
+    void imm64(uint64_t value) {
+        uint8_t raw[8];
+        std::memcpy(raw, &value, 8);
+        buf.insert(buf.end(), raw, raw + 8);
+    }
+    // Emits opcode bytes followed by a rel32 placeholder; returns its position
+    size_t rel32(std::initializer_list<uint8_t> opcode) {
+        bytes(opcode);
+        size_t at = pos();
+        imm32(0);
+        return at;
+    }
+    void patch(size_t at, size_t target) {
+        int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&buf[at], &rel, 4);
+    }
+
+    // --- any register ---------------------------------------------------------
+    // REX prefix when one is needed: W for 64-bit operands, R/B extend reg/rm
+    void rex(bool wide, uint8_t reg, uint8_t rm) {
+        const uint8_t prefix = static_cast<uint8_t>(0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (rm & 8 ? 1 : 0));
+        if (prefix != 0x40) buf.push_back(prefix);
+    }
+    // op reg, [base + disp32]
+    void mem(std::initializer_list<uint8_t> op, bool wide, uint8_t reg, uint8_t base, int32_t disp) {
+        rex(wide, reg, base);
+        bytes(op);
+        buf.push_back(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | (base & 7)));
+        if ((base & 7) == RSP) buf.push_back(0x24);         // SIB: rsp/r12 base, no index
+        imm32(disp);
+    }
+    // op rm, reg between registers
+    void rr(std::initializer_list<uint8_t> op, bool wide, uint8_t reg, uint8_t rm) {
+        rex(wide, reg, rm);
+        bytes(op);
+        buf.push_back(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7)));
+    }
+    void load64(uint8_t dst, uint8_t base, int32_t disp) { mem({0x8B}, true, dst, base, disp); }
+    void load32(uint8_t dst, uint8_t base, int32_t disp) { mem({0x8B}, false, dst, base, disp); }
+    void store64(uint8_t base, int32_t disp, uint8_t src) { mem({0x89}, true, src, base, disp); }
+    void lea(uint8_t dst, uint8_t base, int32_t disp) { mem({0x8D}, true, dst, base, disp); }
+    void mov64(uint8_t dst, uint8_t src) {
+        if (dst != src) rr({0x89}, true, src, dst);
+    }
+    void mov32(uint8_t dst, uint8_t src) { rr({0x89}, false, src, dst); }
+    void movImm64(uint8_t dst, uint64_t value) {
+        rex(true, 0, dst);
+        buf.push_back(static_cast<uint8_t>(0xB8 | (dst & 7)));
+        imm64(value);
+    }
+    void shr64(uint8_t reg, uint8_t count) {
+        rex(true, 0, reg);
+        bytes({0xC1, static_cast<uint8_t>(0xE8 | (reg & 7)), count});
+    }
+    void push(uint8_t reg) {
+        if (reg & 8) buf.push_back(0x41);
+        buf.push_back(static_cast<uint8_t>(0x50 | (reg & 7)));
+    }
+    void pop(uint8_t reg) {
+        if (reg & 8) buf.push_back(0x41);
+        buf.push_back(static_cast<uint8_t>(0x58 | (reg & 7)));
+    }
+
+    // --- globals: [rbx + 8*slot] ------------------------------------------
+    void loadGlobal(uint8_t reg, int32_t slot) { load32(reg, RBX, slot * 8); }     // payload
+    void loadGlobalValue(uint8_t reg, int32_t slot) { load64(reg, RBX, slot * 8); }
+    void storeGlobalValue(int32_t slot, uint8_t reg) { store64(RBX, slot * 8, reg); }
+    void cmpGlobalIntTag(int32_t slot) { mem({0x39}, false, R10, RBX, slot * 8 + 4); }  // cmp [..+4], r10d
+
+    // Boxes the payload in eax (upper half of rax already zero)
+    void boxInt() { bytes({0x4C, 0x09, 0xC0}); }            // or rax, r8
+    void boxBool() { bytes({0x4C, 0x09, 0xC8}); }           // or rax, r9
+    void setcc(uint8_t cc) {                                // setcc al; movzx eax, al
+        bytes({0x0F, cc, 0xC0, 0x0F, 0xB6, 0xC0});
+    }
+    void loadTags() {
+        movImm64(R8, Value::kIntTag);
+        movImm64(R9, Value::kBoolTag);
+        bytes({0x41, 0xBA});                                // mov r10d, int tag >> 32
+        imm32(Value::kIntTagHigh);
+    }
+};
+
+// What the compiler knows about a stack entry or global at some ip
+enum class Known : uint8_t { Any, Int, Bool };
+enum : uint8_t { CC_E = 0x94, CC_NE = 0x95, CC_L = 0x9C, CC_GE = 0x9D, CC_LE = 0x9E, CC_G = 0x9F };
+
+bool compareCode(VMOpCode op, uint8_t& cc) {
+    switch (op) {
+        case VMOpCode::VM_CMP_EQ: cc = CC_E;  return true;
+        case VMOpCode::VM_CMP_NE: cc = CC_NE; return true;
+        case VMOpCode::VM_CMP_LT: cc = CC_L;  return true;
+        case VMOpCode::VM_CMP_LE: cc = CC_LE; return true;
+        case VMOpCode::VM_CMP_GT: cc = CC_G;  return true;
+        case VMOpCode::VM_CMP_GE: cc = CC_GE; return true;
+        default: return false;
+    }
+}
+
+// PRINT from generated code. Nothing may unwind through native frames, so a
+// failed write is reported by the return value and the message kept.
+int jitPrintLine(JitState* state, uint64_t bits) noexcept {
+    try {
+        state->output->printLine(Value::fromBits(bits));
+        return 0;
+    } catch (const std::exception& e) {
+        *state->error = e.what();
+        return 1;
+    }
+}
+
+const size_t kNoEntry = SIZE_MAX;
+
+class TemplateCompiler {
+public:
+    explicit TemplateCompiler(const std::vector<BytecodeInstruction>& program) : code(program) {}
+
+    bool compile() {
+        if (!proveDepths()) return false;
+        findBlockStarts();
+        emitPrologue();
+        nativeOffset.resize(code.size());
+        for (size_t ip = 0; ip < code.size(); ++ip) {
+            nativeOffset[ip] = e.pos();
+            if (blockStart[ip]) forgetKinds();
+            if (depths[ip] == kUnreachedDepth) {
+                e.bytes({0x0F, 0x0B});                      // ud2: never runs
+                continue;
+            }
+            depth = static_cast<size_t>(depths[ip]);
+            if (!emitInstruction(ip, code[ip])) return false;
+        }
+        emitEntries();
+        emitExits();
+        for (const auto& fix : jumpFixups) e.patch(fix.first, nativeOffset[fix.second]);
+        return true;
+    }
+
+    X64Emitter e;
+    std::vector<size_t> nativeOffset;
+    std::vector<size_t> entryOffset;    // by ip: entry stub, or kNoEntry
+    size_t deoptEntry = 0;              // entry for every other ip
+
+private:
+    const std::vector<BytecodeInstruction>& code;
+    std::vector<int64_t> depths;        // verified, relative to the routine
+    size_t depth = 0;                   // at the instruction being emitted
+    std::vector<std::pair<size_t, size_t>> jumpFixups;      // rel32 position -> target ip
+    std::map<size_t, std::vector<size_t>> deoptFixups;      // ip -> rel32 positions
+    std::vector<size_t> haltFixups;
+    std::map<size_t, std::vector<size_t>> yieldFixups;      // resume ip -> rel32 positions
+    std::map<size_t, std::vector<size_t>> errorFixups;      // failed PRINT ip -> rel32 positions
+    size_t epilogue = 0;
+
+    // Types are tracked through each basic block so that values already known
+    // to be ints (pushed constants, results of checked arithmetic, globals
+    // checked or stored earlier in the block) are not checked again. Native
+    // code is only entered at block starts (see JitCode::run), which forget
+    // everything.
+    std::vector<bool> blockStart;
+    std::vector<Known> stackKinds;                          // top of stack last
+    std::vector<Known> globalKinds;                         // by slot
+
+    // Every reached instruction needs one depth that covers what it pops
+    bool proveDepths() {
+        try {
+            depths = verifyStack(code.data(), code.size()).depths;
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+        for (size_t ip = 0; ip < code.size(); ++ip) {
+            if (depths[ip] == kUnreachedDepth) continue;
+            if (depths[ip] == kMixedDepth || depths[ip] < vmStackEffect(code[ip].opcode).pops) return false;
+        }
+        return true;
+    }
+
+    void findBlockStarts() {
+        blockStart.assign(code.size() + 1, false);
+        blockStart[0] = true;
+        size_t slots = 0;
+        for (size_t ip = 0; ip < code.size(); ++ip) {
+            const BytecodeInstruction& in = code[ip];
+            switch (in.opcode) {
+                case VMOpCode::VM_JUMP_IF_TRUE:
+                case VMOpCode::VM_JUMP_IF_FALSE:
+                    blockStart[static_cast<size_t>(in.operand1)] = true;
+                    break;
+                case VMOpCode::VM_JUMP:
+                case VMOpCode::VM_CALL:
+                    blockStart[static_cast<size_t>(in.operand1)] = true;
+                    blockStart[ip + 1] = true;
+                    break;
+                case VMOpCode::VM_RETURN:
+                case VMOpCode::VM_HALT:
+                    blockStart[ip + 1] = true;
+                    break;
+                default:
+                    break;
+            }
+            for (int i = 1; i <= 2; ++i) {
+                int32_t operand = i == 1 ? in.operand1 : in.operand2;
+                if (vmOperandKind(in.opcode, i) == VMOperandKind::Slot) {
+                    slots = std::max(slots, static_cast<size_t>(operand) + 1);
+                }
+            }
+        }
+        globalKinds.assign(slots, Known::Any);
+    }
+    void forgetKinds() {
+        stackKinds.clear();
+        std::fill(globalKinds.begin(), globalKinds.end(), Known::Any);
+    }
+    // Entries below the ones pushed in this block are unknown
+    Known stackKind(size_t fromTop) const {
+        return fromTop < stackKinds.size() ? stackKinds[stackKinds.size() - 1 - fromTop] : Known::Any;
+    }
+    Known popKind() {
+        if (stackKinds.empty()) return Known::Any;
+        Known kind = stackKinds.back();
+        stackKinds.pop_back();
+        return kind;
+    }
+    void pushKind(Known kind) { stackKinds.push_back(kind); }
+
+    // --- stack slots: kSlotRegs[slot], or [r12 + 8*slot] from 4 up ----------
+    static bool inRegister(size_t slot) { return slot < kSlotRegCount; }
+    static int32_t slotDisp(size_t slot) { return static_cast<int32_t>(slot * 8); }
+    void slotPayload(uint8_t dst, size_t slot) {
+        if (inRegister(slot)) e.mov32(dst, kSlotRegs[slot]);
+        else e.load32(dst, R12, slotDisp(slot));
+    }
+    void slotValue(uint8_t dst, size_t slot) {
+        if (inRegister(slot)) e.mov64(dst, kSlotRegs[slot]);
+        else e.load64(dst, R12, slotDisp(slot));
+    }
+    void setSlot(size_t slot, uint8_t src) {
+        if (inRegister(slot)) e.mov64(kSlotRegs[slot], src);
+        else e.store64(R12, slotDisp(slot), src);
+    }
+    // The register for `slot` if it has one, otherwise rax (store it after)
+    uint8_t slotTarget(size_t slot) const { return inRegister(slot) ? kSlotRegs[slot] : RAX; }
+    void finishSlot(size_t slot) {
+        if (!inRegister(slot)) e.store64(R12, slotDisp(slot), RAX);
+    }
+    // Writes the first `count` slots' registers to the stack buffer
+    void spill(size_t count) {
+        for (size_t slot = 0; slot < std::min(count, kSlotRegCount); ++slot) {
+            e.store64(R12, slotDisp(slot), kSlotRegs[slot]);
+        }
+    }
+    // JitState::stackTop = r12 + 8*count
+    void storeStackTop(size_t count) {
+        e.lea(RAX, R12, slotDisp(count));
+        e.store64(R15, 16, RAX);
+    }
+
+    void jumpTo(std::initializer_list<uint8_t> opcode, size_t targetIp) {
+        jumpFixups.emplace_back(e.rel32(opcode), targetIp);
+    }
+    void deoptIf(std::initializer_list<uint8_t> jcc, size_t ip) {
+        deoptFixups[ip].push_back(e.rel32(jcc));
+    }
+    // Back-edge or call into targetIp: charges the run() budget and leaves
+    // native code, to resume at targetIp, once it is used up
+    void chargeBudget(size_t targetIp, int32_t cost) {
+        e.bytes({0x49, 0x81, 0x6F, 0x50});                  // sub qword [r15+80], cost
+        e.imm32(cost);
+        yieldFixups[targetIp].push_back(e.rel32({0x0F, 0x8C}));  // jl yield
+    }
+    void haltAt(size_t ip, size_t count) {
+        spill(count);
+        storeStackTop(count);
+        e.bytes({0x49, 0xC7, 0x47, 0x40});                  // mov qword [r15+64], ip
+        e.imm32(static_cast<int32_t>(ip));
+        haltFixups.push_back(e.rel32({0xE9}));
+    }
+
+    void emitPrologue() {
+        e.bytes({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});  // push rbx..r15
+        e.bytes({0x49, 0x89, 0xFF});                        // mov r15, rdi
+        e.bytes({0x49, 0x8B, 0x1F});                        // mov rbx, [r15]
+        e.bytes({0x4D, 0x8B, 0x67, 0x10});                  // mov r12, [r15+16] (stack top)
+        e.bytes({0x4D, 0x8B, 0x77, 0x28});                  // mov r14, [r15+40]
+        e.bytes({0x49, 0x8B, 0x6F, 0x38});                  // mov rbp, [r15+56]
+        e.loadTags();
+        e.bytes({0xFF, 0xE6});                              // jmp rsi (an entry stub)
+    }
+
+    // Entry stubs run with r12 at the stack top: from JitCode::run and from
+    // RETURN, which also has the ip in rax. Each rebases r12 on the routine
+    // and fills the slot registers; ips without one (mid-block, unreached)
+    // get the shared stub that hands the ip straight back to the interpreter.
+    void emitEntries() {
+        entryOffset.assign(code.size(), kNoEntry);
+        for (size_t ip = 0; ip < code.size(); ++ip) {
+            if (!blockStart[ip] || depths[ip] == kUnreachedDepth) continue;
+            const size_t count = static_cast<size_t>(depths[ip]);
+            entryOffset[ip] = e.pos();
+            if (count != 0) e.lea(R12, R12, -slotDisp(count));
+            for (size_t slot = 0; slot < std::min(count, kSlotRegCount); ++slot) {
+                e.load64(kSlotRegs[slot], R12, slotDisp(slot));
+            }
+            jumpTo({0xE9}, ip);
+        }
+        deoptEntry = e.pos();
+        e.store64(R15, 64, RAX);                            // mov [r15+64], rax (ip)
+        e.store64(R15, 16, R12);                            // mov [r15+16], r12 (stack top)
+        e.bytes({0xB8});                                    // mov eax, 1 (deopt)
+        e.imm32(1);
+        toEpilogue.push_back(e.rel32({0xE9}));
+    }
+
+    // Deopt, yield and error stubs spill the slot registers live at their
+    // ip, record the stack top and the ip, then share the exit that writes
+    // the frame top back and returns 1 (deopt), 2 (yield) or 3 (error);
+    // halting returns 0.
+    void emitExits() {
+        emitStubs(deoptFixups, 1);
+        emitStubs(yieldFixups, 2);
+        emitStubs(errorFixups, 3);
+
+        size_t halt = e.pos();
+        for (size_t at : haltFixups) e.patch(at, halt);
+        e.bytes({0x31, 0xC0});                              // xor eax, eax
+
+        for (size_t at : toEpilogue) e.patch(at, e.pos());
+        e.bytes({0x4D, 0x89, 0x77, 0x28});                  // mov [r15+40], r14
+        e.bytes({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B});  // pop r15..rbx
+        e.bytes({0xC3});                                    // ret
+    }
+    std::vector<size_t> toEpilogue;
+
+    // One stub per ip, then `mov eax, result` and a jump to the epilogue
+    void emitStubs(const std::map<size_t, std::vector<size_t>>& fixups, int32_t result) {
+        if (fixups.empty()) return;
+        std::vector<size_t> toCommon;
+        for (const auto& entry : fixups) {
+            for (size_t at : entry.second) e.patch(at, e.pos());
+            const size_t count = static_cast<size_t>(depths[entry.first]);
+            spill(count);
+            storeStackTop(count);
+            e.bytes({0x49, 0xC7, 0x47, 0x40});              // mov qword [r15+64], ip
+            e.imm32(static_cast<int32_t>(entry.first));
+            toCommon.push_back(e.rel32({0xE9}));
+        }
+        for (size_t at : toCommon) e.patch(at, e.pos());
+        e.bytes({0xB8});                                    // mov eax, result
+        e.imm32(result);
+        toEpilogue.push_back(e.rel32({0xE9}));
+    }
+
+    // Deopts unless stack slot `slot`, `fromTop` places below the top, holds
+    // an int. Entries known to be bools pass too: their 0/1 payload is what
+    // the interpreter would use.
+    void requireIntSlot(size_t ip, size_t slot, size_t fromTop) {
+        if (stackKind(fromTop) != Known::Any) return;
+        if (inRegister(slot)) {
+            e.mov64(RDX, kSlotRegs[slot]);
+            e.shr64(RDX, 32);
+            e.rr({0x39}, false, R10, RDX);                  // cmp edx, r10d
+        } else {
+            e.mem({0x39}, false, R10, R12, slotDisp(slot) + 4);  // cmp [slot + 4], r10d
+        }
+        deoptIf({0x0F, 0x85}, ip);                          // jne deopt
+    }
+    void requireIntGlobal(size_t ip, int32_t slot) {
+        Known& kind = globalKinds[static_cast<size_t>(slot)];
+        if (kind != Known::Any) return;
+        e.cmpGlobalIntTag(slot);
+        deoptIf({0x0F, 0x85}, ip);                          // jne deopt
+        kind = Known::Int;
+    }
+
+    // Checks the top two slots hold ints and loads the right one into ecx
+    // and the left one into eax. The caller boxes the result in rax and
+    // stores it over the left operand (storeResult).
+    void binaryOperands(size_t ip) {
+        requireIntSlot(ip, depth - 1, 0);
+        requireIntSlot(ip, depth - 2, 1);
+        slotPayload(ECX, depth - 1);
+        slotPayload(EAX, depth - 2);
+        popKind();
+        popKind();
+    }
+    void storeResult(bool isBool) {
+        if (isBool) e.boxBool();
+        else e.boxInt();
+        setSlot(depth - 2, RAX);
+        pushKind(isBool ? Known::Bool : Known::Int);
+    }
+    // Boxed result in rax as a new top
+    void pushBoxed(bool isBool) {
+        if (isBool) e.boxBool();
+        else e.boxInt();
+        setSlot(depth, RAX);
+        pushKind(isBool ? Known::Bool : Known::Int);
+    }
+
+    // PRINT: jitPrintLine(state, top). The slot registers are caller-saved
+    // (r13 aside), so the live ones are pushed around the call, with one
+    // more qword when needed to keep rsp 16-byte aligned at the call.
+    void emitPrint(size_t ip) {
+        const size_t live = std::min(depth, kSlotRegCount);
+        for (size_t slot = 0; slot < live; ++slot) e.push(kSlotRegs[slot]);
+        const bool pad = live % 2 == 0;                     // entry left rsp 8 off alignment
+        if (pad) e.bytes({0x48, 0x83, 0xEC, 0x08});         // sub rsp, 8
+        slotValue(RSI, depth - 1);
+        e.mov64(RDI, R15);
+        e.movImm64(RAX, reinterpret_cast<uint64_t>(&jitPrintLine));
+        e.bytes({0xFF, 0xD0});                              // call rax
+        if (pad) e.bytes({0x48, 0x83, 0xC4, 0x08});         // add rsp, 8
+        for (size_t slot = live; slot-- > 0;) e.pop(kSlotRegs[slot]);
+        e.loadTags();
+        e.bytes({0x85, 0xC0});                              // test eax, eax
+        errorFixups[ip].push_back(e.rel32({0x0F, 0x85}));   // jnz error
+        popKind();
+    }
+
+    bool emitInstruction(size_t ip, const BytecodeInstruction& in) {
+        uint8_t cc = 0;
+        switch (in.opcode) {
+            case VMOpCode::VM_PUSH:
+                e.movImm64(slotTarget(depth), Value::integer(in.operand1).raw());
+                finishSlot(depth);
+                pushKind(Known::Int);
+                return true;
+            case VMOpCode::VM_PUSH_CONST:
+                e.load64(RAX, R15, 72);                     // constant pool
+                e.load64(slotTarget(depth), RAX, in.operand1 * 8);
+                finishSlot(depth);
+                pushKind(Known::Any);
+                return true;
+            case VMOpCode::VM_POP:
+                popKind();
+                return true;
+            case VMOpCode::VM_LOAD:
+                e.loadGlobalValue(slotTarget(depth), in.operand1);
+                finishSlot(depth);
+                pushKind(globalKinds[static_cast<size_t>(in.operand1)]);
+                return true;
+            case VMOpCode::VM_STORE:
+                if (inRegister(depth - 1)) {
+                    e.storeGlobalValue(in.operand1, kSlotRegs[depth - 1]);
+                } else {
+                    slotValue(RAX, depth - 1);
+                    e.storeGlobalValue(in.operand1, RAX);
+                }
+                globalKinds[static_cast<size_t>(in.operand1)] = popKind();
+                return true;
+            case VMOpCode::VM_ADD:
+                binaryOperands(ip);
+                e.bytes({0x01, 0xC8});                      // add eax, ecx
+                storeResult(false);
+                return true;
+            case VMOpCode::VM_SUB:
+                binaryOperands(ip);
+                e.bytes({0x29, 0xC8});                      // sub eax, ecx
+                storeResult(false);
+                return true;
+            case VMOpCode::VM_MUL:
+                binaryOperands(ip);
+                e.bytes({0x0F, 0xAF, 0xC1});                // imul eax, ecx
+                storeResult(false);
+                return true;
+            case VMOpCode::VM_DIV:
+                // Division by zero, and by -1 (INT_MIN / -1 traps in idiv),
+                // are left to the interpreter
+                slotPayload(ECX, depth - 1);
+                e.bytes({0x85, 0xC9});                      // test ecx, ecx
+                deoptIf({0x0F, 0x84}, ip);                  // jz deopt
+                e.bytes({0x83, 0xF9, 0xFF});                // cmp ecx, -1
+                deoptIf({0x0F, 0x84}, ip);                  // je deopt
+                binaryOperands(ip);
+                e.bytes({0x99, 0xF7, 0xF9});                // cdq; idiv ecx
+                storeResult(false);
+                return true;
+            case VMOpCode::VM_NEG:
+                requireIntSlot(ip, depth - 1, 0);
+                slotPayload(EAX, depth - 1);
+                e.bytes({0xF7, 0xD8});                      // neg eax
+                e.boxInt();
+                setSlot(depth - 1, RAX);
+                popKind();
+                pushKind(Known::Int);
+                return true;
+            case VMOpCode::VM_CMP_EQ:
+            case VMOpCode::VM_CMP_NE:
+            case VMOpCode::VM_CMP_LT:
+            case VMOpCode::VM_CMP_LE:
+            case VMOpCode::VM_CMP_GT:
+            case VMOpCode::VM_CMP_GE:
+                compareCode(in.opcode, cc);
+                binaryOperands(ip);
+                e.bytes({0x39, 0xC8});                      // cmp eax, ecx
+                e.setcc(cc);
+                storeResult(true);
+                return true;
+            case VMOpCode::VM_JUMP: {
+                size_t target = static_cast<size_t>(in.operand1);
+                if (target <= ip) chargeBudget(target, static_cast<int32_t>(ip - target + 1));
+                jumpTo({0xE9}, target);
+                return true;
+            }
+            case VMOpCode::VM_JUMP_IF_TRUE:
+            case VMOpCode::VM_JUMP_IF_FALSE: {
+                // Ints and bools test their payload; other types deopt
+                if (stackKind(0) == Known::Any) {
+                    if (inRegister(depth - 1)) {
+                        e.mov64(RAX, kSlotRegs[depth - 1]);
+                        e.shr64(RAX, 49);
+                    } else {
+                        e.load32(EAX, R12, slotDisp(depth - 1) + 4);  // high dword
+                        e.bytes({0xC1, 0xE8, 0x11});        // shr eax, 17
+                    }
+                    e.bytes({0x3D});                        // cmp eax, int/bool tag >> 49
+                    e.imm32(static_cast<int32_t>(Value::kIntTag >> 49));
+                    deoptIf({0x0F, 0x85}, ip);              // jne deopt
+                }
+                slotPayload(EAX, depth - 1);
+                e.bytes({0x85, 0xC0});                      // test eax, eax
+                const uint8_t taken = in.opcode == VMOpCode::VM_JUMP_IF_TRUE ? 0x85 : 0x84;  // jnz / jz
+                size_t target = static_cast<size_t>(in.operand1);
+                if (target <= ip) {
+                    size_t notTaken = e.rel32({0x0F, static_cast<uint8_t>(taken ^ 1)});
+                    chargeBudget(target, static_cast<int32_t>(ip - target + 1));
+                    jumpTo({0xE9}, target);
+                    e.patch(notTaken, e.pos());
+                } else {
+                    jumpTo({0x0F, taken}, target);
+                }
+                popKind();
+                return true;
+            }
+            case VMOpCode::VM_CALL:
+                // Frames hold interpreter return offsets, exactly as in the VM
+                e.bytes({0x4D, 0x3B, 0x77, 0x30});          // cmp r14, [r15+48]
+                deoptIf({0x0F, 0x83}, ip);                  // jae deopt
+                // Leave native code when the callee needs more stack than is
+                // left in the buffer (only possible through recursion)
+                e.lea(RAX, R12, slotDisp(depth) + in.operand2 * 8);
+                e.mem({0x3B}, true, RAX, R15, 24);          // cmp rax, [r15+24]
+                deoptIf({0x0F, 0x87}, ip);                  // ja deopt
+                // The callee's slots start at the caller's top
+                spill(depth);
+                e.bytes({0x49, 0xC7, 0x06});                // mov qword [r14], ip + 1
+                e.imm32(static_cast<int32_t>(ip + 1));
+                e.bytes({0x49, 0x83, 0xC6, 0x08});          // add r14, 8
+                if (depth != 0) e.lea(R12, R12, slotDisp(depth));
+                chargeBudget(static_cast<size_t>(in.operand1), 1);
+                jumpTo({0xE9}, static_cast<size_t>(in.operand1));
+                return true;
+            case VMOpCode::VM_RETURN: {
+                e.bytes({0x4D, 0x3B, 0x77, 0x20});          // cmp r14, [r15+32]
+                size_t notTopLevel = e.rel32({0x0F, 0x85}); // jne
+                haltAt(ip, depth);
+                e.patch(notTopLevel, e.pos());
+                // The return site's entry stub reloads the caller's slots
+                spill(depth);
+                if (depth != 0) e.lea(R12, R12, slotDisp(depth));
+                e.bytes({0x49, 0x83, 0xEE, 0x08});          // sub r14, 8
+                e.bytes({0x49, 0x8B, 0x06});                // mov rax, [r14]
+                e.bytes({0xFF, 0x64, 0xC5, 0x00});          // jmp [rbp + rax*8]
+                return true;
+            }
+            case VMOpCode::VM_LABEL:
+                return true;
+            case VMOpCode::VM_HALT:
+                haltAt(ip, depth);
+                return true;
+            case VMOpCode::VM_PRINT:
+                emitPrint(ip);
+                return true;
+
+            // Superinstructions: intermediate values never touch the stack
+            case VMOpCode::VM_INC_VAR:
+                requireIntGlobal(ip, in.operand1);
+                e.loadGlobal(EAX, in.operand1);
+                e.bytes({0x05});                            // add eax, imm32
+                e.imm32(in.operand2);
+                e.boxInt();
+                e.storeGlobalValue(in.operand1, RAX);
+                return true;
+            case VMOpCode::VM_LOAD_LOAD_ADD:
+            case VMOpCode::VM_LOAD_LOAD_SUB:
+            case VMOpCode::VM_LOAD_LOAD_MUL:
+            case VMOpCode::VM_LOAD_LOAD_CMP_LT:
+                requireIntGlobal(ip, in.operand1);
+                requireIntGlobal(ip, in.operand2);
+                e.loadGlobal(EAX, in.operand1);
+                e.loadGlobal(ECX, in.operand2);
+                if (in.opcode == VMOpCode::VM_LOAD_LOAD_ADD) e.bytes({0x01, 0xC8});
+                else if (in.opcode == VMOpCode::VM_LOAD_LOAD_SUB) e.bytes({0x29, 0xC8});
+                else if (in.opcode == VMOpCode::VM_LOAD_LOAD_MUL) e.bytes({0x0F, 0xAF, 0xC1});
+                else { e.bytes({0x39, 0xC8}); e.setcc(CC_L); }
+                pushBoxed(in.opcode == VMOpCode::VM_LOAD_LOAD_CMP_LT);
+                return true;
+            case VMOpCode::VM_LOAD_PUSH_ADD:
+            case VMOpCode::VM_LOAD_PUSH_SUB:
+            case VMOpCode::VM_LOAD_PUSH_MUL:
+            case VMOpCode::VM_LOAD_PUSH_CMP_LT:
+                requireIntGlobal(ip, in.operand1);
+                e.loadGlobal(EAX, in.operand1);
+                if (in.opcode == VMOpCode::VM_LOAD_PUSH_ADD) e.bytes({0x05});             // add eax, imm32
+                else if (in.opcode == VMOpCode::VM_LOAD_PUSH_SUB) e.bytes({0x2D});        // sub eax, imm32
+                else if (in.opcode == VMOpCode::VM_LOAD_PUSH_MUL) e.bytes({0x69, 0xC0});  // imul eax, eax, imm32
+                else e.bytes({0x3D});                                                      // cmp eax, imm32
+                e.imm32(in.operand2);
+                if (in.opcode == VMOpCode::VM_LOAD_PUSH_CMP_LT) e.setcc(CC_L);
+                pushBoxed(in.opcode == VMOpCode::VM_LOAD_PUSH_CMP_LT);
+                return true;
+            case VMOpCode::VM_PUSH_STORE:
+                e.movImm64(RAX, Value::integer(in.operand1).raw());
+                e.storeGlobalValue(in.operand2, RAX);
+                globalKinds[static_cast<size_t>(in.operand2)] = Known::Int;
+                return true;
+            case VMOpCode::VM_STORE_LOAD:
+                slotValue(RAX, depth - 1);
+                e.storeGlobalValue(in.operand1, RAX);
+                e.loadGlobalValue(slotTarget(depth - 1), in.operand2);
+                finishSlot(depth - 1);
+                globalKinds[static_cast<size_t>(in.operand1)] = popKind();
+                pushKind(globalKinds[static_cast<size_t>(in.operand2)]);
+                return true;
+            case VMOpCode::VM_ADD_STORE:
+                requireIntSlot(ip, depth - 1, 0);
+                requireIntSlot(ip, depth - 2, 1);
+                slotPayload(ECX, depth - 1);
+                slotPayload(EAX, depth - 2);
+                e.bytes({0x01, 0xC8});                      // add eax, ecx
+                e.boxInt();
+                e.storeGlobalValue(in.operand1, RAX);
+                popKind();
+                popKind();
+                globalKinds[static_cast<size_t>(in.operand1)] = Known::Int;
+                return true;
+            default:
+                return false;                               // not covered: interpret
+        }
+    }
+};
+
+} // namespace
+#endif
+
+std::unique_ptr<JitCode> JitCompiler::compile(const std::vector<BytecodeInstruction>& code) {
+#if MYCOMPILER_JIT_X64
+    if (code.empty()) return nullptr;
+    TemplateCompiler compiler(code);
+    if (!compiler.compile()) return nullptr;
+
+    const std::vector<uint8_t>& bytes = compiler.e.buf;
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t mapped = (bytes.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return nullptr;
+    std::memcpy(memory, bytes.data(), bytes.size());
+    // W^X: the buffer is never writable and executable at the same time
+    if (mprotect(memory, mapped, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, mapped);
+        return nullptr;
+    }
+
+    std::unique_ptr<JitCode> jit(new JitCode());
+    jit->memory = memory;
+    jit->mapped = mapped;
+    jit->size = bytes.size();
+    const uint8_t* base = static_cast<const uint8_t*>(memory);
+    jit->ipToNative.reserve(code.size());
+    jit->enterable.reserve(code.size());
+    for (size_t offset : compiler.entryOffset) {
+        jit->enterable.push_back(offset != kNoEntry);
+        jit->ipToNative.push_back(base + (offset != kNoEntry ? offset : compiler.deoptEntry));
+    }
+    return jit;
+#else
+    (void)code;
+    return nullptr;
+#endif
+}
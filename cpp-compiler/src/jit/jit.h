@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "assembler.h"
+#include "value.h"
+#include "vm_output.h"
+
+// Baseline x86-64 template JIT for the stack VM.
+//
+// Every bytecode instruction becomes a fixed machine-code template. The
+// compiled code works directly on the VirtualMachine's own buffers (globals,
+// operand stack, call frames), so control can move between the interpreter
+// and native code at block boundaries without copying state:
+//   - entry: JitCode::run(state, ip) starts native execution at ip, which
+//            must start a basic block (ip 0, a jump or call target or a
+//            return address); elsewhere it returns Deopt at once
+//   - exit:  native code stores the stack/frame tops and the ip to resume at
+//            (a "deopt") whenever it meets something it does not handle
+//            inline, e.g. a call that needs a bigger stack buffer or a
+//            division by zero. Other pushes and pops rely on the program's
+//            stack verification and are never checked.
+//   - yield: back-edges and calls charge JitState::budget exactly as the
+//            interpreter does and exit at their target once it runs out.
+// The verifier proves one stack depth per instruction, relative to the
+// running routine's entry, so each of the routine's first few stack slots
+// has a fixed register; those values only reach the stack buffer at exits,
+// calls and returns. Code without such depths (a routine that pops its
+// caller's values, or one instruction shared at two depths) is not compiled.
+// Templates only handle int (and bool) Values; an instruction that finds
+// any other type among its operands deopts before changing anything, and the
+// interpreter runs it with the generic Value semantics. PRINT calls into
+// the VM's OutputBuffer for any type.
+// Only x86-64 System V targets (Linux/BSD) are supported; elsewhere
+// JitCompiler::compile returns nullptr and the VM keeps interpreting.
+
+// Shared with generated code; field offsets are part of the ABI (see jit.cpp)
+struct JitState {
+    Value* globals;
+    Value* stackBase;
+    Value* stackTop;            // in/out: one past the top element
+    Value* stackLimit;          // only consulted by CALL
+    size_t* frameBase;
+    size_t* frameTop;           // in/out: one past the innermost frame
+    size_t* frameLimit;
+    const void* const* ipToNative;  // filled in by JitCode::run
+    size_t exitIp;              // out: instruction to resume at / that halted
+    const Value* constants;     // constant pool (PUSH_CONST)
+    int64_t budget;             // in/out: VirtualMachine::run countdown
+    OutputBuffer* output;       // PRINT
+    std::string* error;         // out: why PRINT failed (JitExit::Error)
+};
+
+enum class JitExit {
+    Halted,     // program finished (HALT or top-level RETURN)
+    Deopt,      // resume interpreting at JitState::exitIp
+    Yielded,    // budget ran out at a back-edge or call into exitIp
+    Error       // PRINT at exitIp could not write; see JitState::error
+};
+
+class JitCode {
+public:
+    ~JitCode();
+    JitCode(const JitCode&) = delete;
+    JitCode& operator=(const JitCode&) = delete;
+
+    JitExit run(JitState& state, size_t entryIp) const;
+
+    size_t codeSize() const { return size; }
+
+private:
+    friend class JitCompiler;
+    JitCode() = default;
+
+    void* memory = nullptr;     // mmap'd, read+execute once finalized
+    size_t mapped = 0;
+    size_t size = 0;
+    std::vector<const void*> ipToNative;
+    std::vector<bool> enterable;    // by ip: has an entry stub
+};
+
+class JitCompiler {
+public:
+    // True when this build can generate and run native code
+    static bool isSupported();
+
+    // Compiles the whole program, or returns nullptr when the platform, any
+    // opcode in it or its stack depths are not supported (callers fall back
+    // to interpreting)
+    static std::unique_ptr<JitCode> compile(const std::vector<BytecodeInstruction>& code);
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstdint>
+
+// Eight int32 lanes and the handful of operations the LaneVM needs, built
+// on AVX2 or SSE2 (SSE4.1 when available) intrinsics, or plain loops when
+// neither is enabled for the target. The backend is picked at compile time
+// from the compiler's target macros (e.g. configure with
+// -DCMAKE_CXX_FLAGS=-mavx2 or -march=native to get AVX2).
+//
+// Lane masks are bitmasks: bit i selects lane i.
+
+#if defined(__AVX2__)
+#define MYCOMPILER_LANES_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define MYCOMPILER_LANES_SSE2 1
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#endif
+
+namespace lanes {
+
+const int kWidth = 8;
+const uint32_t kAllLanes = (1u << kWidth) - 1;
+
+// Loads and stores are unaligned: Vecs live in std::vectors, which do not
+// guarantee 32-byte alignment before C++17
+struct alignas(32) Vec {
+    int32_t v[kWidth];
+};
+
+inline const char* backendName() {
+#if defined(MYCOMPILER_LANES_AVX2)
+    return "avx2";
+#elif defined(MYCOMPILER_LANES_SSE2) && defined(__SSE4_1__)
+    return "sse4.1";
+#elif defined(MYCOMPILER_LANES_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+#if defined(MYCOMPILER_LANES_AVX2)
+
+inline __m256i load(const Vec& a) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.v)); }
+inline void store(Vec& out, __m256i x) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.v), x); }
+inline __m256i one() { return _mm256_set1_epi32(1); }
+
+inline void splat(Vec& out, int32_t x) { store(out, _mm256_set1_epi32(x)); }
+inline void add(Vec& out, const Vec& a, const Vec& b) { store(out, _mm256_add_epi32(load(a), load(b))); }
+inline void sub(Vec& out, const Vec& a, const Vec& b) { store(out, _mm256_sub_epi32(load(a), load(b))); }
+inline void mul(Vec& out, const Vec& a, const Vec& b) { store(out, _mm256_mullo_epi32(load(a), load(b))); }
+inline void neg(Vec& out, const Vec& a) { store(out, _mm256_sub_epi32(_mm256_setzero_si256(), load(a))); }
+inline void addScalar(Vec& out, const Vec& a, int32_t b) { store(out, _mm256_add_epi32(load(a), _mm256_set1_epi32(b))); }
+
+inline void cmpEq(Vec& out, const Vec& a, const Vec& b) {
+    store(out, _mm256_and_si256(_mm256_cmpeq_epi32(load(a), load(b)), one()));
+}
+inline void cmpGt(Vec& out, const Vec& a, const Vec& b) {
+    store(out, _mm256_and_si256(_mm256_cmpgt_epi32(load(a), load(b)), one()));
+}
+// 1 - x for 0/1 lanes
+inline void flip(Vec& out, const Vec& a) { store(out, _mm256_xor_si256(load(a), one())); }
+
+inline uint32_t nonZero(const Vec& a) {
+    __m256i zero = _mm256_cmpeq_epi32(load(a), _mm256_setzero_si256());
+    return ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(zero))) & kAllLanes;
+}
+
+// dst = mask ? src : dst, per lane
+inline void blend(Vec& dst, const Vec& src, uint32_t mask) {
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i select = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int32_t>(mask)), bits), bits);
+    store(dst, _mm256_blendv_epi8(load(dst), load(src), select));
+}
+
+#elif defined(MYCOMPILER_LANES_SSE2)
+
+// Two 4-lane halves
+inline __m128i load(const Vec& a, int half) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(a.v + 4 * half)); }
+inline void store(Vec& out, int half, __m128i x) { _mm_storeu_si128(reinterpret_cast<__m128i*>(out.v + 4 * half), x); }
+
+inline __m128i mullo(__m128i a, __m128i b) {
+#if defined(__SSE4_1__)
+    return _mm_mullo_epi32(a, b);
+#else
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+
+#define LANES_SSE_BINARY(name, expr)                                        \
+    inline void name(Vec& out, const Vec& a, const Vec& b) {                \
+        for (int h = 0; h < 2; ++h) {                                       \
+            __m128i x = load(a, h), y = load(b, h);                         \
+            store(out, h, expr);                                            \
+        }                                                                   \
+    }
+LANES_SSE_BINARY(add, _mm_add_epi32(x, y))
+LANES_SSE_BINARY(sub, _mm_sub_epi32(x, y))
+LANES_SSE_BINARY(mul, mullo(x, y))
+LANES_SSE_BINARY(cmpEq, _mm_and_si128(_mm_cmpeq_epi32(x, y), _mm_set1_epi32(1)))
+LANES_SSE_BINARY(cmpGt, _mm_and_si128(_mm_cmpgt_epi32(x, y), _mm_set1_epi32(1)))
+#undef LANES_SSE_BINARY
+
+inline void splat(Vec& out, int32_t x) {
+    store(out, 0, _mm_set1_epi32(x));
+    store(out, 1, _mm_set1_epi32(x));
+}
+inline void neg(Vec& out, const Vec& a) {
+    for (int h = 0; h < 2; ++h) store(out, h, _mm_sub_epi32(_mm_setzero_si128(), load(a, h)));
+}
+inline void addScalar(Vec& out, const Vec& a, int32_t b) {
+    for (int h = 0; h < 2; ++h) store(out, h, _mm_add_epi32(load(a, h), _mm_set1_epi32(b)));
+}
+inline void flip(Vec& out, const Vec& a) {
+    for (int h = 0; h < 2; ++h) store(out, h, _mm_xor_si128(load(a, h), _mm_set1_epi32(1)));
+}
+
+inline uint32_t nonZero(const Vec& a) {
+    uint32_t zero = 0;
+    for (int h = 0; h < 2; ++h) {
+        __m128i z = _mm_cmpeq_epi32(load(a, h), _mm_setzero_si128());
+        zero |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(z))) << (4 * h);
+    }
+    return ~zero & kAllLanes;
+}
+
+inline void blend(Vec& dst, const Vec& src, uint32_t mask) {
+    const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+    for (int h = 0; h < 2; ++h) {
+        __m128i m = _mm_set1_epi32(static_cast<int32_t>(mask >> (4 * h)));
+        __m128i select = _mm_cmpeq_epi32(_mm_and_si128(m, bits), bits);
+        __m128i d = load(dst, h), s = load(src, h);
+        store(dst, h, _mm_or_si128(_mm_and_si128(select, s), _mm_andnot_si128(select, d)));
+    }
+}
+
+#else
+
+#define LANES_SCALAR_BINARY(name, expr)                                     \
+    inline void name(Vec& out, const Vec& a, const Vec& b) {                \
+        for (int i = 0; i < kWidth; ++i) {                                  \
+            int32_t x = a.v[i], y = b.v[i];                                 \
+            out.v[i] = (expr);                                              \
+        }                                                                   \
+    }
+LANES_SCALAR_BINARY(add, static_cast<int32_t>(uint32_t(x) + uint32_t(y)))
+LANES_SCALAR_BINARY(sub, static_cast<int32_t>(uint32_t(x) - uint32_t(y)))
+LANES_SCALAR_BINARY(mul, static_cast<int32_t>(uint32_t(x) * uint32_t(y)))
+LANES_SCALAR_BINARY(cmpEq, x == y ? 1 : 0)
+LANES_SCALAR_BINARY(cmpGt, x > y ? 1 : 0)
+#undef LANES_SCALAR_BINARY
+
+inline void splat(Vec& out, int32_t x) {
+    for (int i = 0; i < kWidth; ++i) out.v[i] = x;
+}
+inline void neg(Vec& out, const Vec& a) {
+    for (int i = 0; i < kWidth; ++i) out.v[i] = static_cast<int32_t>(0u - uint32_t(a.v[i]));
+}
+inline void addScalar(Vec& out, const Vec& a, int32_t b) {
+    for (int i = 0; i < kWidth; ++i) out.v[i] = static_cast<int32_t>(uint32_t(a.v[i]) + uint32_t(b));
+}
+inline void flip(Vec& out, const Vec& a) {
+    for (int i = 0; i < kWidth; ++i) out.v[i] = a.v[i] ^ 1;
+}
+inline uint32_t nonZero(const Vec& a) {
+    uint32_t mask = 0;
+    for (int i = 0; i < kWidth; ++i) mask |= uint32_t(a.v[i] != 0) << i;
+    return mask;
+}
+inline void blend(Vec& dst, const Vec& src, uint32_t mask) {
+    for (int i = 0; i < kWidth; ++i) {
+        if (mask & (1u << i)) dst.v[i] = src.v[i];
+    }
+}
+
+#endif
+
+// Derived comparisons; all produce 0/1 lanes like the scalar VM
+inline void cmpNe(Vec& out, const Vec& a, const Vec& b) { cmpEq(out, a, b); flip(out, out); }
+inline void cmpLt(Vec& out, const Vec& a, const Vec& b) { cmpGt(out, b, a); }
+inline void cmpLe(Vec& out, const Vec& a, const Vec& b) { cmpGt(out, a, b); flip(out, out); }
+inline void cmpGe(Vec& out, const Vec& a, const Vec& b) { cmpGt(out, b, a); flip(out, out); }
+
+} // namespace lanes
@@ -0,0 +1,323 @@
+#include "lanevm.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include "value.h"
+
+namespace {
+
+std::string at(size_t pc) {
+    return " at @" + std::to_string(pc);
+}
+
+} // namespace
+
+void LaneVM::analyze(const BytecodeProgram& program) {
+    const std::vector<BytecodeInstruction>& code = program.code;
+    const size_t n = code.size();
+    if (n == 0) throw std::runtime_error("LaneVM: empty program");
+
+    depth.assign(n, -1);
+    maxDepth = 0;
+    std::vector<size_t> worklist;
+    depth[0] = 0;
+    worklist.push_back(0);
+
+    auto reach = [&](size_t pc, int32_t target, int d) {
+        if (target < 0 || static_cast<size_t>(target) >= n) {
+            throw std::runtime_error("LaneVM: control leaves the program" + at(pc));
+        }
+        if (depth[target] < 0) {
+            depth[target] = d;
+            worklist.push_back(static_cast<size_t>(target));
+        } else if (depth[target] != d) {
+            throw std::runtime_error("LaneVM: inconsistent stack depth" + at(static_cast<size_t>(target)));
+        }
+    };
+
+    while (!worklist.empty()) {
+        size_t pc = worklist.back();
+        worklist.pop_back();
+        const BytecodeInstruction& instr = code[pc];
+        const int d = depth[pc];
+
+        for (int operand = 1; operand <= 2; ++operand) {
+            if (vmOperandKind(instr.opcode, operand) != VMOperandKind::Slot) continue;
+            int32_t slot = operand == 1 ? instr.operand1 : instr.operand2;
+            if (slot < 0 || static_cast<size_t>(slot) >= program.slotNames.size()) {
+                throw std::runtime_error("LaneVM: bad variable slot" + at(pc));
+            }
+        }
+
+        VMStackEffect effect = vmStackEffect(instr.opcode);
+        if (d < effect.pops) throw std::runtime_error("LaneVM: stack underflow" + at(pc));
+        const int next = d - effect.pops + effect.pushes;
+        maxDepth = std::max(maxDepth, static_cast<size_t>(std::max(d, next)));
+
+        switch (instr.opcode) {
+            case VMOpCode::VM_CALL:
+                throw std::runtime_error("LaneVM: CALL is not supported" + at(pc));
+            case VMOpCode::VM_PRINT:
+                throw std::runtime_error("LaneVM: PRINT is not supported" + at(pc));
+            case VMOpCode::VM_PUSH_CONST:
+                throw std::runtime_error("LaneVM: only int constants are supported" + at(pc));
+            case VMOpCode::VM_HALT:
+            case VMOpCode::VM_RETURN:
+                break;
+            case VMOpCode::VM_JUMP:
+                reach(pc, instr.operand1, next);
+                break;
+            case VMOpCode::VM_JUMP_IF_TRUE:
+            case VMOpCode::VM_JUMP_IF_FALSE:
+                reach(pc, instr.operand1, next);
+                reach(pc, static_cast<int32_t>(pc + 1), next);
+                break;
+            default:
+                reach(pc, static_cast<int32_t>(pc + 1), next);
+                break;
+        }
+    }
+}
+
+void LaneVM::execute(const BytecodeProgram& program, const ColumnSet& inputs, size_t rows) {
+    analyze(program);
+
+    const size_t slotCount = program.slotNames.size();
+    slotByName.clear();
+    for (size_t slot = 0; slot < slotCount; ++slot) {
+        if (!program.slotNames[slot].empty()) slotByName.emplace(program.slotNames[slot], slot);
+    }
+
+    // Input column per slot (nullptr: starts at 0)
+    std::vector<const std::vector<int32_t>*> source(slotCount, nullptr);
+    for (const auto& column : inputs) {
+        auto it = slotByName.find(column.first);
+        if (it == slotByName.end()) {
+            throw std::runtime_error("LaneVM: no variable named '" + column.first + "'");
+        }
+        if (column.second.size() != rows) {
+            throw std::runtime_error("LaneVM: column '" + column.first + "' has " +
+                                     std::to_string(column.second.size()) + " values, expected " +
+                                     std::to_string(rows));
+        }
+        source[it->second] = &column.second;
+    }
+
+    columns.assign(slotCount, std::vector<int32_t>(rows, 0));
+    stack.assign(std::max<size_t>(maxDepth, 1), lanes::Vec());
+    globals.assign(slotCount, lanes::Vec());
+
+    for (size_t row = 0; row < rows; row += lanes::kWidth) {
+        const size_t count = std::min<size_t>(lanes::kWidth, rows - row);
+        for (size_t slot = 0; slot < slotCount; ++slot) {
+            lanes::Vec& g = globals[slot];
+            lanes::splat(g, 0);
+            if (source[slot]) std::copy_n(source[slot]->data() + row, count, g.v);
+        }
+        const uint32_t live = count == lanes::kWidth ? lanes::kAllLanes : (1u << count) - 1;
+        runBlock(program.code.data(), live, row);
+    }
+}
+
+const std::vector<int32_t>& LaneVM::getColumn(const std::string& name) const {
+    auto it = slotByName.find(name);
+    if (it == slotByName.end()) throw std::runtime_error("LaneVM: no variable named '" + name + "'");
+    return columns[it->second];
+}
+
+ColumnSet LaneVM::getColumns() const {
+    ColumnSet result;
+    for (const auto& entry : slotByName) result.emplace(entry.first, columns[entry.second]);
+    return result;
+}
+
+// Runs one block of up to kWidth records (the lanes in `live`). The running
+// group is `mask`, all at `pc`; every other live lane is parked at
+// lanePc[lane]. `nextWaiting` is the lowest parked ip, so a group can tell
+// with one compare whether it is about to catch up with parked lanes.
+void LaneVM::runBlock(const BytecodeInstruction* code, uint32_t live, size_t firstRow) {
+    using lanes::Vec;
+
+    uint32_t lanePc[lanes::kWidth] = {};
+    uint32_t pc = 0;
+    uint32_t mask = live;
+    uint32_t nextWaiting = kNoIp;
+    Vec tmp, imm;
+
+    // Run the parked lanes with the lowest ip next
+    auto select = [&]() {
+        uint32_t lowest = kNoIp;
+        for (int lane = 0; lane < lanes::kWidth; ++lane) {
+            if ((live >> lane & 1) && lanePc[lane] < lowest) lowest = lanePc[lane];
+        }
+        pc = lowest;
+        mask = 0;
+        nextWaiting = kNoIp;
+        for (int lane = 0; lane < lanes::kWidth; ++lane) {
+            if (!(live >> lane & 1)) continue;
+            if (lanePc[lane] == lowest) mask |= 1u << lane;
+            else if (lanePc[lane] < nextWaiting) nextWaiting = lanePc[lane];
+        }
+    };
+    auto park = [&](uint32_t lanesToPark, uint32_t target) {
+        for (int lane = 0; lane < lanes::kWidth; ++lane) {
+            if (lanesToPark >> lane & 1) lanePc[lane] = target;
+        }
+    };
+    // Move the running group to `target`
+    auto advance = [&](uint32_t target) {
+        if (target < nextWaiting) {
+            pc = target;
+        } else {
+            // Caught up with (or passed) parked lanes: regroup
+            park(mask, target);
+            select();
+        }
+    };
+    // Lanes outside the running group keep their values. Finished lanes
+    // have already been written out, so a write covering every live lane
+    // needs no blend.
+    auto commit = [&](Vec& dst, const Vec& value) {
+        if (mask == live) dst = value;
+        else lanes::blend(dst, value, mask);
+    };
+
+    for (;;) {
+        const BytecodeInstruction& instr = code[pc];
+        Vec* sp = stack.data() + depth[pc];     // one past the top
+
+        switch (instr.opcode) {
+            case VMOpCode::VM_PUSH:
+                lanes::splat(tmp, instr.operand1);
+                commit(sp[0], tmp);
+                break;
+            case VMOpCode::VM_POP:
+                break;
+            case VMOpCode::VM_LOAD:
+                commit(sp[0], globals[instr.operand1]);
+                break;
+            case VMOpCode::VM_STORE:
+                commit(globals[instr.operand1], sp[-1]);
+                break;
+            case VMOpCode::VM_ADD: lanes::add(tmp, sp[-2], sp[-1]); commit(sp[-2], tmp); break;
+            case VMOpCode::VM_SUB: lanes::sub(tmp, sp[-2], sp[-1]); commit(sp[-2], tmp); break;
+            case VMOpCode::VM_MUL: lanes::mul(tmp, sp[-2], sp[-1]); commit(sp[-2], tmp); break;
+            case VMOpCode::VM_DIV: {
+                // No vector integer divide; divide lane by lane
+                tmp = sp[-2];
+                for (int lane = 0; lane < lanes::kWidth; ++lane) {
+                    if (!(mask >> lane & 1)) continue;
+                    int32_t b = sp[-1].v[lane];
+                    if (b == 0) {
+                        throw std::runtime_error("LaneVM: division by zero" + at(pc) + " (row " +
+                                                 std::to_string(firstRow + lane) + ")");
+                    }
+                    // INT32_MIN / -1 wraps, as in the scalar VM
+                    tmp.v[lane] = intDiv(tmp.v[lane], b);
+                }
+                commit(sp[-2], tmp);
+                break;
+            }
+            case VMOpCode::VM_NEG: lanes::neg(tmp, sp[-1]); commit(sp[-1], tmp); break;
+            case VMOpCode::VM_CMP_EQ: lanes::cmpEq(tmp, sp[-2], sp[-1]); commit(sp[-2], tmp); break;
+            case VMOpCode::VM_CMP_NE: lanes::cmpNe(tmp, sp[-2], sp[-1]); commit(sp[-2], tmp); break;
+            case VMOpCode::VM_CMP_LT: lanes::cmpLt(tmp, sp[-2], sp[-1]); commit(sp[-2], tmp); break;
+            case VMOpCode::VM_CMP_LE: lanes::cmpLe(tmp, sp[-2], sp[-1]); commit(sp[-2], tmp); break;
+            case VMOpCode::VM_CMP_GT: lanes::cmpGt(tmp, sp[-2], sp[-1]); commit(sp[-2], tmp); break;
+            case VMOpCode::VM_CMP_GE: lanes::cmpGe(tmp, sp[-2], sp[-1]); commit(sp[-2], tmp); break;
+
+            case VMOpCode::VM_JUMP:
+                advance(static_cast<uint32_t>(instr.operand1));
+                continue;
+            case VMOpCode::VM_JUMP_IF_TRUE:
+            case VMOpCode::VM_JUMP_IF_FALSE: {
+                uint32_t truthy = lanes::nonZero(sp[-1]) & mask;
+                uint32_t taken = instr.opcode == VMOpCode::VM_JUMP_IF_TRUE ? truthy : mask & ~truthy;
+                if (taken == mask) {
+                    advance(static_cast<uint32_t>(instr.operand1));
+                } else if (taken == 0) {
+                    advance(pc + 1);
+                } else {
+                    // The group splits; both halves wait and the lower ip runs first
+                    park(taken, static_cast<uint32_t>(instr.operand1));
+                    park(mask & ~taken, pc + 1);
+                    select();
+                }
+                continue;
+            }
+
+            case VMOpCode::VM_HALT:
+            case VMOpCode::VM_RETURN:
+                for (int lane = 0; lane < lanes::kWidth; ++lane) {
+                    if (!(mask >> lane & 1)) continue;
+                    for (size_t slot = 0; slot < globals.size(); ++slot) {
+                        columns[slot][firstRow + lane] = globals[slot].v[lane];
+                    }
+                }
+                live &= ~mask;
+                if (live == 0) return;
+                select();
+                continue;
+
+            case VMOpCode::VM_INC_VAR:
+                lanes::addScalar(tmp, globals[instr.operand1], instr.operand2);
+                commit(globals[instr.operand1], tmp);
+                break;
+            case VMOpCode::VM_LOAD_LOAD_ADD:
+                lanes::add(tmp, globals[instr.operand1], globals[instr.operand2]);
+                commit(sp[0], tmp);
+                break;
+            case VMOpCode::VM_LOAD_LOAD_SUB:
+                lanes::sub(tmp, globals[instr.operand1], globals[instr.operand2]);
+                commit(sp[0], tmp);
+                break;
+            case VMOpCode::VM_LOAD_LOAD_MUL:
+                lanes::mul(tmp, globals[instr.operand1], globals[instr.operand2]);
+                commit(sp[0], tmp);
+                break;
+            case VMOpCode::VM_LOAD_LOAD_CMP_LT:
+                lanes::cmpLt(tmp, globals[instr.operand1], globals[instr.operand2]);
+                commit(sp[0], tmp);
+                break;
+            case VMOpCode::VM_LOAD_PUSH_ADD:
+                lanes::addScalar(tmp, globals[instr.operand1], instr.operand2);
+                commit(sp[0], tmp);
+                break;
+            case VMOpCode::VM_LOAD_PUSH_SUB:
+                lanes::splat(imm, instr.operand2);
+                lanes::sub(tmp, globals[instr.operand1], imm);
+                commit(sp[0], tmp);
+                break;
+            case VMOpCode::VM_LOAD_PUSH_MUL:
+                lanes::splat(imm, instr.operand2);
+                lanes::mul(tmp, globals[instr.operand1], imm);
+                commit(sp[0], tmp);
+                break;
+            case VMOpCode::VM_LOAD_PUSH_CMP_LT:
+                lanes::splat(imm, instr.operand2);
+                lanes::cmpLt(tmp, globals[instr.operand1], imm);
+                commit(sp[0], tmp);
+                break;
+            case VMOpCode::VM_PUSH_STORE:
+                lanes::splat(tmp, instr.operand1);
+                commit(globals[instr.operand2], tmp);
+                break;
+            case VMOpCode::VM_STORE_LOAD:
+                commit(globals[instr.operand1], sp[-1]);
+                commit(sp[-1], globals[instr.operand2]);
+                break;
+            case VMOpCode::VM_ADD_STORE:
+                lanes::add(tmp, sp[-2], sp[-1]);
+                commit(globals[instr.operand1], tmp);
+                break;
+
+            case VMOpCode::VM_LABEL:
+                break;
+            case VMOpCode::VM_CALL:     // rejected by analyze()
+            case VMOpCode::VM_PUSH_CONST:
+            default:
+                throw std::runtime_error("LaneVM: unsupported instruction" + at(pc));
+        }
+        advance(pc + 1);
+    }
+}
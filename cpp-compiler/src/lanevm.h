@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "assembler.h"
+#include "lane_ops.h"
+
+// Named columns, one value per record
+typedef std::unordered_map<std::string, std::vector<int32_t>> ColumnSet;
+
+// Data-parallel stack VM: runs one program over many records at once.
+//
+// Every operand stack entry and every variable slot holds a vector of
+// lanes::kWidth lanes, one record per lane, so each dispatch advances that
+// many records (AVX2/SSE2 or scalar, see lane_ops.h). Records are taken
+// lanes::kWidth at a time from columnar inputs and written back to columnar
+// outputs.
+//
+// Branches are handled with masks. Each lane has its own ip; the lanes with
+// the lowest ip run together with a lane mask, and lanes that branch apart
+// wait until the running group reaches their ip again (or finishes). Stack
+// entries are addressed by the static stack depth of each instruction, so
+// lanes at different ips never disturb each other's values. While all lanes
+// agree (the usual case) this costs one compare per instruction.
+//
+// Programs with CALL are rejected (lanes would need separate call stacks),
+// and so are float and string constants: lanes hold int32 only, and
+// comparisons store 0/1. RETURN ends the program as it does at top level in VirtualMachine.
+class LaneVM {
+public:
+    // Runs `program` once per record. Every input column must have `rows`
+    // values and name a variable of the program; other variables start at
+    // 0. Throws std::runtime_error for unsupported programs, unknown
+    // columns, or a division by zero in any record.
+    void execute(const BytecodeProgram& program, const ColumnSet& inputs, size_t rows);
+
+    // Final values of a variable, one per record
+    const std::vector<int32_t>& getColumn(const std::string& name) const;
+    // Final values of every named variable
+    ColumnSet getColumns() const;
+
+    static const char* simdBackend() { return lanes::backendName(); }
+
+private:
+    static const uint32_t kNoIp = UINT32_MAX;
+
+    // Static stack depth before each instruction (-1: unreachable)
+    void analyze(const BytecodeProgram& program);
+    void runBlock(const BytecodeInstruction* code, uint32_t live, size_t firstRow);
+
+    std::vector<int32_t> depth;
+    size_t maxDepth = 0;
+
+    std::vector<lanes::Vec> stack;
+    std::vector<lanes::Vec> globals;
+    std::vector<std::vector<int32_t>> columns;  // by slot
+    std::unordered_map<std::string, size_t> slotByName;
+};
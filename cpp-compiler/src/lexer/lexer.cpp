@@ -1,10 +1,15 @@
 #include "lexer.h"
+#include "lexer_tables.h"
+#include "scan_ops.h"
 
-#include <cctype>
 #include <iostream>
 
 Lexer::Lexer(const std::string& sourceCode)
-    : source(sourceCode), start(0), current(0), line(1), column(1) {}
+    : ownedSource(new SourceBuffer(sourceCode)), source(ownedSource->text()),
+      start(0), current(0), line(1), column(1) {}
+
+Lexer::Lexer(const SourceBuffer& buffer)
+    : source(buffer.text()), start(0), current(0), line(1), column(1) {}
 
 std::vector<Token> Lexer::tokenize() {
     while (!isAtEnd()) {
@@ -40,43 +45,52 @@ bool Lexer::match(char expected) {
     return true;
 }
 
+// Moves to `to`, a position on the current line
+void Lexer::advanceTo(const char* to) {
+    const size_t next = static_cast<size_t>(to - source.data());
+    column += static_cast<int>(next - current);
+    current = next;
+}
+
 void Lexer::skipWhitespace() {
+    if (inComment) {
+        skipComment();
+        if (inComment) return;
+    }
+    const char* end = source.data() + source.size();
     while (!isAtEnd()) {
-        char c = peek();
-        switch (c) {
-            case ' ':
-            case '\t':
-            case '\r':
-                advance();
-                break;
-            case '\n':
-                advance();
-                line++;
-                column = 1;
-                break;
-            case '/':
-                if (peekNext() == '/') {
-                    skipComment();
-                } else {
-                    return;
-                }
-                break;
-            default:
-                return;
+        const char c = peek();
+        if (c == '/' && peekNext() == '/') {
+            skipComment();
+            continue;
+        }
+        if (!isSpaceChar(static_cast<unsigned char>(c))) return;
+        int newlines = 0;
+        const char* lastNewline = nullptr;
+        const char* next = scan::whitespaceEnd(source.data() + current, end, newlines, lastNewline);
+        if (newlines > 0) {
+            // Columns restart after the last newline of the run
+            line += newlines;
+            column = static_cast<int>(next - lastNewline);
+            current = static_cast<size_t>(next - source.data());
+        } else {
+            advanceTo(next);
         }
     }
 }
 
+// Up to (not including) the newline that ends the comment
 void Lexer::skipComment() {
-    while (!isAtEnd() && peek() != '\n') {
-        advance();
-    }
+    advanceTo(scan::findNewline(source.data() + current, source.data() + source.size()));
+    // The rest of the comment may still be unread
+    inComment = partial && isAtEnd();
 }
 
 void Lexer::scanToken() {
     skipWhitespace();
     if (isAtEnd()) return;
 
+    start = current;  // token begins after any skipped whitespace/comments
     char c = advance();
     switch (c) {
         // Punctuation
@@ -124,67 +138,48 @@ void Lexer::scanToken() {
             break;
 
         default:
-            if (std::isdigit(c)) {
+            if (isDigitChar(static_cast<unsigned char>(c))) {
                 number();
-            } else if (std::isalpha(c) || c == '_') {
+            } else if (isLetterChar(static_cast<unsigned char>(c))) {
                 identifier();
             } else {
-                tokens.emplace_back(TokenType::UNKNOWN, std::string(1, c), line, column);
+                tokens.emplace_back(TokenType::UNKNOWN, source.substr(start, 1), line, column);
             }
             break;
     }
 }
 
 void Lexer::addToken(TokenType type) {
-    std::string text = source.substr(start, current - start);
-    tokens.emplace_back(type, text, line, column);
+    tokens.emplace_back(type, source.substr(start, current - start), line, column);
 }
 
-void Lexer::identifier() {
-    while (!isAtEnd() && (std::isalnum(peek()) || peek() == '_')) {
-        advance();
+void Lexer::report(const char* what) {
+    if (deferErrors) {
+        deferredErrors.emplace_back(line, what);
+        return;
     }
+    std::cerr << what << " at line " << line << "\n";
+}
 
-    std::string text = source.substr(start, current - start);
-    static const std::unordered_map<std::string, TokenType> keywords = {
-        {"int", TokenType::KEYWORD},
-        {"return", TokenType::KEYWORD},
-        {"if", TokenType::KEYWORD},
-        {"else", TokenType::KEYWORD},
-        {"while", TokenType::KEYWORD},
-        {"for", TokenType::KEYWORD},
-        {"void", TokenType::KEYWORD},
-        {"char", TokenType::KEYWORD},
-        {"float", TokenType::KEYWORD},
-        {"bool", TokenType::KEYWORD},
-        {"true", TokenType::KEYWORD},
-        {"false", TokenType::KEYWORD}
-    };
-
-    TokenType type = TokenType::IDENTIFIER;
-    auto it = keywords.find(text);
-    if (it != keywords.end()) {
-        type = it->second;
-    }
+void Lexer::identifier() {
+    advanceTo(scan::identifierEnd(source.data() + current, source.data() + source.size()));
 
+    std::string_view text = source.substr(start, current - start);
+    TokenType type = keywords::find(text) >= 0 ? TokenType::KEYWORD : TokenType::IDENTIFIER;
     tokens.emplace_back(type, text, line, column);
 }
 
 void Lexer::number() {
-    while (!isAtEnd() && std::isdigit(peek())) {
-        advance();
-    }
+    const char* end = source.data() + source.size();
+    advanceTo(scan::digitsEnd(source.data() + current, end));
 
     // Optional: support for decimal values
-    if (!isAtEnd() && peek() == '.' && std::isdigit(peekNext())) {
+    if (!isAtEnd() && peek() == '.' && isDigitChar(static_cast<unsigned char>(peekNext()))) {
         advance(); // consume '.'
-        while (!isAtEnd() && std::isdigit(peek())) {
-            advance();
-        }
+        advanceTo(scan::digitsEnd(source.data() + current, end));
     }
 
-    std::string numStr = source.substr(start, current - start);
-    tokens.emplace_back(TokenType::NUMBER, numStr, line, column);
+    tokens.emplace_back(TokenType::NUMBER, source.substr(start, current - start), line, column);
 }
 
 void Lexer::stringLiteral() {
@@ -197,32 +192,47 @@ void Lexer::stringLiteral() {
     }
 
     if (isAtEnd()) {
-        std::cerr << "Unterminated string at line " << line << "\n";
+        if (partial) {
+            needMore = true;
+            return;
+        }
+        report("Unterminated string");
         return;
     }
 
     advance(); // Consume closing quote
-    std::string value = source.substr(start + 1, current - start - 2); // Exclude quotes
+    std::string_view value = source.substr(start + 1, current - start - 2); // Exclude quotes
     tokens.emplace_back(TokenType::STRING_LITERAL, value, line, column);
 }
 
 void Lexer::charLiteral() {
+    // Decide with the whole literal in view (an escape, its character and
+    // the closing quote) plus the two bytes StreamingLexer looks past a
+    // token, so a malformed one is reported once
+    if (partial && source.size() - current < 5) {
+        needMore = true;
+        return;
+    }
     if (isAtEnd()) {
-        std::cerr << "Unterminated character literal at line " << line << "\n";
+        report("Unterminated character literal");
         return;
     }
 
     char value = advance();
     if (value == '\\') {
-        // Escape sequence, consume next char
+        // Escape sequence, consume next char; the buffer has no terminator to read past the end
+        if (isAtEnd()) {
+            report("Unterminated character literal");
+            return;
+        }
         value = advance(); // e.g., 'n', 't'
     }
 
     if (!match('\'')) {
-        std::cerr << "Unterminated character literal at line " << line << "\n";
+        report("Unterminated character literal");
         return;
     }
 
-    std::string valStr = source.substr(start + 1, current - start - 2); // Without quotes
+    std::string_view valStr = source.substr(start + 1, current - start - 2); // Without quotes
     tokens.emplace_back(TokenType::CHAR_LITERAL, valStr, line, column);
 }
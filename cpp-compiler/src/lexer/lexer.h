@@ -1,11 +1,14 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <utility>
 #include <unordered_map>
 #include <cctype>
 #include <iostream>
+#include "source_buffer.h"
 
 // Token types for your language
 enum class TokenType {
@@ -20,26 +23,36 @@ enum class TokenType {
     UNKNOWN
 };
 
-// Struct representing a single token
+// Struct representing a single token. The lexeme points into the source
+// text the Lexer ran over (see Lexer), so making a token never allocates.
 struct Token {
     TokenType type;
-    std::string lexeme;
+    std::string_view lexeme;
     int line;
     int column;
 
-    Token(TokenType type, const std::string& lexeme, int line = 0, int column = 0)
+    Token(TokenType type, std::string_view lexeme, int line = 0, int column = 0)
         : type(type), lexeme(lexeme), line(line), column(column) {}
 };
 
 class Lexer {
 public:
+    // Lexes a copy of `sourceCode`; the tokens stay valid while the Lexer
+    // lives
     explicit Lexer(const std::string& sourceCode);
+    // Lexes `buffer` in place; the tokens stay valid while the buffer lives
+    explicit Lexer(const SourceBuffer& buffer);
     std::vector<Token> tokenize();
 
 private:
+    friend class StreamingLexer;
+    friend class ParallelLexer;
+    Lexer() = default;
+
     char peek() const;
     char peekNext() const;
     char advance();
+    void advanceTo(const char* to);
     bool match(char expected);
     bool isAtEnd() const;
 
@@ -52,12 +65,25 @@ private:
     void stringLiteral();
     void charLiteral();
     void addToken(TokenType type);
+    void report(const char* what);
 
-    std::string source;
+    std::unique_ptr<SourceBuffer> ownedSource;
+    std::string_view source;
     std::vector<Token> tokens;
     size_t start = 0;
     size_t current = 0;
     int line = 1;
     int column = 1;
+
+    // Set by StreamingLexer: `source` is a prefix of the input, so reaching
+    // its end is not the end of the program
+    bool partial = false;
+    bool needMore = false;      // a literal ran into the end of a partial source
+    bool inComment = false;     // a comment ran into it; skipping goes on
+
+    // Set by ParallelLexer: errors are kept (line, message) rather than
+    // printed, until the chunk's line numbers are known
+    bool deferErrors = false;
+    std::vector<std::pair<int, const char*>> deferredErrors;
 };
 
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Compile-time tables behind the Lexer's per-byte and per-identifier
+// decisions: a 256-entry character class table (plain ASCII, independent
+// of the C locale) and a perfect hash over the keywords, so recognizing a
+// keyword takes one multiply, one table load and one short compare.
+
+// Character classes, as bit flags
+enum CharClass : uint8_t {
+    kSpaceChar = 1,         // ' ', '\t', '\r', '\n'
+    kDigitChar = 2,         // 0-9
+    kLetterChar = 4,        // a-z, A-Z, '_': may start an identifier
+};
+
+constexpr std::array<uint8_t, 256> makeCharClasses() {
+    std::array<uint8_t, 256> table{};
+    table[' '] = table['\t'] = table['\r'] = table['\n'] = kSpaceChar;
+    for (int c = '0'; c <= '9'; ++c) table[c] = kDigitChar;
+    for (int c = 'a'; c <= 'z'; ++c) table[c] = kLetterChar;
+    for (int c = 'A'; c <= 'Z'; ++c) table[c] = kLetterChar;
+    table['_'] = kLetterChar;
+    return table;
+}
+
+inline constexpr std::array<uint8_t, 256> kCharClasses = makeCharClasses();
+
+constexpr bool isSpaceChar(unsigned char c) { return kCharClasses[c] & kSpaceChar; }
+constexpr bool isDigitChar(unsigned char c) { return kCharClasses[c] & kDigitChar; }
+constexpr bool isLetterChar(unsigned char c) { return kCharClasses[c] & kLetterChar; }
+constexpr bool isIdentifierChar(unsigned char c) { return kCharClasses[c] & (kLetterChar | kDigitChar); }
+
+// Every keyword of the language; all lex as TokenType::KEYWORD
+#define LEXER_KEYWORD_LIST(X) \
+    X(int)                    \
+    X(return)                 \
+    X(if)                     \
+    X(else)                   \
+    X(while)                  \
+    X(for)                    \
+    X(void)                   \
+    X(char)                   \
+    X(float)                  \
+    X(bool)                   \
+    X(true)                   \
+    X(false)                  \
+    X(print)
+
+namespace keywords {
+
+#define LEXER_KEYWORD_STRING(name) #name,
+inline constexpr std::string_view kNames[] = {LEXER_KEYWORD_LIST(LEXER_KEYWORD_STRING)};
+#undef LEXER_KEYWORD_STRING
+constexpr int kCount = static_cast<int>(sizeof(kNames) / sizeof(kNames[0]));
+
+const int kTableBits = 5;
+const uint32_t kTableSize = 1u << kTableBits;
+
+// First byte, last byte and length, spread over the table by `seed`
+constexpr uint32_t hash(std::string_view text, uint32_t seed) {
+    const uint32_t key = static_cast<uint32_t>(static_cast<unsigned char>(text.front())) << 16 |
+                         static_cast<uint32_t>(static_cast<unsigned char>(text.back())) << 8 |
+                         static_cast<uint32_t>(text.size() & 0xFF);
+    return (key * seed) >> (32 - kTableBits);
+}
+
+constexpr bool isPerfect(uint32_t seed) {
+    bool used[kTableSize] = {};
+    for (int i = 0; i < kCount; ++i) {
+        const uint32_t slot = hash(kNames[i], seed);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+// Smallest odd seed that gives every keyword its own slot
+constexpr uint32_t findSeed() {
+    uint32_t seed = 1;
+    while (!isPerfect(seed)) seed += 2;
+    return seed;
+}
+
+inline constexpr uint32_t kSeed = findSeed();
+static_assert(isPerfect(kSeed), "keyword hash has collisions");
+
+// Slot -> keyword index, -1 for empty slots
+constexpr std::array<int8_t, kTableSize> makeSlots() {
+    std::array<int8_t, kTableSize> slots{};
+    for (uint32_t i = 0; i < kTableSize; ++i) slots[i] = -1;
+    for (int i = 0; i < kCount; ++i) slots[hash(kNames[i], kSeed)] = static_cast<int8_t>(i);
+    return slots;
+}
+
+inline constexpr std::array<int8_t, kTableSize> kSlots = makeSlots();
+
+// Index of `text` in LEXER_KEYWORD_LIST, or -1 when it is not a keyword
+constexpr int find(std::string_view text) {
+    if (text.empty()) return -1;
+    const int index = kSlots[hash(text, kSeed)];
+    return index >= 0 && kNames[index] == text ? index : -1;
+}
+
+} // namespace keywords
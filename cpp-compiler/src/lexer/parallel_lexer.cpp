@@ -0,0 +1,134 @@
+#include "parallel_lexer.h"
+#include "scan_ops.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+ParallelLexer::ParallelLexer(const SourceBuffer& buffer, size_t threads)
+    : buffer(buffer), source(buffer.text()), threads(threads) {
+    if (this->threads == 0) this->threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Runs work(i) for every chunk index on up to `threads` threads, the
+// calling one included; each thread takes the next index from a counter
+template <typename Work>
+void ParallelLexer::forEachChunk(size_t count, Work&& work) const {
+    std::atomic<size_t> next{0};
+    auto loop = [&] {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) work(i);
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < std::min(threads, count); ++t) pool.emplace_back(loop);
+    loop();
+    for (auto& thread : pool) thread.join();
+}
+
+// Lexes the tokens that start in [from, chunk.limit), counting lines from 1
+void ParallelLexer::lexChunk(Chunk& chunk, size_t from, int column) const {
+    Lexer lexer;
+    lexer.source = source;
+    lexer.current = from;
+    lexer.column = column;
+    lexer.deferErrors = true;
+
+    chunk.start = from;
+    chunk.scanEnd = from;
+    chunk.line = 1;
+    chunk.column = column;
+    for (;;) {
+        lexer.skipWhitespace();
+        if (lexer.isAtEnd() || lexer.current >= chunk.limit) break;
+        lexer.scanToken();
+        chunk.scanEnd = lexer.current;
+        chunk.line = lexer.line;
+        chunk.column = lexer.column;
+    }
+    chunk.endLine = lexer.line;
+    chunk.endColumn = lexer.column;
+    chunk.tokens = std::move(lexer.tokens);
+    chunk.errors = std::move(lexer.deferredErrors);
+}
+
+std::vector<Token> ParallelLexer::tokenize() {
+    const size_t size = source.size();
+    size_t wanted = std::min(threads * 4, size / kMinChunkBytes);
+    if (threads <= 1 || size < kMinParallelBytes || wanted < 2) {
+        chunkCount = 1;
+        relexedCount = 0;
+        Lexer lexer(buffer);
+        return lexer.tokenize();
+    }
+
+    // Cut after the first newline past each even share of the source
+    std::vector<Chunk> chunks(1);
+    for (size_t k = 1; k < wanted; ++k) {
+        const char* cut = scan::findNewline(source.data() + size / wanted * k, source.data() + size);
+        const size_t begin = static_cast<size_t>(cut - source.data()) + 1;
+        if (begin >= size || begin <= chunks.back().begin) continue;
+        chunks.back().limit = begin;
+        chunks.emplace_back();
+        chunks.back().begin = begin;
+    }
+    chunks.back().limit = size;
+    chunkCount = chunks.size();
+    relexedCount = 0;
+
+    forEachChunk(chunks.size(), [&](size_t k) { lexChunk(chunks[k], chunks[k].begin, 1); });
+
+    // Settle the guesses front to back. A chunk right after a settled one
+    // either guessed right or is lexed again from the true state; those
+    // lexed again in one round are independent of each other.
+    chunks[0].settled = true;
+    for (;;) {
+        std::vector<size_t> relex;
+        for (size_t k = 1; k < chunks.size(); ++k) {
+            if (chunks[k].settled || !chunks[k - 1].settled) continue;
+            if (chunks[k - 1].scanEnd < chunks[k].begin) {
+                chunks[k].settled = true;
+            } else {
+                // The last token took in the newline before this chunk, or more
+                relex.push_back(k);
+            }
+        }
+        if (relex.empty()) break;
+        forEachChunk(relex.size(), [&](size_t i) {
+            const Chunk& previous = chunks[relex[i] - 1];
+            lexChunk(chunks[relex[i]], previous.scanEnd, previous.column);
+        });
+        for (size_t k : relex) chunks[k].settled = true;
+        relexedCount += relex.size();
+    }
+
+    // Between the previous chunk's last token and this chunk's start lie
+    // only whitespace and comments
+    size_t end = 0;
+    int line = 1;
+    for (auto& chunk : chunks) {
+        chunk.lineBase = line - 1 + static_cast<int>(std::count(source.data() + end,
+                                                                 source.data() + chunk.start, '\n'));
+        end = chunk.scanEnd;
+        line = chunk.line + chunk.lineBase;
+    }
+
+    forEachChunk(chunks.size(), [&](size_t k) {
+        const int base = chunks[k].lineBase;
+        if (base == 0) return;
+        for (auto& token : chunks[k].tokens) token.line += base;
+    });
+
+    size_t total = 1;
+    for (const auto& chunk : chunks) total += chunk.tokens.size();
+    std::vector<Token> tokens;
+    tokens.reserve(total);
+    for (const auto& chunk : chunks) {
+        tokens.insert(tokens.end(), chunk.tokens.begin(), chunk.tokens.end());
+        for (const auto& error : chunk.errors) {
+            std::cerr << error.second << " at line " << error.first + chunk.lineBase << "\n";
+        }
+    }
+    const Chunk& last = chunks.back();
+    tokens.emplace_back(TokenType::END_OF_FILE, "", last.endLine + last.lineBase, last.endColumn);
+    return tokens;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "lexer.h"
+
+// Tokenizes a large source on several threads, with exactly the tokens,
+// line and column numbers and diagnostics of Lexer::tokenize.
+//
+// The source is cut into chunks that each begin at the start of a line, and
+// worker threads lex the chunks at once, each guessing that its chunk
+// begins between tokens. A guess holds unless the previous chunk's last
+// token ran past the cut, which only a string literal spanning lines (or a
+// character literal swallowing a newline) can do; comments end at the
+// newline. A chunk whose guess was wrong is lexed again from where that
+// token really ended, as soon as the previous chunk is itself settled, so
+// chunks lexed again in the same round still run in parallel. Chunks count
+// lines from 1; once all are settled their lines are offset by the lines
+// before them and the token arrays are joined.
+//
+// Sources under kMinParallelBytes are lexed on the calling thread alone.
+class ParallelLexer {
+public:
+    static const size_t kMinParallelBytes = 1 << 20;
+    static const size_t kMinChunkBytes = 256 * 1024;
+
+    // Lexes `buffer` in place; the tokens stay valid while the buffer
+    // lives. threads == 0 uses one per hardware thread.
+    explicit ParallelLexer(const SourceBuffer& buffer, size_t threads = 0);
+
+    std::vector<Token> tokenize();
+
+    // Of the last tokenize(): chunks lexed, and those lexed a second time
+    // because they began inside a token
+    size_t lastChunkCount() const { return chunkCount; }
+    size_t lastRelexedCount() const { return relexedCount; }
+
+private:
+    struct Chunk {
+        size_t begin = 0;           // at the start of a line
+        size_t limit = 0;           // tokens starting before here are this chunk's
+        size_t start = 0;           // where lexing began: begin, or where the last token before ended
+        std::vector<Token> tokens;
+        std::vector<std::pair<int, const char*>> errors;
+        // Lexer state where the last token (or unterminated literal) ended,
+        // and at the end of the chunk
+        size_t scanEnd = 0;
+        int line = 1;
+        int column = 1;
+        int endLine = 1;
+        int endColumn = 1;
+        int lineBase = 0;           // true line = line counted in the chunk + lineBase
+        bool settled = false;       // lexed from the true state at `start`
+    };
+
+    void lexChunk(Chunk& chunk, size_t from, int column) const;
+    template <typename Work>
+    void forEachChunk(size_t count, Work&& work) const;
+
+    const SourceBuffer& buffer;
+    std::string_view source;
+    size_t threads;
+    size_t chunkCount = 0;
+    size_t relexedCount = 0;
+};
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "lexer_tables.h"
+
+// Byte-class scanning kernels for the Lexer: each one classifies a block of
+// source bytes at once and returns where a run of one class ends. Built on
+// AVX2 (32-byte blocks), SSE4.2 string instructions or SSE2 compares
+// (16-byte blocks), or 8-byte SWAR words when none is enabled for the
+// target. Like lane_ops.h, the backend is picked at compile time from the
+// compiler's target macros (configure with -march=native to get AVX2).
+//
+// Classes are those of lexer_tables.h: plain ASCII, so bytes >= 0x80 belong
+// to none of them. Blocks never read past `end`; the last partial block is
+// scanned bytewise with the class table.
+
+#if defined(__AVX2__)
+#define MYCOMPILER_SCAN_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#define MYCOMPILER_SCAN_SSE42 1
+#include <nmmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define MYCOMPILER_SCAN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace scan {
+
+inline const char* backendName() {
+#if defined(MYCOMPILER_SCAN_AVX2)
+    return "avx2";
+#elif defined(MYCOMPILER_SCAN_SSE42)
+    return "sse4.2";
+#elif defined(MYCOMPILER_SCAN_SSE2)
+    return "sse2";
+#else
+    return "swar";
+#endif
+}
+
+// Index of the lowest / highest set bit of a non-zero mask, and set bits
+inline int lowestBit(uint32_t mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int i = 0;
+    while (!(mask >> i & 1)) ++i;
+    return i;
+#endif
+}
+inline int highestBit(uint32_t mask) {
+#if defined(__GNUC__)
+    return 31 - __builtin_clz(mask);
+#else
+    int i = 31;
+    while (!(mask >> i & 1)) --i;
+    return i;
+#endif
+}
+inline int bitCount(uint32_t mask) {
+#if defined(__GNUC__)
+    return __builtin_popcount(mask);
+#else
+    int n = 0;
+    for (; mask; mask &= mask - 1) ++n;
+    return n;
+#endif
+}
+
+// Per-block class masks: bit i is set when byte p[i] is in the class
+#if defined(MYCOMPILER_SCAN_AVX2)
+
+const int kBlock = 32;
+const uint32_t kBlockMask = 0xFFFFFFFFu;
+
+inline __m256i loadBlock(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline uint32_t bits(__m256i x) { return static_cast<uint32_t>(_mm256_movemask_epi8(x)); }
+// a <= x <= b, bytewise; bytes >= 0x80 are negative and never in range
+inline __m256i inRange(__m256i x, char a, char b) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(static_cast<char>(a - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(b + 1)), x));
+}
+inline __m256i equals(__m256i x, char c) { return _mm256_cmpeq_epi8(x, _mm256_set1_epi8(c)); }
+
+inline uint32_t spaceMask(const char* p) {
+    __m256i x = loadBlock(p);
+    return bits(_mm256_or_si256(_mm256_or_si256(equals(x, ' '), equals(x, '\t')),
+                                _mm256_or_si256(equals(x, '\r'), equals(x, '\n'))));
+}
+inline uint32_t newlineMask(const char* p) { return bits(equals(loadBlock(p), '\n')); }
+inline uint32_t digitMask(const char* p) { return bits(inRange(loadBlock(p), '0', '9')); }
+inline uint32_t identifierMask(const char* p) {
+    __m256i x = loadBlock(p);
+    __m256i letter = inRange(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z');
+    return bits(_mm256_or_si256(_mm256_or_si256(letter, inRange(x, '0', '9')), equals(x, '_')));
+}
+
+#elif defined(MYCOMPILER_SCAN_SSE42)
+
+const int kBlock = 16;
+const uint32_t kBlockMask = 0xFFFFu;
+
+inline __m128i loadBlock(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+// Explicit-length string compares, so a NUL in the source is just a byte
+template <int Mode>
+inline uint32_t matches(const char* p, const char* set, int setLength) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(set));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(
+        _mm_cmpestrm(chars, setLength, loadBlock(p), kBlock, _SIDD_UBYTE_OPS | Mode | _SIDD_BIT_MASK)));
+}
+// 16-byte sets so the load above stays inside them
+inline uint32_t spaceMask(const char* p) {
+    static const char kSet[16] = {' ', '\t', '\r', '\n'};
+    return matches<_SIDD_CMP_EQUAL_ANY>(p, kSet, 4);
+}
+inline uint32_t newlineMask(const char* p) {
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(loadBlock(p), _mm_set1_epi8('\n'))));
+}
+inline uint32_t digitMask(const char* p) {
+    static const char kRanges[16] = {'0', '9'};
+    return matches<_SIDD_CMP_RANGES>(p, kRanges, 2);
+}
+inline uint32_t identifierMask(const char* p) {
+    static const char kRanges[16] = {'a', 'z', 'A', 'Z', '0', '9', '_', '_'};
+    return matches<_SIDD_CMP_RANGES>(p, kRanges, 8);
+}
+
+#elif defined(MYCOMPILER_SCAN_SSE2)
+
+const int kBlock = 16;
+const uint32_t kBlockMask = 0xFFFFu;
+
+inline __m128i loadBlock(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline uint32_t bits(__m128i x) { return static_cast<uint32_t>(_mm_movemask_epi8(x)); }
+// a <= x <= b, bytewise; bytes >= 0x80 are negative and never in range
+inline __m128i inRange(__m128i x, char a, char b) {
+    return _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(static_cast<char>(a - 1))),
+                         _mm_cmplt_epi8(x, _mm_set1_epi8(static_cast<char>(b + 1))));
+}
+inline __m128i equals(__m128i x, char c) { return _mm_cmpeq_epi8(x, _mm_set1_epi8(c)); }
+
+inline uint32_t spaceMask(const char* p) {
+    __m128i x = loadBlock(p);
+    return bits(_mm_or_si128(_mm_or_si128(equals(x, ' '), equals(x, '\t')),
+                             _mm_or_si128(equals(x, '\r'), equals(x, '\n'))));
+}
+inline uint32_t newlineMask(const char* p) { return bits(equals(loadBlock(p), '\n')); }
+inline uint32_t digitMask(const char* p) { return bits(inRange(loadBlock(p), '0', '9')); }
+inline uint32_t identifierMask(const char* p) {
+    __m128i x = loadBlock(p);
+    __m128i letter = inRange(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z');
+    return bits(_mm_or_si128(_mm_or_si128(letter, inRange(x, '0', '9')), equals(x, '_')));
+}
+
+#else
+
+// SWAR: eight bytes in a uint64_t. Each test leaves the high bit of every
+// byte that passes; the tests are exact (no carries between bytes) because
+// they only add to the low seven bits.
+const int kBlock = 8;
+const uint32_t kBlockMask = 0xFFu;
+const uint64_t kLow = 0x0101010101010101ull;
+const uint64_t kHigh = 0x8080808080808080ull;
+
+inline uint64_t loadWord(const char* p) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+// Byte high bits -> bit i for byte i
+inline uint32_t bits(uint64_t highBits) {
+    return static_cast<uint32_t>(((highBits >> 7) * 0x0102040810204080ull) >> 56);
+}
+// (byte & 0x7F) >= n, for 1 <= n <= 128
+inline uint64_t atLeast(uint64_t x, unsigned n) { return ((x & ~kHigh) + (0x80 - n) * kLow) & kHigh; }
+inline uint64_t equals(uint64_t x, unsigned char c) {
+    uint64_t y = x ^ (c * kLow);
+    return ~(((y & ~kHigh) + ~kHigh) | y) & kHigh;
+}
+inline uint64_t inRange(uint64_t x, unsigned a, unsigned b) {
+    return atLeast(x, a) & ~atLeast(x, b + 1) & ~x & kHigh;
+}
+
+inline uint32_t spaceMask(const char* p) {
+    uint64_t x = loadWord(p);
+    return bits(equals(x, ' ') | equals(x, '\t') | equals(x, '\r') | equals(x, '\n'));
+}
+inline uint32_t newlineMask(const char* p) { return bits(equals(loadWord(p), '\n')); }
+inline uint32_t digitMask(const char* p) { return bits(inRange(loadWord(p), '0', '9')); }
+inline uint32_t identifierMask(const char* p) {
+    uint64_t x = loadWord(p);
+    return bits(inRange(x | (0x20 * kLow), 'a', 'z') | inRange(x, '0', '9') | equals(x, '_'));
+}
+
+#endif
+
+// End of the run of `Class` bytes starting at p
+template <uint32_t (*Mask)(const char*), bool (*Scalar)(unsigned char)>
+inline const char* runEnd(const char* p, const char* end) {
+    // Most runs are a byte or two; settle those without a block load
+    if (p == end || !Scalar(static_cast<unsigned char>(*p))) return p;
+    ++p;
+    while (end - p >= kBlock) {
+        uint32_t stop = ~Mask(p) & kBlockMask;
+        if (stop) return p + lowestBit(stop);
+        p += kBlock;
+    }
+    while (p < end && Scalar(static_cast<unsigned char>(*p))) ++p;
+    return p;
+}
+
+inline const char* identifierEnd(const char* p, const char* end) { return runEnd<identifierMask, isIdentifierChar>(p, end); }
+inline const char* digitsEnd(const char* p, const char* end) { return runEnd<digitMask, isDigitChar>(p, end); }
+
+// End of a whitespace run. Adds the '\n's in it to `newlines` and points
+// `lastNewline` at the last one (left alone when there is none).
+inline const char* whitespaceEnd(const char* p, const char* end, int& newlines, const char*& lastNewline) {
+    // A single space between tokens is the common case
+    if (p == end || !isSpaceChar(static_cast<unsigned char>(*p))) return p;
+    if (*p == ' ' && (p + 1 == end || !isSpaceChar(static_cast<unsigned char>(p[1])))) return p + 1;
+    while (end - p >= kBlock) {
+        uint32_t stop = ~spaceMask(p) & kBlockMask;
+        uint32_t lines = newlineMask(p);
+        if (stop) lines &= (stop & (0u - stop)) - 1;
+        if (lines) {
+            newlines += bitCount(lines);
+            lastNewline = p + highestBit(lines);
+        }
+        if (stop) return p + lowestBit(stop);
+        p += kBlock;
+    }
+    for (; p < end && isSpaceChar(static_cast<unsigned char>(*p)); ++p) {
+        if (*p == '\n') {
+            ++newlines;
+            lastNewline = p;
+        }
+    }
+    return p;
+}
+
+// First '\n' at or after p, or end
+inline const char* findNewline(const char* p, const char* end) {
+    while (end - p >= kBlock) {
+        uint32_t found = newlineMask(p);
+        if (found) return p + lowestBit(found);
+        p += kBlock;
+    }
+    while (p < end && *p != '\n') ++p;
+    return p;
+}
+
+} // namespace scan
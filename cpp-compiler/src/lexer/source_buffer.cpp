@@ -0,0 +1,62 @@
+#include "source_buffer.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MYCOMPILER_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define MYCOMPILER_HAS_MMAP 0
+#endif
+
+SourceBuffer::SourceBuffer(std::string text) : owned(std::move(text)) {
+    data = owned.data();
+    size = owned.size();
+}
+
+SourceBuffer::~SourceBuffer() {
+#if MYCOMPILER_HAS_MMAP
+    if (mapped) munmap(const_cast<char*>(data), size);
+#endif
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::open(const std::string& path) {
+    std::unique_ptr<SourceBuffer> buffer(new SourceBuffer());
+#if MYCOMPILER_HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    // Pipes and other special files have no size to map; read them instead
+    if (S_ISREG(info.st_mode) && info.st_size > 0) {
+        const size_t size = static_cast<size_t>(info.st_size);
+        void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED) throw std::runtime_error("Cannot map " + path);
+        // The lexer reads front to back exactly once
+        madvise(memory, size, MADV_SEQUENTIAL);
+        buffer->data = static_cast<const char*>(memory);
+        buffer->size = size;
+        buffer->mapped = true;
+        return buffer;
+    }
+    ::close(fd);
+#endif
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open " + path);
+    std::stringstream text;
+    text << in.rdbuf();
+    if (in.bad()) throw std::runtime_error("Cannot read " + path);
+    buffer->owned = text.str();
+    buffer->data = buffer->owned.data();
+    buffer->size = buffer->owned.size();
+    return buffer;
+}
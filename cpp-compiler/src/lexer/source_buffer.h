@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Source text for the Lexer. A file is mapped read-only rather than read, so
+// a multi-megabyte script costs no copy, and tokens can point straight into
+// the text for as long as the buffer lives.
+class SourceBuffer {
+public:
+    // Owns a copy of `text`
+    explicit SourceBuffer(std::string text);
+    ~SourceBuffer();
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    // Maps a file (reads it where mmap is unavailable). Throws
+    // std::runtime_error when it cannot be opened or read.
+    static std::unique_ptr<SourceBuffer> open(const std::string& path);
+
+    std::string_view text() const { return std::string_view(data, size); }
+
+private:
+    SourceBuffer() = default;
+
+    const char* data = "";
+    size_t size = 0;
+    bool mapped = false;                // false: data points into owned
+    std::string owned;
+};
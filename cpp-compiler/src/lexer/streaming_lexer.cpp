@@ -0,0 +1,115 @@
+#include "streaming_lexer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define MYCOMPILER_HAS_READ 1
+#else
+#define MYCOMPILER_HAS_READ 0
+#endif
+
+StreamingLexer::StreamingLexer(int fd, size_t chunkSize)
+    : fd(fd), buffer(new char[std::max<size_t>(chunkSize, 16)]), capacity(std::max<size_t>(chunkSize, 16)) {
+    lexer.source = std::string_view(buffer.get(), 0);
+    lexer.partial = true;
+}
+
+StreamingLexer::StreamingLexer(std::istream& in, size_t chunkSize)
+    : in(&in), buffer(new char[std::max<size_t>(chunkSize, 16)]), capacity(std::max<size_t>(chunkSize, 16)) {
+    lexer.source = std::string_view(buffer.get(), 0);
+    lexer.partial = true;
+}
+
+const Token& StreamingLexer::next() {
+    // The older slot: the parser has let go of that token by now
+    Token& token = window[newest ^ 1];
+    for (;;) {
+        // Whitespace and comments are dropped as they go, across refills;
+        // two bytes of lookahead decide a "//"
+        lexer.skipWhitespace();
+        if (!endOfInput && (lexer.inComment || lexer.current + 2 > filled)) {
+            refill();
+            continue;
+        }
+        if (lexer.isAtEnd()) {
+            token = Token(TokenType::END_OF_FILE, "", lexer.line, lexer.column);
+            break;
+        }
+
+        const size_t start = lexer.current;
+        const int line = lexer.line;
+        const int column = lexer.column;
+        lexer.scanToken();
+        // A token that reaches the end of the chunk may go on in the next
+        // one (or a two-byte operator, or a decimal point, may): read more
+        // and lex it again
+        if (lexer.needMore || (!endOfInput && lexer.current + 2 > filled)) {
+            lexer.needMore = false;
+            lexer.tokens.clear();
+            lexer.current = start;
+            lexer.line = line;
+            lexer.column = column;
+            refill();
+            continue;
+        }
+        // Unterminated literals at the end of input are reported, not tokens
+        if (lexer.tokens.empty()) continue;
+        token = lexer.tokens.back();
+        lexer.tokens.clear();
+        break;
+    }
+    newest ^= 1;
+    return token;
+}
+
+// Keeps only the bytes still in use, moved to the front, then reads after
+// them: the latest token handed out and whatever has not been lexed yet.
+// What lies between (the rest of a comment, say) is dropped.
+void StreamingLexer::refill() {
+    char* base = buffer.get();
+    std::string_view& held = window[newest].lexeme;
+    const bool heldHere = held.data() >= base && held.data() + held.size() <= base + lexer.current;
+    const size_t heldSize = heldHere ? held.size() : 0;
+    if (heldHere) std::memmove(base, held.data(), heldSize);
+    std::memmove(base + heldSize, base + lexer.current, filled - lexer.current);
+    filled = heldSize + (filled - lexer.current);
+    lexer.current = heldSize;
+    if (filled == capacity) {
+        // One token fills the whole buffer
+        std::unique_ptr<char[]> larger(new char[capacity * 2]);
+        std::memcpy(larger.get(), base, filled);
+        buffer = std::move(larger);
+        capacity *= 2;
+        base = buffer.get();
+    }
+    if (heldHere) held = std::string_view(base, heldSize);
+
+    const size_t got = read(base + filled, capacity - filled);
+    if (got == 0) endOfInput = true;
+    filled += got;
+    lexer.source = std::string_view(base, filled);
+    lexer.partial = !endOfInput;
+}
+
+size_t StreamingLexer::read(char* to, size_t bytes) {
+    if (in) {
+        in->read(to, static_cast<std::streamsize>(bytes));
+        if (in->bad()) throw std::runtime_error("Cannot read source stream");
+        return static_cast<size_t>(in->gcount());
+    }
+#if MYCOMPILER_HAS_READ
+    for (;;) {
+        const ssize_t got = ::read(fd, to, bytes);
+        if (got >= 0) return static_cast<size_t>(got);
+        if (errno != EINTR) throw std::runtime_error(std::string("Cannot read source: ") + std::strerror(errno));
+    }
+#else
+    (void)to;
+    (void)bytes;
+    throw std::runtime_error("Reading a file descriptor is not supported on this platform");
+#endif
+}
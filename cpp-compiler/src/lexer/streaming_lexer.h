@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include "lexer.h"
+
+// Pull-based lexer over a file descriptor or stream, for sources too large
+// to hold (or arriving on a pipe). Input is read in fixed-size chunks into
+// one buffer and tokens are handed out one at a time, so memory stays at a
+// chunk plus the longest token however long the input is.
+//
+// A token cut by the end of a chunk is lexed again once the next chunk is
+// in: the bytes still needed are moved to the front of the buffer before
+// reading, and the buffer only grows when a single token (a long string
+// literal, say) fills it. Comments and whitespace are skipped as they are
+// read and never held.
+class StreamingLexer {
+public:
+    static const size_t kDefaultChunkSize = 64 * 1024;
+
+    // Reads `fd` up to end of file; the descriptor is not closed
+    explicit StreamingLexer(int fd, size_t chunkSize = kDefaultChunkSize);
+    explicit StreamingLexer(std::istream& in, size_t chunkSize = kDefaultChunkSize);
+    StreamingLexer(const StreamingLexer&) = delete;
+    StreamingLexer& operator=(const StreamingLexer&) = delete;
+
+    // The next token, or END_OF_FILE (again on every later call) once the
+    // input is used up. The token returned and the one before it, lexemes
+    // included, stay valid until the following call. Throws
+    // std::runtime_error when the input cannot be read.
+    const Token& next();
+
+    // Bytes of buffer currently held
+    size_t bufferSize() const { return capacity; }
+
+private:
+    void refill();
+    size_t read(char* to, size_t bytes);
+
+    int fd = -1;
+    std::istream* in = nullptr;
+    std::unique_ptr<char[]> buffer;
+    size_t capacity;
+    size_t filled = 0;
+    bool endOfInput = false;
+
+    Lexer lexer;
+    // The last two tokens handed out; `window[newest]` is the latest
+    Token window[2] = {Token(TokenType::END_OF_FILE, ""), Token(TokenType::END_OF_FILE, "")};
+    int newest = 0;
+};
@@ -1,319 +1,359 @@
-// === MyOwnCompiler — Minimal End‑to‑End (header‑only) ===
-// Files below are header-only so you can compile main.cpp quickly.
-// Supports: identifiers, integers, assignments, +, *, ; and multi-line input.
-// Extend later to add types, control flow, etc.
+// === MyOwnCompiler driver ===
+//
+//   mycompiler [--vm=stack|register] [--jit|--tiered|--compact] [--dump]
+//              [--profile[=out.json]] [--trace[=trace.bin]]
+//              [--emit-bytecode[=out.mcbc]] [--stream]
+//              <source-file | program.mcbc>
+//
+// Runs the full pipeline (lexer -> parser -> semantic analysis -> codegen ->
+// assembler -> VM) on a source file and prints the final value of every
+// variable, after anything its print(...) statements wrote. --emit-bytecode
+// stops after the assembler and writes a .mcbc file instead (default: the
+// source path with a .mcbc extension); passing a .mcbc file runs it
+// directly on the stack VM, skipping the whole front end.
+// --vm selects the stack VM (default) or the register VM backend;
+// --jit runs the stack VM program as native code where supported; --tiered
+// interprets first and switches hot loops and functions to native code;
+// --compact runs the stack VM program in the variable-length encoding;
+// --dump also prints tokens, intermediate code and VM instructions.
+// --stream reads the source in chunks as the parser asks for tokens instead
+// of mapping it whole, for pipes and very large generated sources (no
+// token dump: tokens are not kept).
+// --profile (builds with MYCOMPILER_PROFILE only) prints the stack VM's
+// per-opcode profile and writes it as JSON (default: profile.json).
+// --trace records the stack VM's last steps and dumps them (default:
+// trace.bin) when the run ends or fails, and on SIGUSR1; decode the dump
+// with trace_decode.
 
-/* =========================
-   File: lexer.h
-   ========================= */
-#pragma once
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
-#include <cctype>
 
-enum class TokenType {
-    Identifier, Number,
-    Assign, Plus, Star, Semicolon,
-    End,
-};
+#include "lexer.h"
+#include "parallel_lexer.h"
+#include "streaming_lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include "codegen.h"
+#include "assembler.h"
+#include "bytecode_file.h"
+#include "vm.h"
+#include "regvm.h"
 
-struct Token {
-    TokenType type{};
-    std::string lexeme;
-    int line = 1;
-    int col = 1;
+namespace {
+
+struct Options {
+    std::string sourcePath;
+    bool registerVM = false;
+    bool jit = false;
+    bool tiered = false;
+    bool compact = false;
+    bool dump = false;
+    bool emitBytecode = false;
+    std::string bytecodePath;   // --emit-bytecode=<path>; empty means derived
+    bool profile = false;
+    std::string profilePath = "profile.json";
+    bool trace = false;
+    std::string tracePath = "trace.bin";
+    bool stream = false;
 };
 
-class Lexer {
-    std::string src;
-    size_t i = 0; int line = 1, col = 1;
-public:
-    explicit Lexer(const std::string& s) : src(s) {}
+bool hasSuffix(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() &&
+           text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
 
-    std::vector<Token> tokenize() {
-        std::vector<Token> out;
-        while (true) {
-            skipWS();
-            if (i >= src.size()) { out.push_back({TokenType::End, "", line, col}); break; }
-            char c = src[i];
-            if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
-                size_t start = i; int l=line, cc=col;
-                while (i<src.size() && (std::isalnum(static_cast<unsigned char>(src[i])) || src[i]=='_')) advance();
-                out.push_back({TokenType::Identifier, src.substr(start, i-start), l, cc});
-            } else if (std::isdigit(static_cast<unsigned char>(c))) {
-                size_t start = i; int l=line, cc=col;
-                while (i<src.size() && std::isdigit(static_cast<unsigned char>(src[i]))) advance();
-                out.push_back({TokenType::Number, src.substr(start, i-start), l, cc});
-            } else {
-                int l=line, cc=col;
-                switch (c) {
-                    case '=': advance(); out.push_back({TokenType::Assign, "=", l, cc}); break;
-                    case '+': advance(); out.push_back({TokenType::Plus, "+", l, cc}); break;
-                    case '*': advance(); out.push_back({TokenType::Star, "*", l, cc}); break;
-                    case ';': advance(); out.push_back({TokenType::Semicolon, ";", l, cc}); break;
-                    default: // skip unknowns
-                        advance(); break;
-                }
-            }
+std::string defaultBytecodePath(const std::string& sourcePath) {
+    size_t dot = sourcePath.find_last_of('.');
+    size_t slash = sourcePath.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return sourcePath + ".mcbc";
+    return sourcePath.substr(0, dot) + ".mcbc";
+}
+
+void printUsage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [--vm=stack|register] [--jit|--tiered|--compact] [--dump]"
+              << " [--profile[=out.json]] [--trace[=trace.bin]] [--emit-bytecode[=out.mcbc]] [--stream]"
+              << " <source-file | program.mcbc>\n";
+}
+
+bool parseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--vm=stack") {
+            options.registerVM = false;
+        } else if (arg == "--vm=register") {
+            options.registerVM = true;
+        } else if (arg == "--jit") {
+            options.jit = true;
+        } else if (arg == "--tiered") {
+            options.tiered = true;
+        } else if (arg == "--compact") {
+            options.compact = true;
+        } else if (arg == "--dump") {
+            options.dump = true;
+        } else if (arg == "--stream") {
+            options.stream = true;
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg.compare(0, 10, "--profile=") == 0) {
+            options.profile = true;
+            options.profilePath = arg.substr(10);
+        } else if (arg == "--trace") {
+            options.trace = true;
+        } else if (arg.compare(0, 8, "--trace=") == 0) {
+            options.trace = true;
+            options.tracePath = arg.substr(8);
+        } else if (arg == "--emit-bytecode") {
+            options.emitBytecode = true;
+        } else if (arg.compare(0, 16, "--emit-bytecode=") == 0) {
+            options.emitBytecode = true;
+            options.bytecodePath = arg.substr(16);
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        } else {
+            options.sourcePath = arg;
         }
-        return out;
     }
-private:
-    void advance(){ if (i<src.size()) { if (src[i]=='\n'){line++; col=1;} else col++; i++; } }
-    void skipWS(){ while (i<src.size() && std::isspace(static_cast<unsigned char>(src[i]))) advance(); }
-};
+    return !options.sourcePath.empty();
+}
 
-/* =========================
-   File: parser.h
-   ========================= */
-#pragma once
-#include <memory>
-#include <stdexcept>
+// Variables in slot order, so output is stable across runs
+std::vector<std::string> variablesBySlot(const std::unordered_map<std::string, Symbol>& symbols) {
+    std::vector<const Symbol*> sorted;
+    for (const auto& entry : symbols) sorted.push_back(&entry.second);
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Symbol* a, const Symbol* b) { return a->slot < b->slot; });
+    std::vector<std::string> names;
+    for (const Symbol* sym : sorted) names.push_back(sym->name);
+    return names;
+}
 
-struct Expr { virtual ~Expr()=default; };
-struct NumberExpr : Expr { int value; explicit NumberExpr(int v):value(v){} };
-struct VarExpr    : Expr { std::string name; explicit VarExpr(std::string n):name(std::move(n)){} };
-struct BinaryExpr : Expr {
-    char op; std::unique_ptr<Expr> lhs, rhs;
-    BinaryExpr(char o, std::unique_ptr<Expr> L, std::unique_ptr<Expr> R)
-        : op(o), lhs(std::move(L)), rhs(std::move(R)) {}
-};
+void configure(VirtualMachine& vm, const Options& options) {
+    if (options.jit) vm.setExecutionMode(ExecutionMode::Jit);
+    if (options.tiered) vm.setExecutionMode(ExecutionMode::Tiered);
+    if (options.trace) {
+        vm.setTracing(true);
+        vm.setTraceDumpPath(options.tracePath);
+        TraceRing::installSignalHandler(*vm.getTrace(), SIGUSR1, options.tracePath);
+    }
+}
 
-struct Stmt { virtual ~Stmt()=default; };
-struct AssignStmt : Stmt { std::string name; std::unique_ptr<Expr> value; };
+// The failure path is covered by the VM itself (setTraceDumpPath)
+void dumpTrace(const VirtualMachine& vm, const Options& options) {
+    if (!options.trace) return;
+    vm.getTrace()->dumpToFile(options.tracePath);
+    std::cout << "\nTrace written to " << options.tracePath << "\n";
+}
 
-struct ProgramAST { std::vector<std::unique_ptr<Stmt>> stmts; };
+void printFinalState(const VirtualMachine& vm, const std::vector<std::string>& variables) {
+    std::cout << "\n[Final State]\n";
+    for (const auto& name : variables) {
+        if (!name.empty()) std::cout << name << " = " << vm.getVariable(name) << "\n";
+    }
+}
 
-class Parser {
-    const std::vector<Token>& toks; size_t p=0;
-public:
-    explicit Parser(const std::vector<Token>& t):toks(t){}
+void writeProfile(const VirtualMachine& vm, const Options& options) {
+#if MYCOMPILER_PROFILE
+    if (!options.profile) return;
+    std::cout << "\n";
+    vm.getProfiler().writeReport(std::cout);
+    std::ofstream json(options.profilePath);
+    if (!json) throw std::runtime_error("Cannot write " + options.profilePath);
+    vm.getProfiler().writeJson(json);
+    std::cout << "\nProfile written to " << options.profilePath << "\n";
+#else
+    (void)vm;
+    (void)options;
+#endif
+}
 
-    ProgramAST parseProgram(){
-        ProgramAST prog; 
-        while (!check(TokenType::End)) {
-            prog.stmts.push_back(parseStmt());
-        }
-        return prog;
+// Precompiled program: map it and run, no front end involved
+int runBytecodeFile(const Options& options) {
+    if (options.registerVM || options.emitBytecode) {
+        std::cerr << "A .mcbc file can only be run on the stack VM\n";
+        return 2;
     }
-private:
-    bool check(TokenType t) const { return toks[p].type==t; }
-    const Token& peek() const { return toks[p]; }
-    const Token& advance(){ if (!check(TokenType::End)) p++; return toks[p-1]; }
-    const Token& expect(TokenType t, const char* what){ if (!check(t)) error(std::string("expected ")+what); return advance(); }
-    [[noreturn]] void error(const std::string& msg) const { throw std::runtime_error(msg+" at line "+std::to_string(peek().line)); }
-
-    std::unique_ptr<Stmt> parseStmt(){
-        // assignment: Identifier '=' expr ';'
-        if (!check(TokenType::Identifier)) error("statement must start with identifier");
-        auto name = peek().lexeme; advance();
-        expect(TokenType::Assign, "'='");
-        auto value = parseExpr();
-        expect(TokenType::Semicolon, "';'");
-        auto s = std::make_unique<AssignStmt>(); s->name = name; s->value = std::move(value); return s;
+    try {
+        std::unique_ptr<BytecodeFile> file = BytecodeFile::open(options.sourcePath);
+        VirtualMachine vm;
+        configure(vm, options);
+        // The VM writes PRINT output to fd 1 itself; keep it after ours
+        std::cout.flush();
+        vm.execute(*file);
+        printFinalState(vm, file->slotNames());
+        writeProfile(vm, options);
+        dumpTrace(vm, options);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
+    return 0;
+}
 
-    // E -> T ( '+' T )*
-    std::unique_ptr<Expr> parseExpr(){
-        auto lhs = parseTerm();
-        while (check(TokenType::Plus)) { advance(); auto rhs = parseTerm(); lhs = std::make_unique<BinaryExpr>('+', std::move(lhs), std::move(rhs)); }
-        return lhs;
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArgs(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 2;
     }
-    // T -> P ( '*' P )*
-    std::unique_ptr<Expr> parseTerm(){
-        auto lhs = parsePrimary();
-        while (check(TokenType::Star)) { advance(); auto rhs = parsePrimary(); lhs = std::make_unique<BinaryExpr>('*', std::move(lhs), std::move(rhs)); }
-        return lhs;
+    if (options.profile && !VirtualMachine::hasProfiler()) {
+        std::cerr << "--profile needs a build configured with -DMYCOMPILER_PROFILE=ON\n";
+        return 2;
     }
-    // P -> Number | Identifier
-    std::unique_ptr<Expr> parsePrimary(){
-        if (check(TokenType::Number)) { int v = std::stoi(peek().lexeme); advance(); return std::make_unique<NumberExpr>(v); }
-        if (check(TokenType::Identifier)) { auto n = peek().lexeme; advance(); return std::make_unique<VarExpr>(n); }
-        error("expected number or identifier");
+    if (options.compact && (options.registerVM || options.jit || options.tiered || options.trace ||
+                            options.profile || options.emitBytecode || hasSuffix(options.sourcePath, ".mcbc"))) {
+        std::cerr << "--compact runs a compiled source on the stack VM interpreter only\n";
+        return 2;
+    }
+    if (hasSuffix(options.sourcePath, ".mcbc")) return runBytecodeFile(options);
+    if (options.emitBytecode && options.registerVM) {
+        std::cerr << "--emit-bytecode supports the stack VM only\n";
+        return 2;
     }
-};
-
-/* =========================
-   File: semantic.h
-   ========================= */
-#pragma once
-#include <unordered_map>
-#include <string>
-
-class SymbolTable {
-    std::unordered_map<std::string,int> table;
-public:
-    bool declared(const std::string& n) const { return table.count(n)>0; }
-    void set(const std::string& n, int v){ table[n]=v; }
-    int get(const std::string& n) const { auto it=table.find(n); return it==table.end()?0:it->second; }
-};
-
-class SemanticAnalyzer {
-    std::vector<std::string> errors; SymbolTable sym;
-public:
-    void analyze(const ProgramAST& prog){ (void)prog; /* trivial for now */ }
-    const std::vector<std::string>& getErrors() const { return errors; }
-    SymbolTable& getSymbolTable(){ return sym; }
-};
-
-/* =========================
-   File: codegen.h
-   ========================= */
-#pragma once
-#include <string>
-
-enum class OpCode { LDC=0, LDV=1, ADD=2, MUL=3, STV=4 };
 
-struct IRInstr {
-    OpCode opcode{}; std::string operand1; std::string operand2; // strings for easy printing
-};
+    std::unique_ptr<ASTNode> ast;
+    if (options.stream) {
+        std::ifstream in(options.sourcePath, std::ios::binary);
+        if (!in) {
+            std::cerr << "Cannot open " << options.sourcePath << "\n";
+            return 1;
+        }
+        try {
+            StreamingLexer lexer(in);
+            Parser parser(lexer);
+            ast = parser.parseProgram();
+            if (parser.hadErrors()) return 1;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    } else {
+        // Mapped, not read: tokens point into it while the parser runs
+        std::unique_ptr<SourceBuffer> source;
+        try {
+            source = SourceBuffer::open(options.sourcePath);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
 
-class CodeGenerator {
-    std::vector<IRInstr> ir;
-    SymbolTable* sym = nullptr;
-public:
-    void setSymbolTable(SymbolTable* s){ sym = s; }
+        // Large sources are lexed on every core
+        ParallelLexer lexer(*source);
+        auto tokens = lexer.tokenize();
 
-    void generate(const ProgramAST& prog){
-        for (const auto& st : prog.stmts) genStmt(*st);
-    }
-    const std::vector<IRInstr>& getInstructions() const { return ir; }
-private:
-    void genStmt(const Stmt& s){
-        if (auto as = dynamic_cast<const AssignStmt*>(&s)) {
-            genExpr(*as->value);
-            ir.push_back({OpCode::STV, as->name, ""});
+        if (options.dump) {
+            std::cout << "[Tokens]" << std::endl;
+            for (const auto& token : tokens) {
+                std::cout << token.lexeme << "  [" << static_cast<int>(token.type) << "]\n";
+            }
         }
+
+        Parser parser(tokens);
+        ast = parser.parseProgram();
+        // Never compile, emit or run a program with statements missing
+        if (parser.hadErrors()) return 1;
     }
-    void genExpr(const Expr& e){
-        if (auto n = dynamic_cast<const NumberExpr*>(&e)) {
-            ir.push_back({OpCode::LDC, std::to_string(n->value), ""});
-        } else if (auto v = dynamic_cast<const VarExpr*>(&e)) {
-            ir.push_back({OpCode::LDV, v->name, ""});
-        } else if (auto b = dynamic_cast<const BinaryExpr*>(&e)) {
-            genExpr(*b->lhs); genExpr(*b->rhs);
-            if (b->op=='+') ir.push_back({OpCode::ADD, "", ""});
-            else if (b->op=='*') ir.push_back({OpCode::MUL, "", ""});
-        }
+
+    SemanticAnalyzer sema;
+    sema.analyze(ast);
+    const auto& errors = sema.getErrors();
+    if (!errors.empty()) {
+        std::cerr << "\nSemantic Errors:\n";
+        for (const auto& err : errors) std::cerr << "  -> " << err << std::endl;
+        return 1;
     }
-};
 
-/* =========================
-   File: assembler.h
-   ========================= */
-#pragma once
+    CodeGenerator codegen;
+    codegen.setSymbolTable(&sema.getSymbolTable());
+    Assembler assembler;
+    std::vector<std::string> variables = variablesBySlot(sema.getSymbolTable());
 
-enum class VMOp { PUSH=0, LOAD=1, ADD=2, MUL=3, STORE=4 };
+    try {
+        if (options.registerVM) {
+            codegen.generateThreeAddress(ast);
+            const auto& tac = codegen.getThreeAddressCode();
+            if (options.dump) {
+                std::cout << "\n[Three-Address Code]\n";
+                for (const auto& instr : tac) {
+                    std::cout << instr.result << " = " << static_cast<int>(instr.opcode) << " "
+                              << instr.arg1 << " " << instr.arg2 << "\n";
+                }
+            }
 
-struct VMInstr { VMOp opcode{}; std::string operand1; std::string operand2; };
+            assembler.assembleRegister(tac);
+            const RegisterProgram& program = assembler.getRegisterProgram();
+            if (options.dump) {
+                std::cout << "\n[Register VM Instructions] " << program.code.size() << "\n";
+                for (const auto& instr : program.code) {
+                    std::cout << static_cast<int>(instr.opcode) << " r" << instr.dst
+                              << " r" << instr.a << " r" << instr.b << "\n";
+                }
+            }
 
-class Assembler {
-    std::vector<VMInstr> code;
-public:
-    void assemble(const std::vector<IRInstr>& ir){
-        code.clear();
-        for (const auto& ins : ir) {
-            switch (ins.opcode) {
-                case OpCode::LDC:  code.push_back({VMOp::PUSH, ins.operand1, ""}); break;
-                case OpCode::LDV:  code.push_back({VMOp::LOAD, ins.operand1, ""}); break;
-                case OpCode::ADD:  code.push_back({VMOp::ADD,  "", ""}); break;
-                case OpCode::MUL:  code.push_back({VMOp::MUL,  "", ""}); break;
-                case OpCode::STV:  code.push_back({VMOp::STORE, ins.operand1, ""}); break;
+            RegisterVM vm;
+            vm.execute(program);
+            std::cout << "\n[Final State]\n";
+            for (const auto& name : variables) std::cout << name << " = " << vm.getVariable(name) << "\n";
+        } else {
+            codegen.generate(ast);
+            const auto& ir = codegen.getInstructions();
+            if (options.dump) {
+                std::cout << "\n[Intermediate Code]\n";
+                for (const auto& instr : ir) {
+                    std::cout << static_cast<int>(instr.opcode) << " " << instr.operand1 << " " << instr.operand2 << "\n";
+                }
             }
-        }
-    }
-    const std::vector<VMInstr>& getVMInstructions() const { return code; }
-};
 
-/* =========================
-   File: vm.h
-   ========================= */
-#pragma once
-#include <unordered_map>
-#include <stack>
-#include <iostream>
+            assembler.assemble(ir);
+            if (options.dump) {
+                // The fused program the VM runs, not the assembler's input
+                const BytecodeProgram& bytecode = assembler.getBytecode();
+                std::cout << "\n[VM Instructions] " << bytecode.code.size() << "\n";
+                for (size_t ip = 0; ip < bytecode.code.size(); ++ip) {
+                    std::cout << ip << ": " << disassemble(bytecode.code[ip], bytecode.slotNames, &bytecode.constants)
+                              << "\n";
+                }
+            }
 
-class VirtualMachine {
-    std::vector<VMInstr> program;
-    std::stack<int> st;
-    std::unordered_map<std::string,int> vars;
-public:
-    void execute(const std::vector<VMInstr>& code){
-        program = code;
-        for (const auto& ins : program) {
-            switch (ins.opcode) {
-                case VMOp::PUSH: st.push(std::stoi(ins.operand1)); break;
-                case VMOp::LOAD: st.push(getVariable(ins.operand1)); break;
-                case VMOp::ADD:  { int b=pop(), a=pop(); st.push(a+b); } break;
-                case VMOp::MUL:  { int b=pop(), a=pop(); st.push(a*b); } break;
-                case VMOp::STORE:{ int v=pop(); vars[ins.operand1]=v; } break;
+            if (options.emitBytecode) {
+                std::string path = options.bytecodePath.empty() ? defaultBytecodePath(options.sourcePath)
+                                                                : options.bytecodePath;
+                writeBytecodeFile(path, assembler.getBytecode());
+                std::cout << "Wrote " << path << " (" << assembler.getBytecode().code.size()
+                          << " instructions)\n";
+                return 0;
             }
-        }
-    }
 
-    int getVariable(const std::string& name) const {
-        auto it = vars.find(name); return it==vars.end()?0:it->second;
+            VirtualMachine vm;
+            if (options.compact) {
+                CompactProgram compact = encodeCompact(assembler.getBytecode());
+                if (options.dump) {
+                    std::cout << "\n[Compact Code] " << compact.code.size() << " bytes, "
+                              << compact.instructionCount << " instructions\n";
+                }
+                std::cout.flush();
+                vm.execute(compact);
+                printFinalState(vm, variables);
+                return 0;
+            }
+            configure(vm, options);
+            std::cout.flush();
+            vm.execute(assembler.getBytecode());
+            printFinalState(vm, variables);
+            writeProfile(vm, options);
+            dumpTrace(vm, options);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
-private:
-    int pop(){ int v=st.top(); st.pop(); return v; }
-};
-
-/* =========================
-   File: main.cpp (your snippet)
-   ========================= */
-// #include <iostream>
-// #include <string>
-// #include <fstream>
-// #include <sstream>
-//
-// #include "lexer.h"
-// #include "parser.h"
-// #include "semantic.h"
-// #include "codegen.h"
-// #include "assembler.h"
-// #include "vm.h"
-//
-// int main() {
-//     std::string sourceCode = "a = 5 + 3;\nb = a * 2;";
-//
-//     Lexer lexer(sourceCode);
-//     auto tokens = lexer.tokenize();
-//
-//     std::cout << "[Tokens]" << std::endl;
-//     for (const auto& token : tokens) {
-//         std::cout << token.lexeme << "  [" << static_cast<int>(token.type) << "]\n";
-//     }
-//
-//     Parser parser(tokens);
-//     auto ast = parser.parseProgram();
-//
-//     SemanticAnalyzer sema;
-//     sema.analyze(ast);
-//     const auto& errors = sema.getErrors();
-//     if (!errors.empty()) {
-//         std::cerr << "\nSemantic Errors:\n";
-//         for (const auto& err : errors) std::cerr << "  ➜ " << err << std::endl;
-//         return 1;
-//     }
-//
-//     CodeGenerator codegen; codegen.setSymbolTable(&sema.getSymbolTable());
-//     codegen.generate(ast);
-//     const auto& ir = codegen.getInstructions();
-//
-//     std::cout << "\n[Intermediate Code]\n";
-//     for (const auto& instr : ir) {
-//         std::cout << static_cast<int>(instr.opcode) << " " << instr.operand1 << " " << instr.operand2 << "\n";
-//     }
-//
-//     Assembler assembler; assembler.assemble(ir); const auto& vmCode = assembler.getVMInstructions();
-//     std::cout << "\n[VM Instructions]\n";
-//     for (const auto& instr : vmCode) {
-//         std::cout << static_cast<int>(instr.opcode) << " " << instr.operand1 << " " << instr.operand2 << "\n";
-//     }
-//
-//     VirtualMachine vm; vm.execute(vmCode);
-//     std::cout << "\n[Final State]\n";
-//     std::cout << "a = " << vm.getVariable("a") << "\n";
-//     std::cout << "b = " << vm.getVariable("b") << "\n";
-//     return 0;
-// }
+    return 0;
+}
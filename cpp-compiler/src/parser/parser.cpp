@@ -3,19 +3,28 @@
 #include <iostream>
 
 // ---------------- Constructor ----------------
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), current(0) {}
+Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), current(0) {
+    currentToken = previousToken = this->tokens.data();
+}
+
+Parser::Parser(StreamingLexer& lexer) : stream(&lexer) {
+    currentToken = previousToken = &lexer.next();
+}
 
 // ---------------- Utility Functions ----------------
 const Token& Parser::peek() const {
-    return tokens[current];
+    return *currentToken;
 }
 
 const Token& Parser::previous() const {
-    return tokens[current - 1];
+    return *previousToken;
 }
 
 const Token& Parser::advance() {
-    if (!isAtEnd()) current++;
+    if (!isAtEnd()) {
+        previousToken = currentToken;
+        currentToken = stream ? &stream->next() : &tokens[++current];
+    }
     return previous();
 }
 
@@ -36,6 +45,14 @@ bool Parser::match(TokenType type) {
     return false;
 }
 
+bool Parser::matchPunctuation(const std::string& symbol) {
+    if (peek().type == TokenType::PUNCTUATION && peek().lexeme == symbol) {
+        advance();
+        return true;
+    }
+    return false;
+}
+
 bool Parser::matchOperator(const std::string& op) {
     if (peek().type == TokenType::OPERATOR && peek().lexeme == op) {
         advance();
@@ -46,14 +63,14 @@ bool Parser::matchOperator(const std::string& op) {
 
 const Token& Parser::consume(TokenType expected, const std::string& errorMessage) {
     if (check(expected)) return advance();
-    throw std::runtime_error("Parse error at '" + peek().lexeme + "': " + errorMessage);
+    throw std::runtime_error("Parse error at '" + std::string(peek().lexeme) + "': " + errorMessage);
 }
 
 // ---------------- Error Recovery ----------------
 void Parser::synchronize() {
     advance();
     while (!isAtEnd()) {
-        if (previous().type == TokenType::SEMICOLON) return;
+        if (previous().type == TokenType::PUNCTUATION && previous().lexeme == ";") return;
         switch (peek().type) {
             case TokenType::KEYWORD:
             case TokenType::IDENTIFIER:
@@ -76,6 +93,7 @@ std::unique_ptr<ProgramNode> Parser::parseProgram() {
             if (decl) program->statements.push_back(std::move(decl));
         } catch (const std::exception& e) {
             std::cerr << e.what() << std::endl;
+            ++errorCount;
             synchronize();
         }
     }
@@ -84,13 +102,33 @@ std::unique_ptr<ProgramNode> Parser::parseProgram() {
 
 // ---------------- Grammar Rules ----------------
 std::unique_ptr<ASTNode> Parser::parseDeclaration() {
-    // For now, treat every top-level as a statement
+    // For now, treat every top-level as a statement; a leading type keyword
+    // ("int x = 5;") is accepted and the declaration parsed as an assignment
+    if (check(TokenType::KEYWORD) &&
+        (peek().lexeme == "int" || peek().lexeme == "float" || peek().lexeme == "char" ||
+         peek().lexeme == "bool")) {
+        advance();
+    }
     return parseStatement();
 }
 
 std::unique_ptr<ASTNode> Parser::parseStatement() {
     // Extend later for if, while, etc.
-    return parseExpression();
+    if (check(TokenType::KEYWORD) && peek().lexeme == "print") {
+        advance();
+        if (!matchPunctuation("(")) {
+            throw std::runtime_error("Parse error at '" + std::string(peek().lexeme) + "': Expect '(' after print.");
+        }
+        auto value = parseExpression();
+        if (!matchPunctuation(")")) {
+            throw std::runtime_error("Parse error at '" + std::string(peek().lexeme) + "': Expect ')' after print value.");
+        }
+        matchPunctuation(";");
+        return std::make_unique<PrintNode>(std::move(value));
+    }
+    auto stmt = parseExpression();
+    matchPunctuation(";");
+    return stmt;
 }
 
 std::unique_ptr<ASTNode> Parser::parseExpression() {
@@ -102,7 +140,7 @@ std::unique_ptr<ASTNode> Parser::parseAssignment() {
 
     if (matchOperator("=")) {
         auto value = parseAssignment();
-        return std::make_unique<BinaryNode>("=", std::move(expr), std::move(value));
+        return std::make_unique<AssignmentNode>(std::move(expr), std::move(value));
     }
     return expr;
 }
@@ -111,9 +149,9 @@ std::unique_ptr<ASTNode> Parser::parseEquality() {
     auto expr = parseComparison();
 
     while (matchOperator("==") || matchOperator("!=")) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseComparison();
-        expr = std::make_unique<BinaryNode>(op, std::move(expr), std::move(right));
+        expr = std::make_unique<BinaryOpNode>(op, std::move(expr), std::move(right));
     }
     return expr;
 }
@@ -122,9 +160,9 @@ std::unique_ptr<ASTNode> Parser::parseComparison() {
     auto expr = parseTerm();
 
     while (matchOperator("<") || matchOperator(">") || matchOperator("<=") || matchOperator(">=")) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseTerm();
-        expr = std::make_unique<BinaryNode>(op, std::move(expr), std::move(right));
+        expr = std::make_unique<BinaryOpNode>(op, std::move(expr), std::move(right));
     }
     return expr;
 }
@@ -133,9 +171,9 @@ std::unique_ptr<ASTNode> Parser::parseTerm() {
     auto expr = parseFactor();
 
     while (matchOperator("+") || matchOperator("-")) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseFactor();
-        expr = std::make_unique<BinaryNode>(op, std::move(expr), std::move(right));
+        expr = std::make_unique<BinaryOpNode>(op, std::move(expr), std::move(right));
     }
     return expr;
 }
@@ -144,36 +182,42 @@ std::unique_ptr<ASTNode> Parser::parseFactor() {
     auto expr = parseUnary();
 
     while (matchOperator("*") || matchOperator("/")) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseUnary();
-        expr = std::make_unique<BinaryNode>(op, std::move(expr), std::move(right));
+        expr = std::make_unique<BinaryOpNode>(op, std::move(expr), std::move(right));
     }
     return expr;
 }
 
 std::unique_ptr<ASTNode> Parser::parseUnary() {
     if (matchOperator("!") || matchOperator("-")) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseUnary();
-        return std::make_unique<UnaryNode>(op, std::move(right));
+        return std::make_unique<UnaryOpNode>(op, std::move(right));
     }
     return parsePrimary();
 }
 
 std::unique_ptr<ASTNode> Parser::parsePrimary() {
     if (match(TokenType::NUMBER)) {
-        return std::make_unique<NumberNode>(previous().lexeme);
+        return std::make_unique<NumberLiteralNode>(std::string(previous().lexeme));
     }
 
     if (match(TokenType::IDENTIFIER)) {
-        return std::make_unique<IdentifierNode>(previous().lexeme);
+        return std::make_unique<IdentifierNode>(std::string(previous().lexeme));
+    }
+
+    if (match(TokenType::STRING_LITERAL)) {
+        return std::make_unique<StringLiteralNode>(std::string(previous().lexeme));
     }
 
-    if (match(TokenType::LEFT_PAREN)) {
+    if (matchPunctuation("(")) {
         auto expr = parseExpression();
-        consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
+        if (!matchPunctuation(")")) {
+            throw std::runtime_error("Parse error at '" + std::string(peek().lexeme) + "': Expect ')' after expression.");
+        }
         return expr;
     }
 
-    throw std::runtime_error("Unexpected token: " + peek().lexeme);
+    throw std::runtime_error("Unexpected token: " + std::string(peek().lexeme));
 }
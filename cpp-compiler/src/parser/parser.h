@@ -3,6 +3,7 @@
 #include <vector>
 #include <memory>
 #include "lexer.h"
+#include "streaming_lexer.h"
 #include "ast.h"
 
 // Forward declarations for top-level AST nodes if needed
@@ -12,9 +13,17 @@ class ProgramNode;
 class Parser {
 public:
     explicit Parser(const std::vector<Token>& tokens);
-
-    // Entry point for parsing
+    // Pulls tokens from `lexer` one at a time as parsing goes, holding only
+    // the current and the previous one
+    explicit Parser(StreamingLexer& lexer);
+    Parser(const Parser&) = delete;
+    Parser& operator=(const Parser&) = delete;
+
+    // Entry point for parsing. Syntax errors are reported on stderr and
+    // skipped past, so one run finds them all; the tree then lacks the
+    // broken statements and must not be compiled.
     std::unique_ptr<ProgramNode> parseProgram();
+    bool hadErrors() const { return errorCount > 0; }
 
 private:
     const Token& peek() const;
@@ -23,6 +32,7 @@ private:
     const Token& consume(TokenType expected, const std::string& errorMessage);
     bool match(TokenType type);
     bool matchOperator(const std::string& op);
+    bool matchPunctuation(const std::string& symbol);
     bool check(TokenType type) const;
     bool isAtEnd() const;
 
@@ -42,4 +52,8 @@ private:
 
     std::vector<Token> tokens;
     size_t current = 0;
+    StreamingLexer* stream = nullptr;   // null: tokens come from `tokens`
+    const Token* currentToken = nullptr;
+    const Token* previousToken = nullptr;
+    size_t errorCount = 0;
 };
@@ -0,0 +1,96 @@
+#include "regvm.h"
+#include "value.h"
+#include <stdexcept>
+
+RegisterVM::RegisterVM() = default;
+
+void RegisterVM::execute(const RegisterProgram& program) {
+    const size_t named = program.registerNames.size();
+    registers.assign(named + program.constants.size(), 0);
+    for (size_t i = 0; i < program.constants.size(); ++i) {
+        registers[named + i] = program.constants[i];
+    }
+    registerByName.clear();
+    for (size_t i = 0; i < named; ++i) {
+        registerByName.emplace(program.registerNames[i], i);
+    }
+    // Programs are straight-line, so the last instruction writing a register
+    // decides whether it ends up holding a comparison result
+    holdsBool.assign(registers.size(), false);
+    for (const RegInstruction& instr : program.code) {
+        switch (instr.opcode) {
+            case RegOpCode::REG_HALT:
+                break;
+            case RegOpCode::REG_MOV:
+                holdsBool[instr.dst] = holdsBool[instr.a];
+                break;
+            case RegOpCode::REG_CMP_EQ:
+            case RegOpCode::REG_CMP_NE:
+            case RegOpCode::REG_CMP_LT:
+            case RegOpCode::REG_CMP_LE:
+            case RegOpCode::REG_CMP_GT:
+            case RegOpCode::REG_CMP_GE:
+                holdsBool[instr.dst] = true;
+                break;
+            default:
+                holdsBool[instr.dst] = false;
+                break;
+        }
+    }
+    if (program.code.empty()) return;
+    run(program.code.data());
+}
+
+void RegisterVM::run(const RegInstruction* code) {
+    const RegInstruction* pc = code;
+    int* r = registers.data();
+
+#if MYCOMPILER_HAS_COMPUTED_GOTO
+    static const void* const dispatchTable[] = {
+#define REG_OPCODE_LABEL(name) &&L_##name,
+        REG_OPCODE_LIST(REG_OPCODE_LABEL)
+#undef REG_OPCODE_LABEL
+    };
+#define REG_CASE(op) L_##op:
+#define REG_NEXT() ++pc; goto *dispatchTable[static_cast<uint8_t>(pc->opcode)]
+    goto *dispatchTable[static_cast<uint8_t>(pc->opcode)];
+#else
+#define REG_CASE(op) case RegOpCode::op:
+#define REG_NEXT() ++pc; continue
+    for (;;) switch (pc->opcode) {
+#endif
+
+    REG_CASE(REG_MOV)    { r[pc->dst] = r[pc->a];                   REG_NEXT(); }
+    REG_CASE(REG_ADD)    { r[pc->dst] = intAdd(r[pc->a], r[pc->b]); REG_NEXT(); }
+    REG_CASE(REG_SUB)    { r[pc->dst] = intSub(r[pc->a], r[pc->b]); REG_NEXT(); }
+    REG_CASE(REG_MUL)    { r[pc->dst] = intMul(r[pc->a], r[pc->b]); REG_NEXT(); }
+    REG_CASE(REG_DIV) {
+        // Wraps INT_MIN / -1 like the stack engines; only a zero divisor is an error
+        if (r[pc->b] == 0) throw std::runtime_error("VM: division by zero");
+        r[pc->dst] = intDiv(r[pc->a], r[pc->b]);
+        REG_NEXT();
+    }
+    REG_CASE(REG_NEG)    { r[pc->dst] = intNeg(r[pc->a]);           REG_NEXT(); }
+    REG_CASE(REG_CMP_EQ) { r[pc->dst] = r[pc->a] == r[pc->b] ? 1 : 0; REG_NEXT(); }
+    REG_CASE(REG_CMP_NE) { r[pc->dst] = r[pc->a] != r[pc->b] ? 1 : 0; REG_NEXT(); }
+    REG_CASE(REG_CMP_LT) { r[pc->dst] = r[pc->a] <  r[pc->b] ? 1 : 0; REG_NEXT(); }
+    REG_CASE(REG_CMP_LE) { r[pc->dst] = r[pc->a] <= r[pc->b] ? 1 : 0; REG_NEXT(); }
+    REG_CASE(REG_CMP_GT) { r[pc->dst] = r[pc->a] >  r[pc->b] ? 1 : 0; REG_NEXT(); }
+    REG_CASE(REG_CMP_GE) { r[pc->dst] = r[pc->a] >= r[pc->b] ? 1 : 0; REG_NEXT(); }
+    REG_CASE(REG_HALT)   { return; }
+
+#if !MYCOMPILER_HAS_COMPUTED_GOTO
+    }
+#endif
+#undef REG_CASE
+#undef REG_NEXT
+}
+
+Value RegisterVM::getVariable(const std::string& name) const {
+    auto it = registerByName.find(name);
+    if (it != registerByName.end()) {
+        const int value = registers[it->second];
+        return holdsBool[it->second] ? Value::boolean(value != 0) : Value::integer(value);
+    }
+    throw std::runtime_error("Variable not found: " + name);
+}
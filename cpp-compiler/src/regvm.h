@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "assembler.h"
+#include "vm.h"
+
+// Register-machine counterpart of VirtualMachine. Runs three-address code
+// assembled by Assembler::assembleRegister, so an expression like
+// `a = b + c * 3` is two dispatches instead of six stack operations.
+class RegisterVM {
+public:
+    RegisterVM();
+
+    void execute(const RegisterProgram& program);
+
+    // Comparison results come back as bools, like the stack VM's
+    Value getVariable(const std::string& name) const;
+
+private:
+    std::vector<int> registers;
+    std::vector<bool> holdsBool;
+    std::unordered_map<std::string, size_t> registerByName;
+
+    void run(const RegInstruction* code);
+};
@@ -0,0 +1,79 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+Scheduler::Scheduler(size_t threads, int64_t sliceBudget) : sliceBudget(sliceBudget) {
+    if (sliceBudget <= 0) throw std::runtime_error("Scheduler: slice budget must be positive");
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) workers.emplace_back(&Scheduler::workerLoop, this);
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    readySignal.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void Scheduler::submit(VirtualMachine& vm, Completion onDone) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(Task{&vm, std::move(onDone)});
+        ++pending;
+    }
+    readySignal.notify_one();
+}
+
+void Scheduler::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    doneSignal.wait(lock, [this] { return pending == 0; });
+    if (completionError) {
+        std::exception_ptr error = completionError;
+        completionError = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+// Queued VMs are still run to completion when stopping; the destructor only
+// returns once the queue is empty
+void Scheduler::workerLoop() {
+    for (;;) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            readySignal.wait(lock, [this] { return stopping || !ready.empty(); });
+            if (ready.empty()) return;
+            task = std::move(ready.front());
+            ready.pop_front();
+        }
+
+        RunStatus status = task.vm->run(sliceBudget);
+        slices.fetch_add(1, std::memory_order_relaxed);
+        if (status == RunStatus::Yielded) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ready.push_back(std::move(task));
+            }
+            readySignal.notify_one();
+            continue;
+        }
+
+        // An exception must not leave the thread (std::terminate) or skip
+        // the pending count, which wait() would then block on forever
+        std::exception_ptr error;
+        if (task.onDone) {
+            try {
+                task.onDone(*task.vm);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error && !completionError) completionError = error;
+        if (--pending == 0) doneSignal.notify_all();
+    }
+}
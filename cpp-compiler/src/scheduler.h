@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "vm.h"
+
+// Multiplexes many resumable VMs over a small pool of worker threads.
+//
+// Each submitted VM must already have a program load()ed. A worker takes
+// the VM at the front of the shared ready queue, runs it for one slice
+// (VirtualMachine::run with the slice budget) and, if it yielded, puts it
+// back at the end of the queue, so long-running programs cannot starve
+// short ones. A VM is only ever touched by one worker at a time, but may
+// move between workers from slice to slice. Once a VM finishes or fails
+// its completion callback runs on the worker that ran the last slice.
+
+class Scheduler {
+public:
+    typedef std::function<void(VirtualMachine&)> Completion;
+
+    static const int64_t kDefaultSliceBudget = 10000;
+
+    // threads == 0 uses one worker per hardware thread
+    explicit Scheduler(size_t threads = 0, int64_t sliceBudget = kDefaultSliceBudget);
+    ~Scheduler();
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    size_t threadCount() const { return workers.size(); }
+    int64_t getSliceBudget() const { return sliceBudget; }
+
+    // Queues a loaded VM. The VM (and the program it runs) must stay alive
+    // and untouched by the caller until its completion has run or wait()
+    // returns. May be called from any thread, including from a completion.
+    // A completion that throws does not take its worker down: the VM still
+    // counts as done and the exception is kept for wait().
+    void submit(VirtualMachine& vm, Completion onDone = Completion());
+
+    // Blocks until every submitted VM has finished or failed, then rethrows
+    // the first exception a completion threw since the last wait(), if any
+    void wait();
+
+    // Slices run since construction
+    uint64_t sliceCount() const { return slices.load(std::memory_order_relaxed); }
+
+private:
+    struct Task {
+        VirtualMachine* vm = nullptr;
+        Completion onDone;
+    };
+
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    const int64_t sliceBudget;
+    std::atomic<uint64_t> slices{0};
+
+    std::mutex mutex;
+    std::condition_variable readySignal;
+    std::condition_variable doneSignal;
+    std::deque<Task> ready;
+    size_t pending = 0;         // submitted and not yet completed
+    std::exception_ptr completionError;     // first exception from a completion
+    bool stopping = false;
+};
@@ -10,6 +10,7 @@ void SemanticAnalyzer::analyze(const std::unique_ptr<ASTNode>& root) {
     errors.clear();
     symbolTable.clear();
     scopeStack.clear();
+    nextSlot = 0;
     enterScope();
     visit(root.get());
     exitScope();
@@ -62,6 +63,8 @@ void SemanticAnalyzer::visit(const ASTNode* node) {
         visitAssignment(assign);
     } else if (auto ident = dynamic_cast<const IdentifierNode*>(node)) {
         visitIdentifier(ident);
+    } else if (auto print = dynamic_cast<const PrintNode*>(node)) {
+        visit(print->value.get());
     } else if (dynamic_cast<const NumberLiteralNode*>(node) ||
                dynamic_cast<const StringLiteralNode*>(node)) {
         visitLiteral(node);
@@ -85,7 +88,7 @@ void SemanticAnalyzer::visitAssignment(const AssignmentNode* assign) {
     // Declare if not already in the current scope
     if (!isDeclared(lhsIdent->name)) {
         declare(lhsIdent->name);
-        symbolTable[lhsIdent->name] = Symbol{lhsIdent->name, "unknown", false};
+        symbolTable[lhsIdent->name] = Symbol{lhsIdent->name, "unknown", false, nextSlot++};
     }
     visit(assign->rhs.get());
 }
@@ -12,6 +12,7 @@ struct Symbol {
     std::string name;
     std::string type;
     bool isFunction = false;
+    int slot = -1;  // dense global variable slot, assigned in declaration order
     // Add more metadata if needed (e.g., parameter list, scope level, etc.)
 };
 
@@ -39,6 +40,7 @@ private:
 
     std::unordered_map<std::string, Symbol> symbolTable;
     std::vector<std::unordered_set<std::string>> scopeStack;
+    int nextSlot = 0;
     std::vector<std::string> errors;
 
     void enterScope();
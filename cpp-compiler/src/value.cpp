@@ -0,0 +1,295 @@
+#include "value.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const uint64_t kCanonicalNaN = 0x7FF8000000000000ull;
+
+const uint32_t kPinned = UINT32_MAX;     // StringTable::owners: never freed
+const uint32_t kChunkBits = 16;
+const uint32_t kChunkSize = uint32_t(1) << kChunkBits;
+
+typedef std::atomic<const std::string*> StringSlot;
+
+// Process-wide intern table. Writers serialize on the mutex; asString reads
+// a handle's text through `chunks` without it. Chunks are never freed, and
+// a slot only changes while no live Value refers to its handle: when it is
+// first published, and when the last owner of the string lets go of it.
+// Map nodes do not move on rehash, so slots point at the keys.
+struct StringTable {
+    std::mutex mutex;
+    std::unordered_map<std::string, uint32_t> index;
+    std::vector<uint32_t> owners;       // per handle: StringOwners holding it, or kPinned
+    std::vector<uint32_t> freeHandles;  // handles of strings that went away
+    std::atomic<StringSlot*> chunks[size_t(1) << (32 - kChunkBits)];
+
+    const std::string* find(uint32_t handle) const {
+        const StringSlot* chunk = chunks[handle >> kChunkBits].load(std::memory_order_acquire);
+        return chunk ? chunk[handle & (kChunkSize - 1)].load(std::memory_order_acquire) : nullptr;
+    }
+
+    StringSlot& slot(uint32_t handle) {
+        std::atomic<StringSlot*>& chunk = chunks[handle >> kChunkBits];
+        if (!chunk.load(std::memory_order_relaxed)) chunk.store(new StringSlot[kChunkSize](), std::memory_order_release);
+        return chunk.load(std::memory_order_relaxed)[handle & (kChunkSize - 1)];
+    }
+
+    // Called with the mutex held
+    uint32_t add(const std::string& text, uint32_t ownerCount) {
+        uint32_t handle;
+        if (!freeHandles.empty()) {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+            owners[handle] = ownerCount;
+        } else {
+            if (owners.size() >= kPinned) throw std::runtime_error("VM: string table is full");
+            handle = static_cast<uint32_t>(owners.size());
+            owners.push_back(ownerCount);
+        }
+        auto it = index.emplace(text, handle).first;
+        slot(handle).store(&it->first, std::memory_order_release);
+        return handle;
+    }
+
+    // Called with the mutex held
+    void release(uint32_t handle) {
+        if (--owners[handle] != 0) return;
+        StringSlot& entry = slot(handle);
+        const std::string* text = entry.load(std::memory_order_relaxed);
+        entry.store(nullptr, std::memory_order_release);
+        index.erase(*text);
+        freeHandles.push_back(handle);
+    }
+};
+
+StringTable& stringTable() {
+    static StringTable table;
+    return table;
+}
+
+thread_local StringOwner* activeOwner = nullptr;
+
+[[noreturn]] void overLimit(size_t limit) {
+    throw std::runtime_error("VM: strings made by the program exceed the limit of " + std::to_string(limit) +
+                             " bytes");
+}
+
+[[noreturn]] void unsupported(const char* op, Value a, Value b) {
+    throw std::runtime_error(std::string("VM: unsupported operand types for ") + op + ": " +
+                             valueTypeName(a.type()) + " and " + valueTypeName(b.type()));
+}
+
+} // namespace
+
+const uint64_t Value::kIntTag;
+const uint64_t Value::kBoolTag;
+const uint64_t Value::kStringTag;
+const uint32_t Value::kIntTagHigh;
+const uint32_t Value::kBoolTagHigh;
+
+Value Value::number(double value) {
+    uint64_t raw;
+    std::memcpy(&raw, &value, sizeof raw);
+    return fromBits(std::isnan(value) ? kCanonicalNaN : raw);
+}
+
+Value Value::string(const std::string& text) {
+    StringTable& table = stringTable();
+    StringOwner* owner = activeOwner;
+    std::lock_guard<std::mutex> lock(table.mutex);
+    auto it = table.index.find(text);
+    if (it != table.index.end()) {
+        const uint32_t handle = it->second;
+        if (owner && table.owners[handle] != kPinned && !owner->held.count(handle)) {
+            if (owner->heldBytes + text.size() > owner->byteLimit) {
+                overLimit(owner->byteLimit);
+            }
+            owner->held.insert(handle);
+            owner->heldBytes += text.size();
+            ++table.owners[handle];
+        }
+        return fromBits(kStringTag | handle);
+    }
+    if (!owner) return fromBits(kStringTag | table.add(text, kPinned));
+    if (owner->heldBytes + text.size() > owner->byteLimit) {
+        overLimit(owner->byteLimit);
+    }
+    const uint32_t handle = table.add(text, 1);
+    owner->held.insert(handle);
+    owner->heldBytes += text.size();
+    return fromBits(kStringTag | handle);
+}
+
+const std::string& Value::asString() const {
+    const std::string* text = stringTable().find(stringHandle());
+    if (!text) throw std::runtime_error("VM: string handle " + std::to_string(stringHandle()) + " is not live");
+    return *text;
+}
+
+const size_t StringOwner::kDefaultByteLimit;
+
+StringOwner::StringOwner(const StringOwner& other) : byteLimit(other.byteLimit) {
+    StringTable& table = stringTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    for (uint32_t handle : other.held) ++table.owners[handle];
+    held = other.held;
+    heldBytes = other.heldBytes;
+}
+
+StringOwner::StringOwner(StringOwner&& other) noexcept
+    : held(std::move(other.held)), heldBytes(other.heldBytes), byteLimit(other.byteLimit) {
+    other.held.clear();
+    other.heldBytes = 0;
+}
+
+StringOwner& StringOwner::operator=(StringOwner other) noexcept {
+    held.swap(other.held);
+    std::swap(heldBytes, other.heldBytes);
+    std::swap(byteLimit, other.byteLimit);
+    return *this;
+}
+
+void StringOwner::retain(Value value) {
+    if (!value.isString() || held.count(value.stringHandle())) return;
+    StringTable& table = stringTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    const uint32_t handle = value.stringHandle();
+    const std::string* text = table.find(handle);
+    if (!text || table.owners[handle] == kPinned) return;
+    ++table.owners[handle];
+    held.insert(handle);
+    heldBytes += text->size();
+}
+
+void StringOwner::clear() {
+    if (held.empty()) return;
+    StringTable& table = stringTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    for (uint32_t handle : held) table.release(handle);
+    held.clear();
+    heldBytes = 0;
+}
+
+StringOwner::Scope::Scope(StringOwner& owner) : previous(activeOwner) {
+    activeOwner = &owner;
+}
+
+StringOwner::Scope::~Scope() {
+    activeOwner = previous;
+}
+
+Value::Type Value::type() const {
+    if (isDouble()) return Type::Double;
+    if (isInt()) return Type::Int;
+    if (isBool()) return Type::Bool;
+    return Type::String;
+}
+
+bool Value::truthy() const {
+    if (isIntLike()) return asInt() != 0;
+    if (isDouble()) return asDouble() != 0.0;
+    return !asString().empty();
+}
+
+std::string Value::toString() const {
+    switch (type()) {
+        case Type::Int:
+            return std::to_string(asInt());
+        case Type::Bool:
+            return asBool() ? "true" : "false";
+        case Type::String:
+            return asString();
+        case Type::Double:
+            break;
+    }
+    // Shortest of %.15g/%.17g that reads back as the same double
+    double d = asDouble();
+    char text[32];
+    std::snprintf(text, sizeof text, "%.15g", d);
+    if (std::strtod(text, nullptr) != d) std::snprintf(text, sizeof text, "%.17g", d);
+    std::string result = text;
+    // Keep floats recognizable: 3.0, not 3
+    if (result.find_first_of(".eEin") == std::string::npos) result += ".0";
+    return result;
+}
+
+const char* valueTypeName(Value::Type type) {
+    switch (type) {
+        case Value::Type::Int: return "int";
+        case Value::Type::Double: return "float";
+        case Value::Type::Bool: return "bool";
+        case Value::Type::String: return "string";
+    }
+    return "?";
+}
+
+std::ostream& operator<<(std::ostream& out, Value value) {
+    if (value.isString()) return out << '"' << value.asString() << '"';
+    return out << value.toString();
+}
+
+Value valueAdd(Value a, Value b) {
+    if (Value::bothIntLike(a, b)) return Value::integer(intAdd(a.asInt(), b.asInt()));
+    if (a.isString() || b.isString()) return Value::string(a.toString() + b.toString());
+    return Value::number(a.toDouble() + b.toDouble());
+}
+
+Value valueSub(Value a, Value b) {
+    if (Value::bothIntLike(a, b)) return Value::integer(intSub(a.asInt(), b.asInt()));
+    if (a.isString() || b.isString()) unsupported("-", a, b);
+    return Value::number(a.toDouble() - b.toDouble());
+}
+
+Value valueMul(Value a, Value b) {
+    if (Value::bothIntLike(a, b)) return Value::integer(intMul(a.asInt(), b.asInt()));
+    if (a.isString() || b.isString()) unsupported("*", a, b);
+    return Value::number(a.toDouble() * b.toDouble());
+}
+
+// Integer division truncates, rejects a zero divisor and wraps INT32_MIN
+// / -1 (intDiv); with a double operand it follows IEEE (x / 0.0 is an
+// infinity or NaN)
+Value valueDiv(Value a, Value b) {
+    if (Value::bothIntLike(a, b)) {
+        if (b.asInt() == 0) throw std::runtime_error("VM: division by zero");
+        return Value::integer(intDiv(a.asInt(), b.asInt()));
+    }
+    if (a.isString() || b.isString()) unsupported("/", a, b);
+    return Value::number(a.toDouble() / b.toDouble());
+}
+
+Value valueNeg(Value a) {
+    if (a.isIntLike()) return Value::integer(intNeg(a.asInt()));
+    if (a.isString()) throw std::runtime_error("VM: cannot negate a string");
+    return Value::number(-a.asDouble());
+}
+
+bool valueEquals(Value a, Value b) {
+    if (a.isString() || b.isString()) return a == b;    // interned
+    if (Value::bothIntLike(a, b)) return a.asInt() == b.asInt();
+    return a.toDouble() == b.toDouble();
+}
+
+bool valueLess(Value a, Value b) {
+    if (a.isString() && b.isString()) return a.asString() < b.asString();
+    if (a.isString() || b.isString()) unsupported("<", a, b);
+    if (Value::bothIntLike(a, b)) return a.asInt() < b.asInt();
+    return a.toDouble() < b.toDouble();
+}
+
+bool valueLessEqual(Value a, Value b) {
+    if (a.isString() && b.isString()) return a.asString() <= b.asString();
+    if (a.isString() || b.isString()) unsupported("<=", a, b);
+    if (Value::bothIntLike(a, b)) return a.asInt() <= b.asInt();
+    return a.toDouble() <= b.toDouble();
+}
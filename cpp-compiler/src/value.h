@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <string>
+#include <unordered_set>
+
+// Dynamically typed VM value in 8 bytes (NaN boxing).
+//
+// A double is stored as itself. Every other type sits in the payload of a
+// NaN that double arithmetic never produces (NaN results are canonicalized
+// on the way in), tagged by the top 16 bits:
+//   0xFFFA  int     low 32 bits
+//   0xFFFB  bool    low bit
+//   0xFFFC  string  low 32 bits: handle of an interned string
+// Any bit pattern below 0xFFFA << 48 is a double. Int and bool differ in the
+// lowest tag bit only, so "int or bool" is a single shift and compare.
+//
+// Integers are 32-bit: the width of bytecode immediates, of the JIT's
+// templates and of LaneVM lanes; int op int wraps as the int-only VM did.
+// Strings are interned in one process-wide table (see Value::string), so
+// handles can be shared between VMs and threads and string equality is a
+// compare of bits. Literals and constants stay in the table for the life of
+// the process; strings a running program makes belong to a StringOwner.
+class Value {
+public:
+    enum class Type : uint8_t { Int, Double, Bool, String };
+
+    static const uint64_t kIntTag = 0xFFFA000000000000ull;
+    static const uint64_t kBoolTag = 0xFFFB000000000000ull;
+    static const uint64_t kStringTag = 0xFFFC000000000000ull;
+    static const uint32_t kIntTagHigh = static_cast<uint32_t>(kIntTag >> 32);
+    static const uint32_t kBoolTagHigh = static_cast<uint32_t>(kBoolTag >> 32);
+
+    // int 0, the initial value of every variable
+    Value() : bits(kIntTag) {}
+
+    static Value integer(int32_t value) { return fromBits(kIntTag | static_cast<uint32_t>(value)); }
+    static Value number(double value);
+    static Value boolean(bool value) { return fromBits(kBoolTag | (value ? 1u : 0u)); }
+    // Interns `text`; the same text always gets the same handle while it
+    // lives. With a StringOwner active on the thread the string is held by
+    // that owner, otherwise it is kept for the life of the process.
+    static Value string(const std::string& text);
+    static Value fromBits(uint64_t raw) {
+        Value v;
+        v.bits = raw;
+        return v;
+    }
+
+    uint64_t raw() const { return bits; }
+    Type type() const;
+
+    bool isInt() const { return (bits >> 32) == kIntTagHigh; }
+    bool isBool() const { return (bits >> 32) == kBoolTagHigh; }
+    bool isString() const { return (bits >> 48) == (kStringTag >> 48); }
+    bool isDouble() const { return bits < kIntTag; }
+    // int or bool: the types that combine as int32
+    bool isIntLike() const { return (bits >> 49) == (kIntTag >> 49); }
+    // int, bool (as 0/1) or double
+    bool isNumber() const { return !isString(); }
+
+    int32_t asInt() const { return static_cast<int32_t>(bits); }
+    bool asBool() const { return (bits & 1) != 0; }
+    double asDouble() const {
+        double d;
+        std::memcpy(&d, &bits, sizeof d);
+        return d;
+    }
+    uint32_t stringHandle() const { return static_cast<uint32_t>(bits); }
+    // Takes no lock. Throws std::runtime_error for a handle that is not live.
+    const std::string& asString() const;
+
+    // Numeric value of an int, bool or double
+    double toDouble() const { return isDouble() ? asDouble() : static_cast<double>(asInt()); }
+    // Condition value: non-zero number, true, non-empty string
+    bool truthy() const;
+    // Text form: strings as their text, bools as true/false
+    std::string toString() const;
+
+    // Both int or bool: the case every arithmetic handler tries first
+    static bool bothIntLike(Value a, Value b) { return a.isIntLike() & b.isIntLike(); }
+
+    // Same type and payload (not numeric equality: 1 != 1.0 here)
+    friend bool operator==(Value a, Value b) { return a.bits == b.bits; }
+    friend bool operator!=(Value a, Value b) { return a.bits != b.bits; }
+
+private:
+    uint64_t bits;
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay one machine word");
+
+// Holds the strings a program makes at run time (VirtualMachine has one).
+// While a Scope is active on a thread, every string Value::string creates
+// or finds there that is not kept for the whole process is held by the
+// owner, and stays valid until the owner is cleared or destroyed; a string
+// held by several owners goes away with the last of them. Each owner holds
+// at most byteLimit bytes of text, so a program that keeps building new
+// strings fails with a runtime error instead of growing without bound.
+class StringOwner {
+public:
+    static const size_t kDefaultByteLimit = size_t(64) << 20;
+
+    StringOwner() = default;
+    StringOwner(const StringOwner& other);
+    StringOwner(StringOwner&& other) noexcept;
+    StringOwner& operator=(StringOwner other) noexcept;
+    ~StringOwner() { clear(); }
+
+    void setByteLimit(size_t limit) { byteLimit = limit; }
+    size_t getByteLimit() const { return byteLimit; }
+    // Bytes of text currently held
+    size_t bytes() const { return heldBytes; }
+
+    // Also holds `value`'s string, if it is one that can go away; counts
+    // toward bytes() but is not refused at the limit
+    void retain(Value value);
+    // Lets go of every string held
+    void clear();
+
+    // Makes `owner` the one strings are created for on this thread, until
+    // the Scope ends (scopes nest)
+    class Scope {
+    public:
+        explicit Scope(StringOwner& owner);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        StringOwner* previous;
+    };
+
+private:
+    friend class Value;
+
+    std::unordered_set<uint32_t> held;
+    size_t heldBytes = 0;
+    size_t byteLimit = kDefaultByteLimit;
+};
+
+// int op int, wrapping as value.h promises: computed in uint32_t, where
+// overflow is defined, and cast back
+inline int32_t intAdd(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+inline int32_t intSub(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)); }
+inline int32_t intMul(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)); }
+inline int32_t intNeg(int32_t a) { return static_cast<int32_t>(0u - static_cast<uint32_t>(a)); }
+// Truncating division for b != 0. The one quotient that does not fit,
+// INT32_MIN / -1, wraps to INT32_MIN instead of trapping.
+inline int32_t intDiv(int32_t a, int32_t b) { return b == -1 ? intNeg(a) : a / b; }
+
+const char* valueTypeName(Value::Type type);
+
+// Prints ints, doubles and bools as toString() does and strings quoted
+std::ostream& operator<<(std::ostream& out, Value value);
+
+// Generic arithmetic and comparisons for any mix of types; the VM handlers
+// call these only when the operands are not both ints or bools. Ints and bools combine
+// as ints, any double makes the result a double, + with a string operand
+// concatenates. Everything else (e.g. string - int), and int division by
+// zero, throws std::runtime_error.
+Value valueAdd(Value a, Value b);
+Value valueSub(Value a, Value b);
+Value valueMul(Value a, Value b);
+Value valueDiv(Value a, Value b);
+Value valueNeg(Value a);
+// Numbers compare numerically and strings by content; a string never
+// equals a number and ordering them throws
+bool valueEquals(Value a, Value b);
+bool valueLess(Value a, Value b);
+bool valueLessEqual(Value a, Value b);
@@ -1,81 +1,694 @@
 #include "vm.h"
+#include "bytecode_verifier.h"
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
 
-VirtualMachine::VirtualMachine() : ip(0) {}
+namespace {
+// Stack room for a program whose depth is unbounded (recursion) before its
+// calls start growing the buffer
+const size_t kRecursiveStackReserve = 1024;
+// Free room given to native code before it has to hand growing frames back
+const size_t kJitFrameReserve = 256;
 
-void VirtualMachine::execute(const std::vector<VMInstruction>& program) {
-    stack.clear();
-    memory.clear();
+// execute() never yields: no program gets through this many instructions
+const int64_t kUnlimitedBudget = INT64_MAX;
+} // namespace
+
+const size_t VirtualMachine::kMaxCallDepth;
+const uint32_t VirtualMachine::kDefaultTierUpThreshold;
+
+VirtualMachine::VirtualMachine()
+    : ip(0),
+      dispatchMode(MYCOMPILER_HAS_COMPUTED_GOTO ? DispatchMode::Threaded : DispatchMode::Switch) {}
+
+void VirtualMachine::execute(const BytecodeProgram& program) {
+    execute(program.code.data(), program.code.size(), program.slotNames, program.constants,
+            program.stackBounds, program.cachedVariants, program.codeHash, nullptr);
+}
+
+void VirtualMachine::execute(const BytecodeFile& file) {
+    execute(file.code(), file.instructionCount(), file.slotNames(), file.constants(),
+            file.stackBounds(), file.cachedVariants(), file.codeHash(), nullptr);
+}
+
+void VirtualMachine::execute(const BytecodeProgram& program, const std::vector<Value>& inputs) {
+    execute(program.code.data(), program.code.size(), program.slotNames, program.constants,
+            program.stackBounds, program.cachedVariants, program.codeHash, &inputs);
+}
+
+void VirtualMachine::execute(const BytecodeFile& file, const std::vector<Value>& inputs) {
+    execute(file.code(), file.instructionCount(), file.slotNames(), file.constants(),
+            file.stackBounds(), file.cachedVariants(), file.codeHash(), &inputs);
+}
+
+void VirtualMachine::execute(const CompactProgram& program) {
+    executeCompact(program, nullptr);
+}
+
+void VirtualMachine::execute(const CompactProgram& program, const std::vector<Value>& inputs) {
+    executeCompact(program, &inputs);
+}
+
+void VirtualMachine::load(const BytecodeProgram& program) {
+    load(program.code.data(), program.code.size(), program.slotNames, program.constants,
+         program.stackBounds, program.cachedVariants, program.codeHash, nullptr);
+}
+
+void VirtualMachine::load(const BytecodeFile& file) {
+    load(file.code(), file.instructionCount(), file.slotNames(), file.constants(),
+         file.stackBounds(), file.cachedVariants(), file.codeHash(), nullptr);
+}
+
+void VirtualMachine::load(const BytecodeProgram& program, const std::vector<Value>& inputs) {
+    load(program.code.data(), program.code.size(), program.slotNames, program.constants,
+         program.stackBounds, program.cachedVariants, program.codeHash, &inputs);
+}
+
+void VirtualMachine::load(const BytecodeFile& file, const std::vector<Value>& inputs) {
+    load(file.code(), file.instructionCount(), file.slotNames(), file.constants(),
+         file.stackBounds(), file.cachedVariants(), file.codeHash(), &inputs);
+}
+
+void VirtualMachine::load(const BytecodeInstruction* code, size_t count,
+                          const std::vector<std::string>& slotNames, const std::vector<Value>& constantPool,
+                          const StackBounds& bounds, bool cachedVariants, uint64_t codeHash,
+                          const std::vector<Value>* inputs) {
+    stack.resize(bounds.maxDepth != kUnboundedStackDepth
+                     ? bounds.maxDepth
+                     : std::max<size_t>(bounds.maxFrameDepth, kRecursiveStackReserve));
+    stackDepth = 0;
+    frameRoom = bounds.maxFrameDepth;
+    frames.clear();
+    nativeSized = false;
+    globals.assign(slotNames.size(), Value());
+    constants = constantPool.data();
+    // Inputs may be strings the last run made, so hold them before letting go
+    StringOwner previous(std::move(strings));
+    strings.setByteLimit(previous.getByteLimit());
+    if (inputs) {
+        std::copy_n(inputs->begin(), std::min(inputs->size(), globals.size()), globals.begin());
+        for (Value value : globals) strings.retain(value);
+    }
+    slotByName.clear();
+    for (size_t slot = 0; slot < slotNames.size(); ++slot) {
+        if (!slotNames[slot].empty()) slotByName.emplace(slotNames[slot], slot);
+    }
     ip = 0;
-    while (ip < program.size()) {
-        executeInstruction(program[ip]);
-        ip++;
-    }
-}
-
-void VirtualMachine::executeInstruction(const VMInstruction& instr) {
-    if (instr.opcode == VMOpCode::VM_PUSH) {
-        stack.push_back(std::stoi(instr.operand1));
-    } else if (instr.opcode == VMOpCode::VM_POP) {
-        if (!stack.empty()) stack.pop_back();
-    } else if (instr.opcode == VMOpCode::VM_LOAD) {
-        stack.push_back(memory[instr.operand1]);
-    } else if (instr.opcode == VMOpCode::VM_STORE) {
-        if (!stack.empty()) {
-            int val = stack.back(); stack.pop_back();
-            memory[instr.operand1] = val;
+    usedJit = false;
+    hotness.assign(count, 0);
+    loadedCode = code;
+    loadedCount = count;
+    loadedCachedVariants = cachedVariants;
+    loadedHash = codeHash;
+    status = count == 0 ? RunStatus::Finished : RunStatus::Yielded;
+    error.clear();
+#if MYCOMPILER_PROFILE
+    if (count != 0) profiler.begin(code, count);
+#endif
+}
+
+void VirtualMachine::execute(const BytecodeInstruction* code, size_t count,
+                             const std::vector<std::string>& slotNames, const std::vector<Value>& constantPool,
+                             const StackBounds& bounds, bool cachedVariants, uint64_t codeHash,
+                             const std::vector<Value>* inputs) {
+    load(code, count, slotNames, constantPool, bounds, cachedVariants, codeHash, inputs);
+    if (count == 0) return;
+    budget = kUnlimitedBudget;
+    // Stays Error if runProgram throws, so the state cannot be snapshotted
+    status = RunStatus::Error;
+    StringOwner::Scope scope(strings);
+
+    try {
+        runProgram(code, count);
+    } catch (const std::runtime_error&) {
+        // What the program printed before the error still goes out
+        output.flush();
+        if (tracing && !traceDumpPath.empty()) trace->dumpToFile(traceDumpPath);
+        throw;
+    }
+    status = RunStatus::Finished;
+    flushOutput();
+}
+
+void VirtualMachine::executeCompact(const CompactProgram& program, const std::vector<Value>* inputs) {
+    // Loading no packed code resets the VM and leaves nothing for run() or
+    // saveSnapshot() to pick up
+    load(nullptr, 0, program.slotNames, program.constants, program.stackBounds, false, 0, inputs);
+    if (program.code.empty()) return;
+    status = RunStatus::Error;
+    StringOwner::Scope scope(strings);
+    try {
+        runCompact(program.code.data());
+    } catch (const std::runtime_error&) {
+        output.flush();
+        throw;
+    }
+    status = RunStatus::Finished;
+    flushOutput();
+}
+
+RunStatus VirtualMachine::run(int64_t sliceBudget) {
+    if (status != RunStatus::Yielded) return status;
+    budget = sliceBudget;
+    StringOwner::Scope scope(strings);
+    try {
+        if (runProgram(loadedCode, loadedCount)) {
+            status = RunStatus::Finished;
+            flushOutput();
+        }
+    } catch (const std::runtime_error& e) {
+        output.flush();
+        if (tracing && !traceDumpPath.empty()) trace->dumpToFile(traceDumpPath);
+        status = RunStatus::Error;
+        error = e.what();
+    }
+    return status;
+}
+
+void VirtualMachine::saveSnapshot(const std::string& path) const {
+    if (!loadedCode) throw std::runtime_error("VM: no program to snapshot");
+    if (status == RunStatus::Error) throw std::runtime_error("VM: cannot snapshot a program stopped by an error");
+    VMSnapshotState state;
+    state.codeHash = loadedHash;
+    state.status = static_cast<uint32_t>(status);
+    state.ip = ip;
+    state.slots = globals.data();
+    state.slotCount = globals.size();
+    state.stack = stack.data();
+    state.stackDepth = stackDepth;
+    state.frames = frames.data();
+    state.frameDepth = nativeSized ? nativeFrameDepth : frames.size();
+    writeVMSnapshot(path, state);
+}
+
+void VirtualMachine::restore(const BytecodeProgram& program, const VMSnapshot& snapshot) {
+    restore(program.code.data(), program.code.size(), program.slotNames, program.constants,
+            program.stackBounds, program.cachedVariants, program.codeHash, snapshot);
+}
+
+void VirtualMachine::restore(const BytecodeFile& file, const VMSnapshot& snapshot) {
+    restore(file.code(), file.instructionCount(), file.slotNames(), file.constants(),
+            file.stackBounds(), file.cachedVariants(), file.codeHash(), snapshot);
+}
+
+void VirtualMachine::restore(const BytecodeInstruction* code, size_t count,
+                             const std::vector<std::string>& slotNames, const std::vector<Value>& constantPool,
+                             const StackBounds& bounds, bool cachedVariants, uint64_t codeHash,
+                             const VMSnapshot& snapshot) {
+    if (snapshot.codeHash() != codeHash || snapshot.slotCount() != slotNames.size()) {
+        throw std::runtime_error("VM: snapshot was taken from a different program");
+    }
+    const uint32_t savedStatus = snapshot.status();
+    std::vector<size_t> savedFrames(snapshot.frameDepth());
+    snapshot.readFrames(savedFrames.data());
+    bool fits = (savedStatus == static_cast<uint32_t>(RunStatus::Yielded) ||
+                 savedStatus == static_cast<uint32_t>(RunStatus::Finished)) &&
+                snapshot.ip() < count && savedFrames.size() <= kMaxCallDepth;
+    for (size_t frame : savedFrames) fits = fits && frame < count;
+    if (fits) fits = stackDepthFits(code, count, savedFrames, snapshot.ip(), snapshot.stackDepth());
+    if (!fits) throw std::runtime_error("VM: snapshot state does not fit the program");
+
+    load(code, count, slotNames, constantPool, bounds, cachedVariants, codeHash, nullptr);
+    snapshot.readSlots(globals.data());
+    // The running routine may still need up to a frame's worth above it
+    growStack(snapshot.stackDepth() + frameRoom);
+    snapshot.readStack(stack.data());
+    stackDepth = snapshot.stackDepth();
+    for (Value value : globals) strings.retain(value);
+    for (size_t i = 0; i < stackDepth; ++i) strings.retain(stack[i]);
+    frames.swap(savedFrames);
+    ip = snapshot.ip();
+    status = static_cast<RunStatus>(savedStatus);
+}
+
+// Handlers trust the verified depths, so a saved state must sit exactly on
+// them: each return site follows a CALL, and the depth is the sum of the
+// depths the calls were made at plus the depth verified at ip.
+bool VirtualMachine::stackDepthFits(const BytecodeInstruction* code, size_t count,
+                                    const std::vector<size_t>& savedFrames, size_t savedIp, size_t depth) {
+    StackVerification verified;
+    try {
+        verified = verifyStack(code, count);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    auto known = [](int64_t d) { return d != kUnreachedDepth && d != kMixedDepth; };
+    int64_t base = 0;
+    for (size_t frame : savedFrames) {
+        if (frame == 0 || code[frame - 1].opcode != VMOpCode::VM_CALL) return false;
+        const int64_t atCall = verified.depths[frame - 1];
+        if (!known(atCall)) return false;
+        base += atCall;
+    }
+    const int64_t atIp = verified.depths[savedIp];
+    return known(atIp) && base + atIp >= 0 && static_cast<uint64_t>(base + atIp) == depth;
+}
+
+bool VirtualMachine::runProgram(const BytecodeInstruction* code, size_t count) {
+    yielded = false;
+    if (tracing) {
+        interpret(code, false);
+    } else if (executionMode == ExecutionMode::Tiered) {
+        runTiered(code, count);
+    } else {
+        const JitCode* jit = executionMode == ExecutionMode::Jit ? jitFor(code, count) : nullptr;
+        if (jit) usedJit = true;
+        // A deopt finishes the slice in the interpreter from the exit ip
+        if (!jit || runJit(*jit) == JitExit::Deopt) interpret(code, false);
+    }
+    return !yielded;
+}
+
+void VirtualMachine::interpret(const BytecodeInstruction* code, bool counting) {
+    trimNativeFrames();
+#if MYCOMPILER_HAS_COMPUTED_GOTO
+    if (dispatchMode == DispatchMode::CachedTop && loadedCachedVariants && !tracing) {
+        if (counting) runCached<true>(code);
+        else runCached<false>(code);
+        return;
+    }
+    if (dispatchMode != DispatchMode::Switch) {
+        if (tracing) runThreaded<false, true>(code);
+        else if (counting) runThreaded<true, false>(code);
+        else runThreaded<false, false>(code);
+        return;
+    }
+#endif
+    if (tracing) runSwitch<false, true>(code);
+    else if (counting) runSwitch<true, false>(code);
+    else runSwitch<false, false>(code);
+}
+
+// Nothing is compiled until some loop header or function entry has been
+// reached tierUpThreshold times; the interpreter then stops there and
+// native code picks up from the same ip with the same stack and frames.
+// A deopt drops back to the counting interpreter, which can tier up again.
+void VirtualMachine::runTiered(const BytecodeInstruction* code, size_t count) {
+    // A slice that yielded from native code resumes there
+    if (nativeSized && runJit(*jitCode) != JitExit::Deopt) return;
+    for (;;) {
+        tierUpRequested = false;
+        interpret(code, true);
+        if (!tierUpRequested) return;
+
+        const JitCode* jit = jitFor(code, count);
+        if (!jit) {
+            interpret(code, false);
+            return;
         }
-    } else if (instr.opcode == VMOpCode::VM_ADD) {
-        int b = stack.back(); stack.pop_back();
-        int a = stack.back(); stack.pop_back();
-        stack.push_back(a + b);
-    } else if (instr.opcode == VMOpCode::VM_SUB) {
-        int b = stack.back(); stack.pop_back();
-        int a = stack.back(); stack.pop_back();
-        stack.push_back(a - b);
-    } else if (instr.opcode == VMOpCode::VM_MUL) {
-        int b = stack.back(); stack.pop_back();
-        int a = stack.back(); stack.pop_back();
-        stack.push_back(a * b);
-    } else if (instr.opcode == VMOpCode::VM_DIV) {
-        int b = stack.back(); stack.pop_back();
-        int a = stack.back(); stack.pop_back();
-        stack.push_back(a / b);
-    } else if (instr.opcode == VMOpCode::VM_NEG) {
-        int a = stack.back(); stack.pop_back();
-        stack.push_back(-a);
-    } else if (instr.opcode == VMOpCode::VM_CMP_EQ) {
-        int b = stack.back(); stack.pop_back();
-        int a = stack.back(); stack.pop_back();
-        stack.push_back(a == b ? 1 : 0);
-    } else if (instr.opcode == VMOpCode::VM_CMP_NE) {
-        int b = stack.back(); stack.pop_back();
-        int a = stack.back(); stack.pop_back();
-        stack.push_back(a != b ? 1 : 0);
-    } else if (instr.opcode == VMOpCode::VM_CMP_LT) {
-        int b = stack.back(); stack.pop_back();
-        int a = stack.back(); stack.pop_back();
-        stack.push_back(a < b ? 1 : 0);
-    } else if (instr.opcode == VMOpCode::VM_CMP_LE) {
-        int b = stack.back(); stack.pop_back();
-        int a = stack.back(); stack.pop_back();
-        stack.push_back(a <= b ? 1 : 0);
-    } else if (instr.opcode == VMOpCode::VM_CMP_GT) {
-        int b = stack.back(); stack.pop_back();
-        int a = stack.back(); stack.pop_back();
-        stack.push_back(a > b ? 1 : 0);
-    } else if (instr.opcode == VMOpCode::VM_CMP_GE) {
-        int b = stack.back(); stack.pop_back();
-        int a = stack.back(); stack.pop_back();
-        stack.push_back(a >= b ? 1 : 0);
-    }
-    // You can further coordinate jump/call/return instructions as needed
-}
-
-int VirtualMachine::getVariable(const std::string& name) const {
-    auto it = memory.find(name);
-    if (it != memory.end()) return it->second;
+        usedJit = true;
+        if (runJit(*jit) != JitExit::Deopt) return;
+    }
+}
+
+const JitCode* VirtualMachine::jitFor(const BytecodeInstruction* code, size_t count) {
+    // The hash was computed once, when the program was assembled or mapped
+    if (code != jitSource || count != jitSourceCount || loadedHash != jitSourceHash ||
+        (!jitCode && !jitCompileFailed)) {
+        jitSource = code;
+        jitSourceCount = count;
+        jitSourceHash = loadedHash;
+        jitCode = JitCompiler::compile(std::vector<BytecodeInstruction>(code, code + count));
+        jitCompileFailed = !jitCode;
+    }
+    return jitCode.get();
+}
+
+// Runs native code from ip on the VM's own buffers until the program
+// finishes, the budget runs out or native code hands control back at ip.
+JitExit VirtualMachine::runJit(const JitCode& jit) {
+    size_t frameDepth = nativeFrameDepth;
+    if (!nativeSized) {
+        frameDepth = frames.size();
+        frames.resize(std::min(kMaxCallDepth, std::max(frames.capacity(), frameDepth + kJitFrameReserve)));
+    }
+
+    JitState state;
+    state.globals = globals.data();
+    state.constants = constants;
+    state.stackBase = stack.data();
+    state.stackTop = stack.data() + stackDepth;
+    state.stackLimit = stack.data() + stack.size();
+    state.frameBase = frames.data();
+    state.frameTop = frames.data() + frameDepth;
+    state.frameLimit = frames.data() + frames.size();
+    state.exitIp = ip;
+    state.budget = budget;
+    std::string printError;
+    state.output = &output;
+    state.error = &printError;
+
+    JitExit exit = jit.run(state, ip);
+
+    stackDepth = static_cast<size_t>(state.stackTop - state.stackBase);
+    nativeFrameDepth = static_cast<size_t>(state.frameTop - state.frameBase);
+    nativeSized = true;
+    ip = state.exitIp;
+    budget = state.budget;
+    if (exit == JitExit::Yielded) yielded = true;
+    else trimNativeFrames();
+    if (exit == JitExit::Error) throw std::runtime_error(printError);
+    return exit;
+}
+
+void VirtualMachine::trimNativeFrames() {
+    if (!nativeSized) return;
+    frames.resize(nativeFrameDepth);
+    nativeSized = false;
+}
+
+// Only calls into recursive routines (and restore) ever need this
+void VirtualMachine::growStack(size_t room) {
+    if (stack.size() - stackDepth >= room) return;
+    stack.resize(std::max(stack.size() * 2, stackDepth + room));
+}
+
+void VirtualMachine::setExecutionMode(ExecutionMode mode) {
+    executionMode = mode;
+}
+
+ExecutionMode VirtualMachine::getExecutionMode() const {
+    return executionMode;
+}
+
+bool VirtualMachine::lastRunUsedJit() const {
+    return usedJit;
+}
+
+void VirtualMachine::setTracing(bool enabled) {
+    if (enabled && !trace) trace.reset(new TraceRing());
+    if (enabled) trace->clear();
+    tracing = enabled;
+}
+
+bool VirtualMachine::isTracing() const {
+    return tracing;
+}
+
+void VirtualMachine::setTraceDumpPath(const std::string& path) {
+    traceDumpPath = path;
+}
+
+void VirtualMachine::setTierUpThreshold(uint32_t count) {
+    tierUpThreshold = count;
+}
+
+uint32_t VirtualMachine::getTierUpThreshold() const {
+    return tierUpThreshold;
+}
+
+void VirtualMachine::setOutputFd(int fd) {
+    output.setFd(fd);
+}
+
+void VirtualMachine::flushOutput() {
+    if (!output.flush()) throw std::runtime_error(std::string("VM: cannot write output: ") + std::strerror(errno));
+}
+
+void VirtualMachine::setDispatchMode(DispatchMode mode) {
+    dispatchMode = hasThreadedDispatch() ? mode : DispatchMode::Switch;
+}
+
+DispatchMode VirtualMachine::getDispatchMode() const {
+    return dispatchMode;
+}
+
+bool VirtualMachine::hasThreadedDispatch() {
+    return MYCOMPILER_HAS_COMPUTED_GOTO != 0;
+}
+
+// Run at every back-edge and call into `target`. Charges `cost` to the
+// budget and counts one more arrival at `target`; once that is hot, stops
+// the interpreter there so the VM can tier up (compiled away unless
+// Counting), otherwise yields at target if the budget has run out. Tiering
+// up first keeps tiny budgets from starving the counters; native code then
+// yields at its own first check. `leave` runs before either exit.
+#define VM_HOT_LEAVING(target, cost, leave)                        \
+    do {                                                           \
+        budget -= (cost);                                          \
+        const size_t hotIp = static_cast<size_t>((target) - code); \
+        if (Counting && ++hotness[hotIp] >= tierUpThreshold) {     \
+            hotness[hotIp] = 0;                                    \
+            leave;                                                 \
+            pc = (target);                                         \
+            goto vm_tier_up;                                       \
+        }                                                          \
+        if (budget < 0) {                                          \
+            leave;                                                 \
+            pc = (target);                                         \
+            goto vm_yield;                                         \
+        }                                                          \
+    } while (0)
+#define VM_HOT(target, cost) VM_HOT_LEAVING(target, cost, (void)0)
+
+// Records the current instruction in ip (and the stack depth) before a
+// generic Value operation that may throw, so the error (and any trace dump)
+// points at it
+#define VM_SYNC_IP() (ip = static_cast<size_t>(pc - code), stackDepth = static_cast<size_t>(sp - stack.data()))
+
+// Profiling hooks: every dispatch ticks, and each engine exit closes the
+// last instruction's time. Empty unless MYCOMPILER_PROFILE.
+#if MYCOMPILER_PROFILE
+#define VM_PROFILE_TICK() profiler.tick(static_cast<size_t>(pc - code))
+#define VM_PROFILE_END() profiler.end()
+#else
+#define VM_PROFILE_TICK() ((void)0)
+#define VM_PROFILE_END() ((void)0)
+#endif
+
+// Tracing hook, run before each instruction; compiles away unless Tracing
+#define VM_TRACE_STEP()                                                          \
+    do {                                                                         \
+        if (Tracing) {                                                           \
+            trace->record(static_cast<size_t>(pc - code), pc->opcode,            \
+                          sp == stack.data() ? Value() : sp[-1]);                \
+        }                                                                        \
+    } while (0)
+
+// Portable engine: a single switch in a loop
+template <bool Counting, bool Tracing>
+void VirtualMachine::runSwitch(const BytecodeInstruction* code) {
+    const BytecodeInstruction* pc = code + ip;
+    Value* sp = stack.data() + stackDepth;
+    Value* stackEnd = stack.data() + stack.size();
+
+#define VM_CASE(op) case VMOpCode::op:
+#define VM_NEXT() ++pc; continue
+#define VM_DISPATCH() continue
+
+    for (;;) {
+        VM_PROFILE_TICK();
+        VM_TRACE_STEP();
+        switch (pc->opcode) {
+#include "vm_handlers.inc"
+        }
+    }
+
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_DISPATCH
+
+vm_yield:
+    yielded = true;
+    goto vm_halt;
+vm_tier_up:
+    tierUpRequested = true;
+vm_halt:
+    VM_PROFILE_END();
+    ip = static_cast<size_t>(pc - code);
+    stackDepth = static_cast<size_t>(sp - stack.data());
+}
+
+#if MYCOMPILER_HAS_COMPUTED_GOTO
+// Threaded engine: every handler ends in its own indirect jump, so the branch
+// predictor sees one dispatch site per opcode instead of a shared one.
+template <bool Counting, bool Tracing>
+void VirtualMachine::runThreaded(const BytecodeInstruction* code) {
+    static const void* const dispatchTable[] = {
+#define VM_OPCODE_LABEL(name) &&L_##name,
+        VM_OPCODE_LIST(VM_OPCODE_LABEL)
+#undef VM_OPCODE_LABEL
+    };
+    const BytecodeInstruction* pc = code + ip;
+    Value* sp = stack.data() + stackDepth;
+    Value* stackEnd = stack.data() + stack.size();
+
+#define VM_CASE(op) L_##op:
+#define VM_DISPATCH() VM_PROFILE_TICK(); VM_TRACE_STEP(); goto *dispatchTable[static_cast<uint8_t>(pc->opcode)]
+#define VM_NEXT() ++pc; VM_DISPATCH()
+
+    VM_DISPATCH();
+#include "vm_handlers.inc"
+
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_DISPATCH
+
+vm_yield:
+    yielded = true;
+    goto vm_halt;
+vm_tier_up:
+    tierUpRequested = true;
+vm_halt:
+    VM_PROFILE_END();
+    ip = static_cast<size_t>(pc - code);
+    stackDepth = static_cast<size_t>(sp - stack.data());
+}
+
+// Top-of-stack caching engine: threaded like runThreaded, but it dispatches
+// on each instruction's cachedVariant, so the handler already knows whether
+// the top of the stack is in `tos` or in the buffer.
+template <bool Counting>
+void VirtualMachine::runCached(const BytecodeInstruction* code) {
+    static const void* const dispatchTable[] = {
+#define VM_OPCODE_LABELS(name) &&C_##name##_00, &&C_##name##_01, &&C_##name##_10, &&C_##name##_11,
+        VM_OPCODE_LIST(VM_OPCODE_LABELS)
+#undef VM_OPCODE_LABELS
+    };
+    static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) <= 256, "cachedVariant is one byte");
+    const BytecodeInstruction* pc = code + ip;
+    Value* sp = stack.data() + stackDepth;
+    Value* stackEnd = stack.data() + stack.size();
+    // The top was spilled when the engine last left off here
+    Value tos;
+    if (vmCachedBefore(pc->cachedVariant)) tos = *--sp;
+
+#define VM_CACHED_CASE(op, before, after) C_##op##_##before##after:
+#define VM_DISPATCH() VM_PROFILE_TICK(); goto *dispatchTable[pc->cachedVariant]
+#define VM_NEXT() ++pc; VM_DISPATCH()
+
+    VM_DISPATCH();
+#include "vm_cached_handlers.inc"
+
+#undef VM_CACHED_CASE
+#undef VM_NEXT
+#undef VM_DISPATCH
+
+vm_bad_variant:
+    VM_SYNC_IP();
+    throw std::runtime_error(std::string("VM: no cached variant of ") + vmOpCodeName(pc->opcode) +
+                             " for its stack depth");
+vm_yield:
+    yielded = true;
+    goto vm_halt;
+vm_tier_up:
+    tierUpRequested = true;
+vm_halt:
+    VM_PROFILE_END();
+    ip = static_cast<size_t>(pc - code);
+    stackDepth = static_cast<size_t>(sp - stack.data());
+}
+#endif
+
+// Compact engine: decodes the variable-length stream (compact_bytecode.h) as
+// it goes. vm_compact_handlers.inc is included once per operand width; a
+// CM_WIDE16/CM_WIDE32 prefix dispatches on the opcode after it into the
+// wider copy.
+void VirtualMachine::runCompact(const uint8_t* code) {
+    const uint8_t* pc = code;
+    Value* sp = stack.data() + stackDepth;
+    Value* stackEnd = stack.data() + stack.size();
+
+#define CM_OPERAND(i) compactOperand<CM_WIDTH>(pc + (CM_WIDTH > 1 ? 2 : 1) + (i) * CM_WIDTH)
+#define CM_NEXT(n) pc += (CM_WIDTH > 1 ? 2 : 1) + (n) * CM_WIDTH; CM_DISPATCH()
+
+#if MYCOMPILER_HAS_COMPUTED_GOTO
+#define CM_OPCODE_LABEL(name, width) &&W##width##_##name,
+#define CM_NARROW_LABEL(name) CM_OPCODE_LABEL(name, 1)
+#define CM_WIDE16_LABEL(name) CM_OPCODE_LABEL(name, 2)
+#define CM_WIDE32_LABEL(name) CM_OPCODE_LABEL(name, 4)
+#define CM_SHORT_LABEL(name) &&S_##name,
+    static const void* const dispatchTable[] = {
+        VM_OPCODE_LIST(CM_NARROW_LABEL)
+        COMPACT_OPCODE_LIST(CM_SHORT_LABEL)
+    };
+    static const void* const wide16Table[] = {VM_OPCODE_LIST(CM_WIDE16_LABEL)};
+    static const void* const wide32Table[] = {VM_OPCODE_LIST(CM_WIDE32_LABEL)};
+#undef CM_OPCODE_LABEL
+#undef CM_NARROW_LABEL
+#undef CM_WIDE16_LABEL
+#undef CM_WIDE32_LABEL
+#undef CM_SHORT_LABEL
+
+#define CM_CASE_AT(op, width) W##width##_##op:
+#define CM_CASE_WIDTH(op, width) CM_CASE_AT(op, width)
+#define CM_CASE(op) CM_CASE_WIDTH(op, CM_WIDTH)
+#define CM_SHORT_CASE(op) S_##op:
+#define CM_DISPATCH() goto *dispatchTable[*pc]
+
+    CM_DISPATCH();
+S_CM_WIDE16:
+    goto *wide16Table[pc[1]];
+S_CM_WIDE32:
+    goto *wide32Table[pc[1]];
+#define CM_WIDTH 1
+#include "vm_compact_handlers.inc"
+#undef CM_WIDTH
+#define CM_WIDTH 2
+#include "vm_compact_handlers.inc"
+#undef CM_WIDTH
+#define CM_WIDTH 4
+#include "vm_compact_handlers.inc"
+#undef CM_WIDTH
+
+#undef CM_CASE_AT
+#undef CM_CASE_WIDTH
+#else
+#define CM_CASE(op) case static_cast<uint8_t>(VMOpCode::op):
+#define CM_SHORT_CASE(op) case static_cast<uint8_t>(CompactOpCode::op):
+#define CM_DISPATCH() continue
+
+    for (;;) {
+        switch (*pc) {
+#define CM_WIDTH 1
+#include "vm_compact_handlers.inc"
+#undef CM_WIDTH
+        case static_cast<uint8_t>(CompactOpCode::CM_WIDE16):
+            switch (pc[1]) {
+#define CM_WIDTH 2
+#include "vm_compact_handlers.inc"
+#undef CM_WIDTH
+            }
+            break;
+        case static_cast<uint8_t>(CompactOpCode::CM_WIDE32):
+            switch (pc[1]) {
+#define CM_WIDTH 4
+#include "vm_compact_handlers.inc"
+#undef CM_WIDTH
+            }
+            break;
+        }
+        goto vm_bad_compact;
+    }
+#endif
+
+#undef CM_CASE
+#undef CM_SHORT_CASE
+#undef CM_DISPATCH
+#undef CM_NEXT
+#undef CM_OPERAND
+
+vm_bad_compact:
+    VM_SYNC_IP();
+    throw std::runtime_error("VM: malformed compact bytecode at byte " + std::to_string(ip));
+vm_halt:
+    ip = static_cast<size_t>(pc - code);
+    stackDepth = static_cast<size_t>(sp - stack.data());
+}
+
+#undef VM_HOT
+#undef VM_HOT_LEAVING
+#undef VM_SYNC_IP
+#undef VM_PROFILE_TICK
+#undef VM_PROFILE_END
+#undef VM_TRACE_STEP
+
+Value VirtualMachine::getVariable(const std::string& name) const {
+    auto it = slotByName.find(name);
+    if (it != slotByName.end()) return globals[it->second];
     throw std::runtime_error("Variable not found: " + name);
 }
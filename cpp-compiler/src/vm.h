@@ -1,25 +1,264 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
 #include <unordered_map>
 #include "assembler.h"
+#include "bytecode_file.h"
+#include "compact_bytecode.h"
+#include "jit.h"
+#include "value.h"
+#include "vm_output.h"
+#include "vm_snapshot.h"
+#include "vm_trace.h"
+
+// Opt-in per-instruction profiling (CMake option MYCOMPILER_PROFILE). When
+// off, the profiler is not a member and the dispatch loops carry no hooks.
+#ifndef MYCOMPILER_PROFILE
+#define MYCOMPILER_PROFILE 0
+#endif
+#if MYCOMPILER_PROFILE
+#include "vm_profiler.h"
+#endif
+
+// Threaded (computed goto) dispatch relies on the GCC/Clang labels-as-values
+// extension. It is compiled in unless MYCOMPILER_NO_COMPUTED_GOTO is defined;
+// the portable switch loop is always available.
+#if defined(__GNUC__) && !defined(MYCOMPILER_NO_COMPUTED_GOTO)
+#define MYCOMPILER_HAS_COMPUTED_GOTO 1
+#else
+#define MYCOMPILER_HAS_COMPUTED_GOTO 0
+#endif
+
+enum class DispatchMode {
+    Switch,     // one indirect branch through a switch jump table
+    Threaded,   // each handler jumps straight to the next one
+    CachedTop   // threaded, with the top of the stack kept in a register
+                // (see vmCachedVariant); code without cached variants runs
+                // Threaded
+};
+
+enum class ExecutionMode {
+    Interpret,  // bytecode interpreter only
+    Jit,        // compile the program to native code first; any opcode or
+                // platform the JIT does not cover falls back to Interpret
+    Tiered      // interpret while counting loop back-edges and calls; once a
+                // target reaches the tier-up threshold, compile and continue
+                // natively from that instruction (on-stack replacement)
+};
+
+enum class RunStatus {
+    Yielded,    // budget used up; call run() again to continue
+    Finished,   // HALT or top-level RETURN reached (or nothing loaded)
+    Error       // a runtime error stopped the program; see getError()
+};
 
 class VirtualMachine {
 public:
     VirtualMachine();
 
-    // Load and execute a program (VM instructions)
-    void execute(const std::vector<VMInstruction>& program);
+    // Load and execute a program (packed bytecode from the Assembler)
+    void execute(const BytecodeProgram& program);
+    // Execute a precompiled .mcbc straight from its mapped instruction stream
+    void execute(const BytecodeFile& file);
+    // Same, with variables starting at `inputs` (indexed by slot; missing
+    // slots start at int 0) instead of all zeros
+    void execute(const BytecodeProgram& program, const std::vector<Value>& inputs);
+    void execute(const BytecodeFile& file, const std::vector<Value>& inputs);
+    // Runs a program in the variable-length encoding (compact_bytecode.h)
+    // to completion. The compact engine only interprets and has no hooks:
+    // execution mode, tracing and profiling do not apply, and it has no
+    // load()/run() or snapshot form.
+    void execute(const CompactProgram& program);
+    void execute(const CompactProgram& program, const std::vector<Value>& inputs);
+
+    // Resumable execution. load() resets the VM for a program without running
+    // it; each run(budget) then continues from where the last one stopped,
+    // with ip, stack, frames and variables kept in between. The program (or
+    // file) must stay alive until the run finishes.
+    //
+    // The budget is counted in instructions but only charged at loop
+    // back-edges (the length of the loop body) and calls (one each), so the
+    // straight-line code between two checks is never interrupted and a slice
+    // may overrun by that much. Works in every execution mode; native code
+    // checks the same countdown.
+    void load(const BytecodeProgram& program);
+    void load(const BytecodeFile& file);
+    void load(const BytecodeProgram& program, const std::vector<Value>& inputs);
+    void load(const BytecodeFile& file, const std::vector<Value>& inputs);
+    RunStatus run(int64_t budget);
+    RunStatus getStatus() const { return status; }
+    // Message of the runtime error when getStatus() is Error
+    const std::string& getError() const { return error; }
+
+    // Snapshots of a loaded program's state: variables, stack, call frames
+    // and the strings they reference (see vm_snapshot.h). saveSnapshot()
+    // works between run() slices and after the program finished, but not
+    // after an error. restore() loads the same program (checked by a hash of
+    // its code) and puts the state back, so run() continues from there.
+    // Tiering counters and native code are not part of a snapshot. Both
+    // throw std::runtime_error on failure.
+    void saveSnapshot(const std::string& path) const;
+    void restore(const BytecodeProgram& program, const VMSnapshot& snapshot);
+    void restore(const BytecodeFile& file, const VMSnapshot& snapshot);
+
+    // Strings the program makes (e.g. by + with a string operand) belong to
+    // this VM: they stay valid until the next load(), execute() or restore()
+    // or until the VM is destroyed, and a program whose strings would take
+    // more than the limit (StringOwner::kDefaultByteLimit unless set) stops
+    // with a runtime error. Literals and constants are not counted.
+    void setStringMemoryLimit(size_t bytes) { strings.setByteLimit(bytes); }
+    size_t getStringMemoryLimit() const { return strings.getByteLimit(); }
 
     // Optional: access memory/register state for inspection
-    int getVariable(const std::string& name) const;
+    Value getVariable(const std::string& name) const;
+    // All variable values after the last run, indexed by slot
+    const std::vector<Value>& getGlobals() const { return globals; }
+
+    // Selects the dispatch engine (Threaded by default; CachedTop is opt-in
+    // until vmbench shows it ahead); Threaded and CachedTop fall back to
+    // Switch when the compiler does not support computed goto.
+    void setDispatchMode(DispatchMode mode);
+    DispatchMode getDispatchMode() const;
+    static bool hasThreadedDispatch();
+
+    void setExecutionMode(ExecutionMode mode);
+    ExecutionMode getExecutionMode() const;
+    // True when the last execute() ran (at least partly) as native code
+    bool lastRunUsedJit() const;
+
+#if MYCOMPILER_PROFILE
+    // Counts and time per interpreted instruction, across execute() calls
+    const VMProfiler& getProfiler() const { return profiler; }
+    VMProfiler& getProfiler() { return profiler; }
+#endif
+    static bool hasProfiler() { return MYCOMPILER_PROFILE != 0; }
+
+    // Records (ip, opcode, top of stack) for every step into a fixed ring.
+    // Tracing runs everything in the interpreter, so JIT modes are ignored
+    // while it is on, and CachedTop dispatch runs as Threaded.
+    void setTracing(bool enabled);
+    bool isTracing() const;
+    // nullptr until tracing has been enabled once
+    const TraceRing* getTrace() const { return trace.get(); }
+    // When non-empty, execute() and run() dump the trace there when a
+    // runtime error (e.g. division by zero) stops the program
+    void setTraceDumpPath(const std::string& path);
+
+    // Back-edges/calls into one target before Tiered mode compiles
+    void setTierUpThreshold(uint32_t count);
+    uint32_t getTierUpThreshold() const;
+
+    // PRINT output (stdout unless redirected) is buffered per VM and written
+    // in batches: when the buffer fills, when the program finishes or stops
+    // with an error, on flushOutput() and when the VM is destroyed. Yielding
+    // run() slices do not flush, and buffered output is not part of a
+    // snapshot. Both throw std::runtime_error when writing fails.
+    void setOutputFd(int fd);
+    void flushOutput();
 
 private:
-    std::vector<int> stack;
-    std::unordered_map<std::string, int> memory;
+    static const size_t kMaxCallDepth = 1 << 16;
+    static const uint32_t kDefaultTierUpThreshold = 1000;
+
+    // Operand stack buffer, sized at load from the program's verified
+    // StackBounds and grown only by calls into recursive routines; the first
+    // stackDepth entries are live
+    std::vector<Value> stack;
+    size_t stackDepth = 0;
+    uint32_t frameRoom = 0;              // StackBounds::maxFrameDepth
+    std::vector<size_t> frames;          // call frames: return instruction index
+    std::vector<Value> globals;          // variable values, indexed by slot
+    const Value* constants = nullptr;    // constant pool of the running program
+    StringOwner strings;                 // strings the running program made
+
+    // name -> slot side table; only getVariable uses it, never the hot loop
+    std::unordered_map<std::string, size_t> slotByName;
 
     size_t ip = 0; // Instruction pointer
 
-    void executeInstruction(const VMInstruction& instr);
+    // Program being run by load()/run(), and where it stands
+    const BytecodeInstruction* loadedCode = nullptr;
+    size_t loadedCount = 0;
+    bool loadedCachedVariants = false;  // its cachedVariant bytes are set
+    uint64_t loadedHash = 0;            // vmCodeHash of the loaded code
+    RunStatus status = RunStatus::Finished;
+    std::string error;
+    // Instructions left before the next yield; charged at back-edges and
+    // calls by the interpreter and native code alike
+    int64_t budget = 0;
+    bool yielded = false;
+    // After native code yields, frames keep the size it runs with and only
+    // the first nativeFrameDepth entries are live, so the next slice can
+    // re-enter native code without resizing them
+    bool nativeSized = false;
+    size_t nativeFrameDepth = 0;
+
+    DispatchMode dispatchMode;
+    ExecutionMode executionMode = ExecutionMode::Interpret;
+
+    // Native code for the most recently executed program, reused while the
+    // same code (by address, length and hash) is loaded
+    std::unique_ptr<JitCode> jitCode;
+    const BytecodeInstruction* jitSource = nullptr;
+    size_t jitSourceCount = 0;
+    uint64_t jitSourceHash = 0;
+    bool jitCompileFailed = false;
+    bool usedJit = false;
+
+    // Tiered mode: executions of each jump/call target, indexed by ip. The
+    // interpreter stops at ip with tierUpRequested set once one reaches
+    // tierUpThreshold.
+    std::vector<uint32_t> hotness;
+    uint32_t tierUpThreshold = kDefaultTierUpThreshold;
+    bool tierUpRequested = false;
+
+#if MYCOMPILER_PROFILE
+    VMProfiler profiler;
+#endif
+
+    std::unique_ptr<TraceRing> trace;
+    bool tracing = false;
+    std::string traceDumpPath;
+
+    OutputBuffer output;
+
+    void load(const BytecodeInstruction* code, size_t count, const std::vector<std::string>& slotNames,
+              const std::vector<Value>& constantPool, const StackBounds& bounds,
+              bool cachedVariants, uint64_t codeHash, const std::vector<Value>* inputs);
+    void execute(const BytecodeInstruction* code, size_t count, const std::vector<std::string>& slotNames,
+                 const std::vector<Value>& constantPool, const StackBounds& bounds,
+                 bool cachedVariants, uint64_t codeHash, const std::vector<Value>* inputs);
+    void restore(const BytecodeInstruction* code, size_t count, const std::vector<std::string>& slotNames,
+                 const std::vector<Value>& constantPool, const StackBounds& bounds, bool cachedVariants,
+                 uint64_t codeHash, const VMSnapshot& snapshot);
+    // Whether a saved stack depth and call frames match the verified depths
+    static bool stackDepthFits(const BytecodeInstruction* code, size_t count,
+                               const std::vector<size_t>& savedFrames, size_t savedIp, size_t depth);
+    void executeCompact(const CompactProgram& program, const std::vector<Value>* inputs);
+    // Runs until the program ends (true) or the budget runs out (false)
+    bool runProgram(const BytecodeInstruction* code, size_t count);
+    void interpret(const BytecodeInstruction* code, bool counting);
+    void runTiered(const BytecodeInstruction* code, size_t count);
+    const JitCode* jitFor(const BytecodeInstruction* code, size_t count);
+    JitExit runJit(const JitCode& jit);
+    void trimNativeFrames();
+    // Makes room for `room` more values above stackDepth
+    void growStack(size_t room);
+
+    // Counting instantiations maintain `hotness`, Tracing ones fill `trace`;
+    // the <false, false> pair is the plain interpreter with no extra work
+    template <bool Counting, bool Tracing>
+    void runSwitch(const BytecodeInstruction* code);
+#if MYCOMPILER_HAS_COMPUTED_GOTO
+    template <bool Counting, bool Tracing>
+    void runThreaded(const BytecodeInstruction* code);
+    // Top-of-stack caching engine; never traces
+    template <bool Counting>
+    void runCached(const BytecodeInstruction* code);
+#endif
+    // Threaded when computed goto is available, a switch otherwise
+    void runCompact(const uint8_t* code);
 };
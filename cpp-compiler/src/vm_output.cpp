@@ -0,0 +1,117 @@
+#include "vm_output.h"
+
+#include <cerrno>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+// "00".."99": two digits per division instead of one
+const char kDigitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// write(2) until everything is out, retrying after signals
+bool writeAll(int fd, const char* text, size_t length) {
+    while (length > 0) {
+        ssize_t n = ::write(fd, text, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        text += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+const size_t OutputBuffer::kDefaultCapacity;
+const size_t OutputBuffer::kMaxIntLine;
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity)
+    : fd(fd), capacity(capacity < kMaxIntLine ? kMaxIntLine : capacity), data(new char[this->capacity]) {}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+OutputBuffer::OutputBuffer(OutputBuffer&& other) noexcept
+    : fd(other.fd), capacity(other.capacity), used(other.used), data(std::move(other.data)) {
+    // The moved-from buffer must not flush the same bytes again
+    other.used = 0;
+    other.capacity = 0;
+}
+
+void OutputBuffer::setFd(int newFd) {
+    flushOrThrow();
+    fd = newFd;
+}
+
+size_t OutputBuffer::formatIntLine(int32_t value, char* out) {
+    // Digits are produced backwards into a scratch buffer, then copied
+    char digits[kMaxIntLine];
+    char* end = digits + sizeof digits;
+    char* p = end;
+    *--p = '\n';
+    uint32_t magnitude = value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+    while (magnitude >= 100) {
+        const uint32_t pair = (magnitude % 100) * 2;
+        magnitude /= 100;
+        *--p = kDigitPairs[pair + 1];
+        *--p = kDigitPairs[pair];
+    }
+    if (magnitude >= 10) {
+        *--p = kDigitPairs[magnitude * 2 + 1];
+        *--p = kDigitPairs[magnitude * 2];
+    } else {
+        *--p = static_cast<char>('0' + magnitude);
+    }
+    if (value < 0) *--p = '-';
+    const size_t length = static_cast<size_t>(end - p);
+    std::memcpy(out, p, length);
+    return length;
+}
+
+void OutputBuffer::printLineSlow(Value value) {
+    if (value.isInt()) {
+        flushOrThrow();
+        used += formatIntLine(value.asInt(), data.get() + used);
+        return;
+    }
+    std::string text = value.toString();
+    text += '\n';
+    write(text.data(), text.size());
+}
+
+void OutputBuffer::write(const char* text, size_t length) {
+    if (capacity - used < length) {
+        flushOrThrow();
+        // Too big to buffer at all: straight through
+        if (length > capacity) {
+            if (!writeAll(fd, text, length)) {
+                throw std::runtime_error(std::string("VM: cannot write output: ") + std::strerror(errno));
+            }
+            return;
+        }
+    }
+    std::memcpy(data.get() + used, text, length);
+    used += length;
+}
+
+bool OutputBuffer::flush() {
+    const size_t length = used;
+    used = 0;
+    return writeAll(fd, data.get(), length);
+}
+
+void OutputBuffer::flushOrThrow() {
+    if (!flush()) throw std::runtime_error(std::string("VM: cannot write output: ") + std::strerror(errno));
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include "value.h"
+
+// Output of the PRINT opcode. Each VM owns one buffer and hands it to the
+// file descriptor in large write(2) batches (when it fills up and when the
+// VM flushes it), so a print-heavy program makes a few syscalls instead of
+// one per line and never touches iostream locks. Integers, the common
+// case, are formatted in place two digits at a time.
+class OutputBuffer {
+public:
+    static const size_t kDefaultCapacity = 64 * 1024;
+
+    explicit OutputBuffer(int fd = 1, size_t capacity = kDefaultCapacity);
+    // Flushes what is left, ignoring write errors
+    ~OutputBuffer();
+    OutputBuffer(OutputBuffer&& other) noexcept;
+    OutputBuffer& operator=(OutputBuffer&& other) = delete;
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    // Pending output goes to the old descriptor first
+    void setFd(int fd);
+    int getFd() const { return fd; }
+
+    // One PRINT: the value as Value::toString() gives it (strings as their
+    // text), then a newline. Throws std::runtime_error if a flush it needs
+    // fails.
+    void printLine(Value value) {
+        if (value.isInt() && capacity - used >= kMaxIntLine) {
+            used += formatIntLine(value.asInt(), data.get() + used);
+            return;
+        }
+        printLineSlow(value);
+    }
+    void write(const char* text, size_t length);
+
+    // Writes out everything buffered. Returns false if write(2) failed; the
+    // unwritten rest is dropped and errno tells why.
+    bool flush();
+    size_t pending() const { return used; }
+
+    // Decimal digits of `value` and a newline at `out`; returns the length
+    // (at most kMaxIntLine)
+    static size_t formatIntLine(int32_t value, char* out);
+    static const size_t kMaxIntLine = 12;   // "-2147483648\n"
+
+private:
+    void printLineSlow(Value value);
+    // flush() that throws std::runtime_error on failure
+    void flushOrThrow();
+
+    int fd;
+    size_t capacity;
+    size_t used = 0;
+    std::unique_ptr<char[]> data;
+};
@@ -0,0 +1,139 @@
+#include "vm_profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace {
+
+void sortByTime(std::vector<VMProfiler::Entry>& rows) {
+    std::sort(rows.begin(), rows.end(), [](const VMProfiler::Entry& a, const VMProfiler::Entry& b) {
+        if (a.time != b.time) return a.time > b.time;
+        return a.count > b.count;
+    });
+}
+
+double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * double(part) / double(total) : 0.0;
+}
+
+} // namespace
+
+const size_t VMProfiler::kNone;
+
+void VMProfiler::begin(const BytecodeInstruction* code, size_t count) {
+    bool same = opcodes.size() == count;
+    for (size_t ip = 0; same && ip < count; ++ip) same = opcodes[ip] == code[ip].opcode;
+    if (!same) {
+        opcodes.resize(count);
+        for (size_t ip = 0; ip < count; ++ip) opcodes[ip] = code[ip].opcode;
+        counts.assign(count, 0);
+        times.assign(count, 0);
+    }
+    current = kNone;
+}
+
+void VMProfiler::end() {
+    if (current != kNone) times[current] += readClock() - last;
+    current = kNone;
+}
+
+void VMProfiler::reset() {
+    std::fill(counts.begin(), counts.end(), 0);
+    std::fill(times.begin(), times.end(), 0);
+    current = kNone;
+}
+
+const char* VMProfiler::timeUnit() {
+#if defined(__x86_64__) || defined(__i386__)
+    return "cycles";
+#else
+    return "ns";
+#endif
+}
+
+std::vector<VMProfiler::Entry> VMProfiler::byOpcode() const {
+    std::vector<Entry> rows;
+    std::vector<int> rowOf(256, -1);
+    for (size_t ip = 0; ip < opcodes.size(); ++ip) {
+        if (counts[ip] == 0) continue;
+        int& row = rowOf[static_cast<uint8_t>(opcodes[ip])];
+        if (row < 0) {
+            row = static_cast<int>(rows.size());
+            rows.push_back(Entry{0, opcodes[ip], 0, 0});
+        }
+        rows[row].count += counts[ip];
+        rows[row].time += times[ip];
+    }
+    sortByTime(rows);
+    return rows;
+}
+
+std::vector<VMProfiler::Entry> VMProfiler::byInstruction() const {
+    std::vector<Entry> rows;
+    for (size_t ip = 0; ip < opcodes.size(); ++ip) {
+        if (counts[ip] != 0) rows.push_back(Entry{ip, opcodes[ip], counts[ip], times[ip]});
+    }
+    sortByTime(rows);
+    return rows;
+}
+
+void VMProfiler::writeReport(std::ostream& out, size_t top) const {
+    std::vector<Entry> opcodeRows = byOpcode();
+    uint64_t totalCount = 0, totalTime = 0;
+    for (const auto& row : opcodeRows) {
+        totalCount += row.count;
+        totalTime += row.time;
+    }
+
+    out << "[Profile] " << totalCount << " instructions, " << totalTime << " " << timeUnit() << "\n";
+    out << std::left << std::setw(20) << "opcode" << std::right << std::setw(14) << "count"
+        << std::setw(8) << "%count" << std::setw(16) << timeUnit() << std::setw(8) << "%time"
+        << std::setw(10) << "per-op" << "\n";
+    out << std::fixed << std::setprecision(1);
+    for (const auto& row : opcodeRows) {
+        out << std::left << std::setw(20) << vmOpCodeName(row.opcode) << std::right
+            << std::setw(14) << row.count << std::setw(8) << percent(row.count, totalCount)
+            << std::setw(16) << row.time << std::setw(8) << percent(row.time, totalTime)
+            << std::setw(10) << double(row.time) / double(row.count) << "\n";
+    }
+
+    std::vector<Entry> ipRows = byInstruction();
+    if (ipRows.size() > top) ipRows.resize(top);
+    out << "\nHottest instructions\n";
+    out << std::setw(8) << "ip" << "  " << std::left << std::setw(20) << "opcode" << std::right
+        << std::setw(14) << "count" << std::setw(16) << timeUnit() << std::setw(8) << "%time" << "\n";
+    for (const auto& row : ipRows) {
+        out << std::setw(8) << row.ip << "  " << std::left << std::setw(20) << vmOpCodeName(row.opcode)
+            << std::right << std::setw(14) << row.count << std::setw(16) << row.time
+            << std::setw(8) << percent(row.time, totalTime) << "\n";
+    }
+    out.unsetf(std::ios::floatfield);
+}
+
+void VMProfiler::writeJson(std::ostream& out) const {
+    std::vector<Entry> opcodeRows = byOpcode();
+    uint64_t totalCount = 0, totalTime = 0;
+    for (const auto& row : opcodeRows) {
+        totalCount += row.count;
+        totalTime += row.time;
+    }
+
+    out << "{\n  \"unit\": \"" << timeUnit() << "\",\n"
+        << "  \"totalCount\": " << totalCount << ",\n"
+        << "  \"totalTime\": " << totalTime << ",\n"
+        << "  \"opcodes\": [";
+    for (size_t i = 0; i < opcodeRows.size(); ++i) {
+        const Entry& row = opcodeRows[i];
+        out << (i ? ",\n" : "\n") << "    {\"opcode\": \"" << vmOpCodeName(row.opcode)
+            << "\", \"count\": " << row.count << ", \"time\": " << row.time << "}";
+    }
+    out << "\n  ],\n  \"instructions\": [";
+    std::vector<Entry> ipRows = byInstruction();
+    for (size_t i = 0; i < ipRows.size(); ++i) {
+        const Entry& row = ipRows[i];
+        out << (i ? ",\n" : "\n") << "    {\"ip\": " << row.ip << ", \"opcode\": \""
+            << vmOpCodeName(row.opcode) << "\", \"count\": " << row.count
+            << ", \"time\": " << row.time << "}";
+    }
+    out << "\n  ]\n}\n";
+}
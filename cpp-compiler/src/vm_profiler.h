@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "assembler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// Per-instruction execution profile for the stack VM interpreter.
+//
+// Only built into VirtualMachine when MYCOMPILER_PROFILE is defined (CMake
+// option MYCOMPILER_PROFILE); otherwise the dispatch loops contain no trace
+// of it. Every dispatch calls tick(), which charges the time since the
+// previous tick to the previous instruction. Time is TSC cycles on x86 and
+// CLOCK_MONOTONIC nanoseconds elsewhere (see timeUnit()); it includes the
+// dispatch that follows each handler. Code run natively by the JIT is not
+// seen. Counts accumulate over execute() calls until the program changes or
+// reset() is called.
+class VMProfiler {
+public:
+    struct Entry {
+        size_t ip;              // instruction index (per-instruction rows)
+        VMOpCode opcode;
+        uint64_t count;
+        uint64_t time;
+    };
+
+    // Starts a run of `code`; keeps accumulated data if the opcodes match
+    void begin(const BytecodeInstruction* code, size_t count);
+    void end();
+    void reset();
+
+    void tick(size_t ip) {
+        uint64_t now = readClock();
+        if (current != kNone) times[current] += now - last;
+        ++counts[ip];
+        current = ip;
+        last = now;
+    }
+
+    static const char* timeUnit();
+
+    // Rows sorted by time spent, heaviest first
+    std::vector<Entry> byOpcode() const;
+    std::vector<Entry> byInstruction() const;
+
+    // Human-readable tables: per opcode, then the `top` hottest instructions
+    void writeReport(std::ostream& out, size_t top = 20) const;
+    void writeJson(std::ostream& out) const;
+
+private:
+    static const size_t kNone = static_cast<size_t>(-1);
+
+    static uint64_t readClock() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+#endif
+    }
+
+    std::vector<VMOpCode> opcodes;      // snapshot of the profiled program
+    std::vector<uint64_t> counts;
+    std::vector<uint64_t> times;
+    size_t current = kNone;
+    uint64_t last = 0;
+};
@@ -0,0 +1,227 @@
+#include "vm_snapshot.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include "bytecode_file.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MYCOMPILER_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define MYCOMPILER_HAS_MMAP 0
+#endif
+
+namespace {
+
+static_assert(sizeof(VMSnapshotHeader) == 96, "VMSnapshotHeader layout changed");
+
+uint64_t alignUp(uint64_t value) {
+    return (value + 7) & ~uint64_t(7);
+}
+
+void appendBytes(std::vector<uint8_t>& out, const void* src, size_t n) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(src);
+    out.insert(out.end(), bytes, bytes + n);
+}
+
+void padTo(std::vector<uint8_t>& out, uint64_t offset) {
+    out.resize(static_cast<size_t>(offset), 0);
+}
+
+[[noreturn]] void reject(const std::string& path, const std::string& why) {
+    throw std::runtime_error("Invalid VM snapshot " + path + ": " + why);
+}
+
+// Replaces string handles by indexes into the snapshot's string table
+class StringEncoder {
+public:
+    Value encode(Value value) {
+        if (!value.isString()) return value;
+        auto it = indexByHandle.find(value.stringHandle());
+        if (it == indexByHandle.end()) {
+            it = indexByHandle.emplace(value.stringHandle(), static_cast<uint32_t>(table.size() / 2)).first;
+            const std::string& text = value.asString();
+            table.push_back(static_cast<uint32_t>(pool.size()));
+            table.push_back(static_cast<uint32_t>(text.size()));
+            pool += text;
+        }
+        return Value::fromBits(Value::kStringTag | it->second);
+    }
+
+    std::vector<uint32_t> table;
+    std::string pool;
+
+private:
+    std::unordered_map<uint32_t, uint32_t> indexByHandle;
+};
+
+} // namespace
+
+void writeVMSnapshot(const std::string& path, const VMSnapshotState& state) {
+    StringEncoder strings;
+    std::vector<uint64_t> slots(state.slotCount);
+    for (size_t i = 0; i < state.slotCount; ++i) slots[i] = strings.encode(state.slots[i]).raw();
+    std::vector<uint64_t> stack(state.stackDepth);
+    for (size_t i = 0; i < state.stackDepth; ++i) stack[i] = strings.encode(state.stack[i]).raw();
+    std::vector<uint64_t> frames(state.frames, state.frames + state.frameDepth);
+
+    VMSnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "MCVS", 4);
+    header.versionMajor = kSnapshotVersionMajor;
+    header.versionMinor = kSnapshotVersionMinor;
+    header.byteOrder = kMcbcByteOrder;
+    header.status = state.status;
+    header.codeHash = state.codeHash;
+    header.ip = state.ip;
+    header.slotCount = static_cast<uint32_t>(slots.size());
+    header.stackDepth = static_cast<uint32_t>(stack.size());
+    header.frameDepth = static_cast<uint32_t>(frames.size());
+    header.stringCount = static_cast<uint32_t>(strings.table.size() / 2);
+    header.stringPoolSize = strings.pool.size();
+    header.slotsOffset = alignUp(sizeof(VMSnapshotHeader));
+    header.stackOffset = header.slotsOffset + slots.size() * sizeof(uint64_t);
+    header.framesOffset = header.stackOffset + stack.size() * sizeof(uint64_t);
+    header.stringTableOffset = header.framesOffset + frames.size() * sizeof(uint64_t);
+    header.stringPoolOffset = alignUp(header.stringTableOffset + strings.table.size() * sizeof(uint32_t));
+
+    std::vector<uint8_t> out;
+    out.reserve(static_cast<size_t>(header.stringPoolOffset + strings.pool.size()));
+    appendBytes(out, &header, sizeof(header));
+    padTo(out, header.slotsOffset);
+    appendBytes(out, slots.data(), slots.size() * sizeof(uint64_t));
+    appendBytes(out, stack.data(), stack.size() * sizeof(uint64_t));
+    appendBytes(out, frames.data(), frames.size() * sizeof(uint64_t));
+    appendBytes(out, strings.table.data(), strings.table.size() * sizeof(uint32_t));
+    padTo(out, header.stringPoolOffset);
+    appendBytes(out, strings.pool.data(), strings.pool.size());
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) throw std::runtime_error("Cannot write " + path);
+    file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+    if (!file) throw std::runtime_error("Cannot write " + path);
+}
+
+VMSnapshot::~VMSnapshot() {
+#if MYCOMPILER_HAS_MMAP
+    if (mapped) {
+        munmap(const_cast<uint8_t*>(data), size);
+        return;
+    }
+#endif
+    delete[] data;
+}
+
+std::unique_ptr<VMSnapshot> VMSnapshot::open(const std::string& path) {
+    std::unique_ptr<VMSnapshot> snapshot(new VMSnapshot());
+#if MYCOMPILER_HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    snapshot->size = static_cast<size_t>(info.st_size);
+    if (snapshot->size > 0) {
+        void* memory = mmap(nullptr, snapshot->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED) throw std::runtime_error("Cannot map " + path);
+        snapshot->data = static_cast<const uint8_t*>(memory);
+        snapshot->mapped = true;
+    } else {
+        ::close(fd);
+    }
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) throw std::runtime_error("Cannot open " + path);
+    snapshot->size = static_cast<size_t>(in.tellg());
+    uint8_t* buffer = new uint8_t[snapshot->size ? snapshot->size : 1];
+    snapshot->data = buffer;
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(snapshot->size));
+    if (!in) throw std::runtime_error("Cannot read " + path);
+#endif
+    snapshot->validate(path);
+    return snapshot;
+}
+
+// Sections must be in bounds and every string Value must name an entry of
+// the string table; whether ip and frames fit the program is checked by
+// VirtualMachine::restore, which has the program
+void VMSnapshot::validate(const std::string& path) {
+    if (size < sizeof(VMSnapshotHeader)) reject(path, "truncated header");
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, "MCVS", 4) != 0) reject(path, "bad magic");
+    if (header.byteOrder != kMcbcByteOrder) reject(path, "written with a different byte order");
+    if (header.versionMajor != kSnapshotVersionMajor) {
+        reject(path, "unsupported version " + std::to_string(header.versionMajor) + "." +
+                     std::to_string(header.versionMinor));
+    }
+
+    // offset + bytes could wrap on crafted 64-bit offsets; compare against
+    // what is left after the offset instead
+    auto fits = [this](uint64_t offset, uint64_t bytes) { return offset <= size && bytes <= size - offset; };
+    if (!fits(header.slotsOffset, uint64_t(header.slotCount) * sizeof(uint64_t)) ||
+        !fits(header.stackOffset, uint64_t(header.stackDepth) * sizeof(uint64_t)) ||
+        !fits(header.framesOffset, uint64_t(header.frameDepth) * sizeof(uint64_t)) ||
+        !fits(header.stringTableOffset, uint64_t(header.stringCount) * 2 * sizeof(uint32_t)) ||
+        !fits(header.stringPoolOffset, header.stringPoolSize) ||
+        header.slotsOffset % 8 != 0 || header.stackOffset % 8 != 0 || header.framesOffset % 8 != 0 ||
+        header.stringTableOffset % alignof(uint32_t) != 0) {
+        reject(path, "section out of bounds");
+    }
+
+    const char* pool = reinterpret_cast<const char*>(data + header.stringPoolOffset);
+    strings.clear();
+    strings.reserve(header.stringCount);
+    // The table lives as long as this snapshot; VMs restored from it hold
+    // what they use themselves
+    stringOwner.setByteLimit(SIZE_MAX);
+    StringOwner::Scope scope(stringOwner);
+    for (uint32_t index = 0; index < header.stringCount; ++index) {
+        uint32_t entry[2];
+        std::memcpy(entry, data + header.stringTableOffset + index * sizeof(entry), sizeof(entry));
+        if (uint64_t(entry[0]) + entry[1] > header.stringPoolSize) reject(path, "string out of bounds");
+        strings.push_back(Value::string(std::string(pool + entry[0], entry[1])));
+    }
+
+    auto checkValues = [&](uint64_t offset, uint32_t count) {
+        for (uint32_t i = 0; i < count; ++i) {
+            uint64_t bits;
+            std::memcpy(&bits, data + offset + i * sizeof(bits), sizeof(bits));
+            Value value = Value::fromBits(bits);
+            // Only the encodings Value produces: anything else would decode
+            // as some other type (a tag of 0xFFFD and up as a string)
+            const uint32_t high = static_cast<uint32_t>(bits >> 32);
+            const bool wellFormed = value.isDouble() || high == Value::kIntTagHigh ||
+                                    (high == Value::kBoolTagHigh && (bits & 0xFFFFFFFFu) <= 1) ||
+                                    high == static_cast<uint32_t>(Value::kStringTag >> 32);
+            if (!wellFormed) reject(path, "bad value");
+            if (value.isString() && value.stringHandle() >= header.stringCount) reject(path, "bad string index");
+        }
+    };
+    checkValues(header.slotsOffset, header.slotCount);
+    checkValues(header.stackOffset, header.stackDepth);
+}
+
+void VMSnapshot::readValues(uint64_t offset, size_t count, Value* out) const {
+    std::memcpy(out, data + offset, count * sizeof(Value));
+    if (strings.empty()) return;
+    for (size_t i = 0; i < count; ++i) {
+        if (out[i].isString()) out[i] = strings[out[i].stringHandle()];
+    }
+}
+
+void VMSnapshot::readFrames(size_t* out) const {
+    for (size_t i = 0; i < header.frameDepth; ++i) {
+        uint64_t frame;
+        std::memcpy(&frame, data + header.framesOffset + i * sizeof(frame), sizeof(frame));
+        out[i] = static_cast<size_t>(frame);
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "assembler.h"
+#include "value.h"
+
+// .mcvs: the state of a VirtualMachine part way through a program (paused
+// between run() slices) or after it finished, so a costly prologue can run
+// once and later VMs start from its result, like a V8 startup snapshot.
+//
+// Layout (native byte order, checked on load; every section 8-byte aligned):
+//   VMSnapshotHeader
+//   slots          slotCount x uint64 Value bits
+//   stack          stackDepth x uint64 Value bits
+//   frames         frameDepth x uint64 return instruction index
+//   string table   stringCount x {uint32 offset, uint32 length} into the pool
+//   string pool    stringPoolSize bytes
+// String handles only mean something inside one process, so a string Value
+// is written with its index in the string table as the payload, and the
+// table is re-interned on load. Every other Value is stored exactly as the
+// VM holds it: without strings, restoring is one memcpy per section out of
+// the mapping. A snapshot records a hash of the program's code and only
+// restores into that program.
+
+struct VMSnapshotHeader {
+    char magic[4];              // "MCVS"
+    uint16_t versionMajor;      // readers reject other major versions
+    uint16_t versionMinor;
+    uint32_t byteOrder;         // kMcbcByteOrder as written by the producer
+    uint32_t status;            // RunStatus of the VM: Yielded or Finished
+    uint64_t codeHash;          // vmCodeHash of the program
+    uint64_t ip;                // where run() continues
+    uint32_t slotCount;
+    uint32_t stackDepth;
+    uint32_t frameDepth;
+    uint32_t stringCount;
+    uint64_t stringPoolSize;
+    uint64_t slotsOffset;
+    uint64_t stackOffset;
+    uint64_t framesOffset;
+    uint64_t stringTableOffset;
+    uint64_t stringPoolOffset;
+};
+
+const uint16_t kSnapshotVersionMajor = 1;
+const uint16_t kSnapshotVersionMinor = 0;
+
+// What VirtualMachine::saveSnapshot hands to writeVMSnapshot
+struct VMSnapshotState {
+    uint64_t codeHash = 0;
+    uint32_t status = 0;
+    size_t ip = 0;
+    const Value* slots = nullptr;
+    size_t slotCount = 0;
+    const Value* stack = nullptr;
+    size_t stackDepth = 0;
+    const size_t* frames = nullptr;
+    size_t frameDepth = 0;
+};
+
+// Throws std::runtime_error on I/O errors
+void writeVMSnapshot(const std::string& path, const VMSnapshotState& state);
+
+// A loaded .mcvs file: a read-only mapping that any number of VMs can
+// restore from (VirtualMachine::restore) while this object lives.
+class VMSnapshot {
+public:
+    ~VMSnapshot();
+    VMSnapshot(const VMSnapshot&) = delete;
+    VMSnapshot& operator=(const VMSnapshot&) = delete;
+
+    // Maps and validates a file. Throws std::runtime_error when it cannot be
+    // read or is not a well-formed snapshot.
+    static std::unique_ptr<VMSnapshot> open(const std::string& path);
+
+    uint64_t codeHash() const { return header.codeHash; }
+    uint32_t status() const { return header.status; }
+    size_t ip() const { return static_cast<size_t>(header.ip); }
+    size_t slotCount() const { return header.slotCount; }
+    size_t stackDepth() const { return header.stackDepth; }
+    size_t frameDepth() const { return header.frameDepth; }
+
+    // Copy a section into `out`, which must have room for all of it; string
+    // Values come back as handles of this process
+    void readSlots(Value* out) const { readValues(header.slotsOffset, header.slotCount, out); }
+    void readStack(Value* out) const { readValues(header.stackOffset, header.stackDepth, out); }
+    void readFrames(size_t* out) const;
+
+private:
+    VMSnapshot() = default;
+    void validate(const std::string& path);
+    void readValues(uint64_t offset, size_t count, Value* out) const;
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;                // false: data is owned heap memory
+    VMSnapshotHeader header = {};
+    std::vector<Value> strings;         // string table, interned
+    StringOwner stringOwner;            // holds the interned table
+};
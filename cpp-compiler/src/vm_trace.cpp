@@ -0,0 +1,125 @@
+#include "vm_trace.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+static_assert(sizeof(TraceEntry) == 16, "TraceEntry layout is part of the dump format");
+static_assert(sizeof(TraceFileHeader) == 24, "TraceFileHeader layout is part of the dump format");
+
+// Signal-time state: only lock-free atomics and a fixed buffer
+std::atomic<const TraceRing*> signalRing{nullptr};
+char signalPath[4096];
+
+bool writeAll(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = ::write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+extern "C" void dumpTraceOnSignal(int) {
+    int savedErrno = errno;
+    const TraceRing* ring = signalRing.load(std::memory_order_acquire);
+    if (ring) {
+        int fd = ::open(signalPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            ring->dump(fd);
+            ::close(fd);
+        }
+    }
+    errno = savedErrno;
+}
+
+} // namespace
+
+const size_t TraceRing::kCapacity;
+
+TraceRing::~TraceRing() {
+    const TraceRing* self = this;
+    signalRing.compare_exchange_strong(self, nullptr);
+}
+
+std::vector<TraceEntry> TraceRing::snapshot() const {
+    uint64_t total = totalSteps();
+    size_t count = total < kCapacity ? static_cast<size_t>(total) : kCapacity;
+    std::vector<TraceEntry> out;
+    out.reserve(count);
+    for (uint64_t step = total - count; step < total; ++step) out.push_back(entries[step & (kCapacity - 1)]);
+    return out;
+}
+
+bool TraceRing::dump(int fd) const {
+    uint64_t total = totalSteps();
+    size_t count = total < kCapacity ? static_cast<size_t>(total) : kCapacity;
+
+    TraceFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "MCTR", 4);
+    header.version = kTraceVersion;
+    header.totalSteps = total;
+    header.entryCount = static_cast<uint32_t>(count);
+    header.entrySize = sizeof(TraceEntry);
+    if (!writeAll(fd, &header, sizeof(header))) return false;
+
+    // Oldest entry first: the ring's tail, then its start up to the head
+    size_t start = static_cast<size_t>((total - count) & (kCapacity - 1));
+    size_t firstPart = count < kCapacity - start ? count : kCapacity - start;
+    if (!writeAll(fd, entries + start, firstPart * sizeof(TraceEntry))) return false;
+    return writeAll(fd, entries, (count - firstPart) * sizeof(TraceEntry));
+}
+
+void TraceRing::dumpToFile(const std::string& path) const {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("Cannot write " + path);
+    bool ok = dump(fd);
+    ::close(fd);
+    if (!ok) throw std::runtime_error("Cannot write " + path);
+}
+
+void TraceRing::installSignalHandler(const TraceRing& ring, int signal, const std::string& path) {
+    if (path.size() >= sizeof(signalPath)) throw std::runtime_error("Trace path too long: " + path);
+    signalRing.store(nullptr, std::memory_order_release);
+    std::memcpy(signalPath, path.c_str(), path.size() + 1);
+    signalRing.store(&ring, std::memory_order_release);
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = dumpTraceOnSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(signal, &action, nullptr) != 0) {
+        throw std::runtime_error("Cannot install trace handler for signal " + std::to_string(signal));
+    }
+}
+
+std::vector<TraceEntry> readTraceFile(const std::string& path, uint64_t* totalSteps) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open " + path);
+    TraceFileHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, "MCTR", 4) != 0) throw std::runtime_error(path + " is not a VM trace");
+    if (header.version != kTraceVersion || header.entrySize != sizeof(TraceEntry)) {
+        throw std::runtime_error(path + ": unsupported trace version " + std::to_string(header.version));
+    }
+    std::vector<TraceEntry> entries(header.entryCount);
+    in.read(reinterpret_cast<char*>(entries.data()),
+            static_cast<std::streamsize>(entries.size() * sizeof(TraceEntry)));
+    if (!in) throw std::runtime_error(path + ": truncated trace");
+    if (totalSteps) *totalSteps = header.totalSteps;
+    return entries;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "assembler.h"
+#include "value.h"
+
+// Fixed-size instruction trace for the stack VM.
+//
+// While tracing is enabled the interpreter appends one TraceEntry per
+// executed instruction (ip, opcode, top of stack before it runs). The ring
+// keeps the last kCapacity steps; recording is plain stores into the slot
+// followed by a release store of the head index, with no locks or
+// allocation. The VM thread is the only writer. Readers (dumps on error,
+// from a signal handler or another thread) acquire the head, so every entry
+// below it is complete when read, but take no lock: a slot the writer is
+// reusing for a newer step at that moment may be torn.
+//
+// Dumps are binary (TraceFileHeader + entries, oldest first) and are turned
+// back into instruction text by tools/trace_decode.
+
+struct TraceEntry {
+    uint32_t ip;
+    uint8_t opcode;
+    uint8_t reserved[3];
+    uint64_t top;           // Value bits of the top of stack, int 0 when empty
+};
+
+struct TraceFileHeader {
+    char magic[4];          // "MCTR"
+    uint32_t version;       // kTraceVersion
+    uint64_t totalSteps;    // steps recorded since clear(), may exceed entryCount
+    uint32_t entryCount;
+    uint32_t entrySize;     // sizeof(TraceEntry)
+};
+
+const uint32_t kTraceVersion = 2;
+
+class TraceRing {
+public:
+    static const size_t kCapacity = 4096;   // power of two
+
+    TraceRing() = default;
+    ~TraceRing();
+    TraceRing(const TraceRing&) = delete;
+    TraceRing& operator=(const TraceRing&) = delete;
+
+    void record(size_t ip, VMOpCode opcode, Value top) {
+        uint64_t at = head.load(std::memory_order_relaxed);
+        TraceEntry& entry = entries[at & (kCapacity - 1)];
+        entry.ip = static_cast<uint32_t>(ip);
+        entry.opcode = static_cast<uint8_t>(opcode);
+        entry.top = top.raw();
+        head.store(at + 1, std::memory_order_release);
+    }
+
+    void clear() { head.store(0, std::memory_order_relaxed); }
+    uint64_t totalSteps() const { return head.load(std::memory_order_acquire); }
+
+    // Retained entries, oldest first
+    std::vector<TraceEntry> snapshot() const;
+
+    // Writes a binary dump with write(2) only, so it is safe to call from a
+    // signal handler. Returns false on a write error.
+    bool dump(int fd) const;
+    // Creates/truncates `path` and dumps into it; throws std::runtime_error
+    void dumpToFile(const std::string& path) const;
+
+    // On `signal`, dump `ring` to `path` (created at signal time). One ring
+    // can be registered per process; a later call replaces the earlier one,
+    // and destroying the ring unregisters it.
+    static void installSignalHandler(const TraceRing& ring, int signal, const std::string& path);
+
+private:
+    TraceEntry entries[kCapacity] = {};
+    std::atomic<uint64_t> head{0};
+};
+
+// Reads a dump written by TraceRing::dump; throws std::runtime_error
+std::vector<TraceEntry> readTraceFile(const std::string& path, uint64_t* totalSteps = nullptr);
@@ -0,0 +1,525 @@
+// VM regression tests (run by ctest)
+// ==================================
+//
+//   vmtests verifier                 malformed code is rejected by verifyStack
+//   vmtests bytecode_file            BytecodeFile::open rejects damaged .mcbc
+//   vmtests snapshot                 VMSnapshot::open / restore reject states
+//                                    that do not fit the program
+//   vmtests engines <file.mc>...     every engine and execution mode agrees
+//                                    with the switch interpreter on the given
+//                                    sources and on built-in loop/call programs
+//
+// Scratch files are written to the working directory. Exits 1 after listing
+// every failed check.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include "codegen.h"
+#include "assembler.h"
+#include "bytecode_verifier.h"
+#include "bytecode_file.h"
+#include "compact_bytecode.h"
+#include "vm.h"
+#include "vm_snapshot.h"
+#include "regvm.h"
+#include "batch_runner.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (ok) return;
+    ++failures;
+    std::cerr << "FAIL: " << what << "\n";
+}
+
+bool throws(const std::function<void()>& body) {
+    try {
+        body();
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+std::vector<uint8_t> readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+BytecodeProgram assembleIR(const std::vector<Instruction>& ir, bool fusion = true) {
+    Assembler assembler;
+    assembler.setFusion(fusion);
+    assembler.assemble(ir);
+    return assembler.getBytecode();
+}
+
+// --- verifier ----------------------------------------------------------------
+
+bool rejected(std::vector<BytecodeInstruction> code) {
+    return throws([&] { verifyStack(code.data(), code.size()); });
+}
+
+void testVerifier() {
+    typedef BytecodeInstruction I;
+    // Pops from an empty stack
+    check(rejected({I(VMOpCode::VM_ADD), I(VMOpCode::VM_HALT)}), "verifier: ADD on an empty stack");
+    check(rejected({I(VMOpCode::VM_PUSH, 1), I(VMOpCode::VM_ADD), I(VMOpCode::VM_HALT)}),
+          "verifier: ADD with one operand");
+    // ip 4 is reached with depth 1 by the jump and depth 2 falling through
+    check(rejected({I(VMOpCode::VM_PUSH, 1), I(VMOpCode::VM_PUSH, 1), I(VMOpCode::VM_JUMP_IF_TRUE, 4),
+                    I(VMOpCode::VM_PUSH, 2), I(VMOpCode::VM_HALT)}),
+          "verifier: join at two depths");
+    check(rejected({I(VMOpCode::VM_JUMP, 7), I(VMOpCode::VM_HALT)}), "verifier: jump past the end");
+    check(rejected({I(VMOpCode::VM_CALL, -1), I(VMOpCode::VM_HALT)}), "verifier: call before the start");
+    // The routine at 2 returns at depth 1 on one path and 0 on the other
+    check(rejected({I(VMOpCode::VM_CALL, 2), I(VMOpCode::VM_HALT), I(VMOpCode::VM_PUSH, 0),
+                    I(VMOpCode::VM_JUMP_IF_TRUE, 5), I(VMOpCode::VM_PUSH, 1), I(VMOpCode::VM_RETURN)}),
+          "verifier: returns at two depths");
+    // Falls off the end without a HALT
+    check(rejected({I(VMOpCode::VM_PUSH, 1)}), "verifier: no HALT");
+
+    // A valid program with a call records the depth at every reached ip
+    std::vector<I> good = {I(VMOpCode::VM_PUSH, 1), I(VMOpCode::VM_CALL, 4), I(VMOpCode::VM_POP),
+                           I(VMOpCode::VM_HALT), I(VMOpCode::VM_PUSH, 2), I(VMOpCode::VM_RETURN)};
+    StackVerification verified;
+    check(!throws([&] { verified = verifyStack(good.data(), good.size()); }), "verifier: valid program");
+    check(verified.depths.size() == good.size() && verified.depths[2] == 2 && verified.depths[5] == 1,
+          "verifier: depths of a valid program");
+    check(verified.bounds.maxDepth == 2, "verifier: max depth of a valid program");
+}
+
+// --- .mcbc -----------------------------------------------------------------
+
+void testBytecodeFile() {
+    BytecodeProgram program = assembleIR({Instruction(OpCode::PUSH, "1"), Instruction(OpCode::STORE, "x"),
+                                          Instruction(OpCode::LOAD, "x"), Instruction(OpCode::PUSH, "2"),
+                                          Instruction(OpCode::ADD), Instruction(OpCode::STORE, "y")},
+                                         false);
+    const std::string path = "vmtests.mcbc";
+    const std::string damaged = "vmtests_damaged.mcbc";
+    writeBytecodeFile(path, program);
+    const std::vector<uint8_t> bytes = readFile(path);
+
+    std::unique_ptr<BytecodeFile> file;
+    check(!throws([&] { file = BytecodeFile::open(path); }), "mcbc: valid file");
+    if (file) {
+        VirtualMachine vm;
+        vm.execute(*file);
+        check(vm.getVariable("y").toString() == "3", "mcbc: valid file runs");
+        check(file->codeHash() == program.codeHash, "mcbc: code hash matches the program");
+    }
+
+    auto rejectsWith = [&](const std::string& what, const std::function<void(std::vector<uint8_t>&)>& damage) {
+        std::vector<uint8_t> copy = bytes;
+        damage(copy);
+        writeFile(damaged, copy);
+        check(throws([&] { BytecodeFile::open(damaged); }), "mcbc: " + what);
+    };
+    check(throws([] { BytecodeFile::open("vmtests_missing.mcbc"); }), "mcbc: missing file");
+    rejectsWith("empty file", [](std::vector<uint8_t>& b) { b.clear(); });
+    rejectsWith("truncated", [](std::vector<uint8_t>& b) { b.resize(b.size() - sizeof(BytecodeInstruction)); });
+    rejectsWith("bad magic", [](std::vector<uint8_t>& b) { b[0] = 'X'; });
+    rejectsWith("other major version", [](std::vector<uint8_t>& b) {
+        reinterpret_cast<McbcHeader*>(b.data())->versionMajor = kMcbcVersionMajor + 1;
+    });
+    rejectsWith("other byte order", [](std::vector<uint8_t>& b) {
+        reinterpret_cast<McbcHeader*>(b.data())->byteOrder = 0x04030201;
+    });
+    rejectsWith("other opcode set", [](std::vector<uint8_t>& b) {
+        reinterpret_cast<McbcHeader*>(b.data())->opcodeSetHash ^= 1;
+    });
+    rejectsWith("code past the end", [](std::vector<uint8_t>& b) {
+        reinterpret_cast<McbcHeader*>(b.data())->instructionCount += 1000;
+    });
+
+    // Instructions are patched in place: ip 1 is the STORE to x
+    auto code = [](std::vector<uint8_t>& b) {
+        const McbcHeader* header = reinterpret_cast<const McbcHeader*>(b.data());
+        return reinterpret_cast<BytecodeInstruction*>(b.data() + header->codeOffset);
+    };
+    rejectsWith("slot out of range", [&](std::vector<uint8_t>& b) { code(b)[1].operand1 = 99; });
+    rejectsWith("unknown opcode", [&](std::vector<uint8_t>& b) { code(b)[1].opcode = static_cast<VMOpCode>(0xEE); });
+    rejectsWith("jump out of range", [&](std::vector<uint8_t>& b) { code(b)[1] = BytecodeInstruction(VMOpCode::VM_JUMP, 99); });
+    rejectsWith("stack underflow", [&](std::vector<uint8_t>& b) { code(b)[0] = BytecodeInstruction(VMOpCode::VM_ADD); });
+    rejectsWith("no HALT at the end", [&](std::vector<uint8_t>& b) {
+        const McbcHeader* header = reinterpret_cast<const McbcHeader*>(b.data());
+        code(b)[header->instructionCount - 1] = BytecodeInstruction(VMOpCode::VM_POP);
+    });
+
+    ::unlink(path.c_str());
+    ::unlink(damaged.c_str());
+}
+
+// --- snapshots ---------------------------------------------------------------
+
+void testSnapshot() {
+    // x = 1 + 2, unfused: ip 2 is the ADD, reached with two values stacked
+    BytecodeProgram program = assembleIR({Instruction(OpCode::PUSH, "1"), Instruction(OpCode::PUSH, "2"),
+                                          Instruction(OpCode::ADD), Instruction(OpCode::STORE, "x")},
+                                         false);
+    const std::string path = "vmtests.mcvs";
+    Value slot = Value::integer(0);
+    Value stack[2] = {Value::integer(1), Value::integer(2)};
+
+    auto write = [&](size_t ip, size_t depth, const size_t* frames, size_t frameDepth) {
+        VMSnapshotState state;
+        state.codeHash = program.codeHash;
+        state.status = static_cast<uint32_t>(RunStatus::Yielded);
+        state.ip = ip;
+        state.slots = &slot;
+        state.slotCount = 1;
+        state.stack = stack;
+        state.stackDepth = depth;
+        state.frames = frames;
+        state.frameDepth = frameDepth;
+        writeVMSnapshot(path, state);
+    };
+    auto restoreFails = [&](const BytecodeProgram& into) {
+        std::unique_ptr<VMSnapshot> snapshot = VMSnapshot::open(path);
+        VirtualMachine vm;
+        return throws([&] { vm.restore(into, *snapshot); });
+    };
+
+    write(2, 2, nullptr, 0);
+    {
+        std::unique_ptr<VMSnapshot> snapshot = VMSnapshot::open(path);
+        VirtualMachine vm;
+        vm.restore(program, *snapshot);
+        check(vm.run(INT64_MAX) == RunStatus::Finished && vm.getVariable("x").toString() == "3",
+              "snapshot: state on the verified depth resumes");
+    }
+    write(2, 0, nullptr, 0);
+    check(restoreFails(program), "snapshot: ADD resumed on an empty stack");
+    write(2, 1, nullptr, 0);
+    check(restoreFails(program), "snapshot: stack one short of the verified depth");
+    write(7, 0, nullptr, 0);
+    check(restoreFails(program), "snapshot: ip past the end");
+    const size_t notAfterCall[] = {1};
+    write(2, 2, notAfterCall, 1);
+    check(restoreFails(program), "snapshot: return site that does not follow a CALL");
+    write(2, 2, nullptr, 0);
+    BytecodeProgram other = assembleIR({Instruction(OpCode::PUSH, "5"), Instruction(OpCode::STORE, "x")}, false);
+    check(restoreFails(other), "snapshot: restored into another program");
+
+    // Values that are not a valid encoding are rejected on open
+    slot = Value::fromBits(0xFFFD000000000000ull);
+    write(0, 0, nullptr, 0);
+    check(throws([&] { VMSnapshot::open(path); }), "snapshot: unknown tag");
+    slot = Value::fromBits(Value::kBoolTag | 2);
+    write(0, 0, nullptr, 0);
+    check(throws([&] { VMSnapshot::open(path); }), "snapshot: bool other than 0/1");
+    slot = Value::integer(0);
+
+    write(2, 2, nullptr, 0);
+    std::vector<uint8_t> bytes = readFile(path);
+    bytes.resize(bytes.size() - 8);
+    writeFile(path, bytes);
+    check(throws([&] { VMSnapshot::open(path); }), "snapshot: truncated");
+    check(throws([] { VMSnapshot::open("vmtests_missing.mcvs"); }), "snapshot: missing file");
+
+    ::unlink(path.c_str());
+}
+
+// --- engines -----------------------------------------------------------------
+
+// Final variables and printed lines of one run
+struct Outcome {
+    std::vector<std::string> globals;
+    std::string output;
+    std::string error;
+
+    bool operator==(const Outcome& other) const {
+        return globals == other.globals && output == other.output && error == other.error;
+    }
+};
+
+std::vector<std::string> describe(const std::vector<Value>& values) {
+    std::vector<std::string> text;
+    for (Value value : values) text.push_back(value.toString());
+    return text;
+}
+
+// Runs `body` with the VM's PRINT output going to a scratch file
+Outcome capture(VirtualMachine& vm, const std::function<void()>& body) {
+    const std::string path = "vmtests_output.txt";
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    vm.setOutputFd(fd);
+    Outcome outcome;
+    try {
+        body();
+        vm.flushOutput();
+    } catch (const std::runtime_error& e) {
+        outcome.error = e.what();
+    }
+    vm.setOutputFd(1);
+    ::close(fd);
+    const std::vector<uint8_t> bytes = readFile(path);
+    outcome.output.assign(bytes.begin(), bytes.end());
+    outcome.globals = describe(vm.getGlobals());
+    ::unlink(path.c_str());
+    return outcome;
+}
+
+Outcome sliced(VirtualMachine& vm, const BytecodeProgram& program, int64_t slice) {
+    return capture(vm, [&] {
+        vm.load(program);
+        RunStatus status;
+        while ((status = vm.run(slice)) == RunStatus::Yielded) {}
+        if (status == RunStatus::Error) throw std::runtime_error(vm.getError());
+    });
+}
+
+// Pauses after the first slice, snapshots, and finishes in a fresh VM
+Outcome resumed(const BytecodeProgram& program, ExecutionMode mode) {
+    const std::string path = "vmtests_resume.mcvs";
+    VirtualMachine first;
+    first.setExecutionMode(mode);
+    Outcome head = capture(first, [&] {
+        first.load(program);
+        first.run(3);
+        first.saveSnapshot(path);
+    });
+    std::unique_ptr<VMSnapshot> snapshot = VMSnapshot::open(path);
+    VirtualMachine second;
+    second.setExecutionMode(mode);
+    Outcome tail = capture(second, [&] {
+        second.restore(program, *snapshot);
+        RunStatus status = second.run(INT64_MAX);
+        if (status == RunStatus::Error) throw std::runtime_error(second.getError());
+    });
+    tail.output = head.output + tail.output;
+    if (!head.error.empty()) tail.error = head.error;
+    ::unlink(path.c_str());
+    return tail;
+}
+
+void checkEngines(const std::string& name, const BytecodeProgram& program) {
+    VirtualMachine reference;
+    reference.setDispatchMode(DispatchMode::Switch);
+    const Outcome expected = capture(reference, [&] { reference.execute(program); });
+
+    auto agree = [&](const std::string& engine, const Outcome& got) {
+        check(got == expected, name + ": " + engine + " disagrees with the switch interpreter" +
+                                   (got.error.empty() ? "" : " (" + got.error + ")"));
+    };
+    for (DispatchMode dispatch : {DispatchMode::Threaded, DispatchMode::CachedTop}) {
+        VirtualMachine vm;
+        vm.setDispatchMode(dispatch);
+        agree(dispatch == DispatchMode::Threaded ? "threaded" : "cached", capture(vm, [&] { vm.execute(program); }));
+    }
+    {
+        VirtualMachine vm;
+        vm.setExecutionMode(ExecutionMode::Jit);
+        agree("jit", capture(vm, [&] { vm.execute(program); }));
+        // The second execute() reuses the native code
+        agree("jit again", capture(vm, [&] { vm.execute(program); }));
+    }
+    {
+        VirtualMachine vm;
+        vm.setExecutionMode(ExecutionMode::Tiered);
+        vm.setTierUpThreshold(2);
+        agree("tiered", capture(vm, [&] { vm.execute(program); }));
+    }
+    {
+        CompactProgram compact = encodeCompact(program);
+        VirtualMachine vm;
+        agree("compact", capture(vm, [&] { vm.execute(compact); }));
+    }
+    {
+        const std::string path = "vmtests_engines.mcbc";
+        writeBytecodeFile(path, program);
+        std::unique_ptr<BytecodeFile> file = BytecodeFile::open(path);
+        VirtualMachine vm;
+        vm.setExecutionMode(ExecutionMode::Jit);
+        agree("mcbc jit", capture(vm, [&] { vm.execute(*file); }));
+        ::unlink(path.c_str());
+    }
+    for (ExecutionMode mode : {ExecutionMode::Interpret, ExecutionMode::Jit, ExecutionMode::Tiered}) {
+        const std::string label = mode == ExecutionMode::Interpret ? "interpret"
+                                : mode == ExecutionMode::Jit       ? "jit"
+                                                                   : "tiered";
+        VirtualMachine vm;
+        vm.setExecutionMode(mode);
+        vm.setTierUpThreshold(2);
+        agree("sliced " + label, sliced(vm, program, 5));
+        if (expected.error.empty()) agree("snapshot " + label, resumed(program, mode));
+    }
+    // Batch workers print to stdout, so only silent programs run there
+    if (expected.error.empty() && expected.output.empty()) {
+        for (ExecutionMode mode : {ExecutionMode::Interpret, ExecutionMode::Jit}) {
+            BatchRunner runner(2);
+            runner.setExecutionMode(mode);
+            std::vector<BatchResult> results = runner.run(program, std::vector<BatchJob>(4));
+            for (const BatchResult& result : results) {
+                check(result.ok && describe(result.globals) == expected.globals,
+                      name + ": batch " + (mode == ExecutionMode::Jit ? "jit" : "interpret") + " disagrees");
+            }
+        }
+    }
+}
+
+bool compileSource(const std::string& path, BytecodeProgram& program, RegisterProgram* registers,
+                   std::vector<std::string>& variables) {
+    std::ifstream file(path);
+    if (!file) {
+        check(false, "cannot open " + path);
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    Lexer lexer(buffer.str());
+    Parser parser(lexer.tokenize());
+    std::unique_ptr<ASTNode> ast = parser.parseProgram();
+    SemanticAnalyzer sema;
+    sema.analyze(ast);
+    if (parser.hadErrors() || !sema.getErrors().empty()) {
+        check(false, path + " does not compile");
+        return false;
+    }
+    CodeGenerator codegen;
+    codegen.setSymbolTable(&sema.getSymbolTable());
+    codegen.generate(ast);
+    Assembler assembler;
+    assembler.assemble(codegen.getInstructions());
+    program = assembler.getBytecode();
+    variables = program.slotNames;
+
+    // The register VM has no PRINT; programs using it only run on the stack VM
+    try {
+        codegen.generateThreeAddress(ast);
+        assembler.assembleRegister(codegen.getThreeAddressCode());
+        *registers = assembler.getRegisterProgram();
+        return true;
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+}
+
+// Sources have no loops or calls, so these cover back-edges, calls,
+// recursion, yields inside calls and PRINT at several stack depths
+std::vector<Instruction> loopWithCalls() {
+    typedef Instruction I;
+    return {I(OpCode::PUSH, "0"), I(OpCode::STORE, "i"),
+            I(OpCode::LABEL, "loop"), I(OpCode::LOAD, "i"), I(OpCode::PUSH, "40"), I(OpCode::CMP_LT),
+            I(OpCode::JUMP_IF_FALSE, "done"),
+            I(OpCode::LOAD, "acc"), I(OpCode::LOAD, "i"), I(OpCode::PUSH, "3"), I(OpCode::CALL, "f"), I(OpCode::MUL), I(OpCode::ADD), I(OpCode::ADD), I(OpCode::STORE, "acc"),
+            I(OpCode::LOAD, "i"), I(OpCode::PUSH, "1"), I(OpCode::ADD), I(OpCode::STORE, "i"),
+            I(OpCode::JUMP, "loop"),
+            I(OpCode::LABEL, "done"), I(OpCode::LOAD, "acc"), I(OpCode::PRINT), I(OpCode::RETURN),
+            // f: i / 7, printing i*i when i is a multiple of 10
+            I(OpCode::LABEL, "f"), I(OpCode::LOAD, "i"), I(OpCode::PUSH, "7"), I(OpCode::DIV),
+            I(OpCode::LOAD, "i"), I(OpCode::PUSH, "10"), I(OpCode::DIV), I(OpCode::PUSH, "10"), I(OpCode::MUL),
+            I(OpCode::LOAD, "i"), I(OpCode::CMP_NE), I(OpCode::JUMP_IF_TRUE, "quiet"),
+            I(OpCode::LOAD, "i"), I(OpCode::LOAD, "i"), I(OpCode::MUL), I(OpCode::PRINT),
+            I(OpCode::LABEL, "quiet"), I(OpCode::RETURN)};
+}
+
+std::vector<Instruction> recursion() {
+    typedef Instruction I;
+    return {I(OpCode::PUSH, "300"), I(OpCode::STORE, "n"), I(OpCode::CALL, "sum"), I(OpCode::STORE, "result"),
+            I(OpCode::RETURN),
+            // sum: n - 1 + ... + 0, counting n down on the way in
+            I(OpCode::LABEL, "sum"), I(OpCode::LOAD, "n"), I(OpCode::JUMP_IF_FALSE, "bottom"),
+            I(OpCode::LOAD, "n"), I(OpCode::PUSH, "1"), I(OpCode::SUB), I(OpCode::STORE, "n"),
+            I(OpCode::LOAD, "n"), I(OpCode::CALL, "sum"), I(OpCode::ADD), I(OpCode::RETURN),
+            I(OpCode::LABEL, "bottom"), I(OpCode::PUSH, "0"), I(OpCode::RETURN)};
+}
+
+// Routines that pop their caller's values have no fixed depths to compile
+std::vector<Instruction> recursionOnCallerStack() {
+    typedef Instruction I;
+    return {I(OpCode::PUSH, "300"), I(OpCode::STORE, "n"), I(OpCode::PUSH, "1"), I(OpCode::CALL, "down"),
+            I(OpCode::STORE, "result"), I(OpCode::RETURN),
+            // down: adds n to the top and recurses until n reaches 0
+            I(OpCode::LABEL, "down"), I(OpCode::LOAD, "n"), I(OpCode::JUMP_IF_FALSE, "bottom"),
+            I(OpCode::LOAD, "n"), I(OpCode::ADD), I(OpCode::LOAD, "n"), I(OpCode::PUSH, "1"), I(OpCode::SUB),
+            I(OpCode::STORE, "n"), I(OpCode::CALL, "down"),
+            I(OpCode::LABEL, "bottom"), I(OpCode::RETURN)};
+}
+
+void testEngines(const std::vector<std::string>& sources) {
+    for (const std::string& path : sources) {
+        BytecodeProgram program;
+        RegisterProgram registers;
+        std::vector<std::string> variables;
+        const bool registerVM = compileSource(path, program, &registers, variables);
+        if (program.code.empty()) continue;
+        checkEngines(path, program);
+        if (!registerVM) continue;
+
+        VirtualMachine reference;
+        reference.execute(program);
+        RegisterVM vm;
+        vm.execute(registers);
+        for (const std::string& name : variables) {
+            if (name.empty()) continue;
+            check(vm.getVariable(name).toString() == reference.getVariable(name).toString(),
+                  path + ": register VM disagrees on " + name);
+        }
+    }
+    checkEngines("loop with calls", assembleIR(loopWithCalls()));
+    checkEngines("loop with calls (unfused)", assembleIR(loopWithCalls(), false));
+    checkEngines("recursion", assembleIR(recursion()));
+    checkEngines("recursion on the caller's stack", assembleIR(recursionOnCallerStack()));
+
+    // Errors stop every engine at the same point, after the same output
+    std::vector<Instruction> failing = loopWithCalls();
+    failing.insert(failing.begin(), {Instruction(OpCode::PUSH, "1"), Instruction(OpCode::PRINT)});
+    failing.insert(failing.end() - 2, {Instruction(OpCode::PUSH, "0"), Instruction(OpCode::DIV)});
+    checkEngines("division by zero", assembleIR(failing));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " verifier | bytecode_file | snapshot | engines <file.mc>...\n";
+        return 2;
+    }
+    const std::string suite = argv[1];
+    try {
+        if (suite == "verifier") {
+            testVerifier();
+        } else if (suite == "bytecode_file") {
+            testBytecodeFile();
+        } else if (suite == "snapshot") {
+            testSnapshot();
+        } else if (suite == "engines") {
+            testEngines(std::vector<std::string>(argv + 2, argv + argc));
+        } else {
+            std::cerr << "Unknown suite: " << suite << "\n";
+            return 2;
+        }
+    } catch (const std::exception& e) {
+        check(false, std::string("unexpected exception: ") + e.what());
+    }
+    if (failures != 0) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << suite << ": ok\n";
+    return 0;
+}
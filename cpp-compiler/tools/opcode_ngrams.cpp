@@ -0,0 +1,119 @@
+// Opcode n-gram miner
+// ===================
+//
+// Compiles a corpus of source programs to stack-VM bytecode (with
+// superinstruction fusion disabled) and reports the most frequent opcode
+// sequences. The fused opcodes in Assembler::fuseSuperinstructions were
+// picked from this output; rerun it on new workloads to revisit the set.
+//
+//   opcode_ngrams [--min=2] [--max=4] [--top=20] <file>...
+//
+// Operand-sensitive shapes are reported separately with a suffix: "=" marks
+// a LOAD/STORE pair on the same slot (read-modify-write of one variable).
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include "codegen.h"
+#include "assembler.h"
+
+namespace {
+
+bool compileFile(const std::string& path, Assembler& assembler) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Cannot open " << path << "\n";
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    Lexer lexer(buffer.str());
+    Parser parser(lexer.tokenize());
+    std::unique_ptr<ASTNode> ast = parser.parseProgram();
+    SemanticAnalyzer sema;
+    sema.analyze(ast);
+    if (!sema.getErrors().empty()) {
+        std::cerr << path << ": " << sema.getErrors().front() << "\n";
+        return false;
+    }
+    CodeGenerator codegen;
+    codegen.setSymbolTable(&sema.getSymbolTable());
+    codegen.generate(ast);
+    assembler.assemble(codegen.getInstructions());
+    return true;
+}
+
+std::string ngramKey(const std::vector<BytecodeInstruction>& code, size_t at, size_t n) {
+    std::string key;
+    for (size_t k = 0; k < n; ++k) {
+        if (k) key += ' ';
+        key += vmOpCodeName(code[at + k].opcode);
+    }
+    const BytecodeInstruction& first = code[at];
+    const BytecodeInstruction& last = code[at + n - 1];
+    if (first.opcode == VMOpCode::VM_LOAD && last.opcode == VMOpCode::VM_STORE &&
+        first.operand1 == last.operand1) {
+        key += " (=)";
+    }
+    return key;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t minN = 2, maxN = 4, top = 20;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 6, "--min=") == 0) minN = std::strtoul(arg.c_str() + 6, nullptr, 10);
+        else if (arg.compare(0, 6, "--max=") == 0) maxN = std::strtoul(arg.c_str() + 6, nullptr, 10);
+        else if (arg.compare(0, 6, "--top=") == 0) top = std::strtoul(arg.c_str() + 6, nullptr, 10);
+        else files.push_back(arg);
+    }
+    if (files.empty() || minN < 1 || maxN < minN) {
+        std::cerr << "Usage: " << argv[0] << " [--min=2] [--max=4] [--top=20] <file>...\n";
+        return 2;
+    }
+
+    std::map<size_t, std::map<std::string, size_t>> counts;
+    size_t totalInstructions = 0;
+    for (const auto& path : files) {
+        Assembler assembler;
+        assembler.setFusion(false);
+        if (!compileFile(path, assembler)) continue;
+        const auto& code = assembler.getBytecode().code;
+        size_t length = code.size() - 1;  // ignore the trailing HALT
+        totalInstructions += length;
+        for (size_t n = minN; n <= maxN; ++n) {
+            for (size_t at = 0; at + n <= length; ++at) counts[n][ngramKey(code, at, n)]++;
+        }
+    }
+
+    std::cout << files.size() << " file(s), " << totalInstructions << " instructions\n";
+    for (const auto& bucket : counts) {
+        std::vector<std::pair<std::string, size_t>> sorted(bucket.second.begin(), bucket.second.end());
+        std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, size_t>& a,
+                                                   const std::pair<std::string, size_t>& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        std::cout << "\n[" << bucket.first << "-grams]\n";
+        for (size_t i = 0; i < sorted.size() && i < top; ++i) {
+            // Each occurrence of an n-gram covers n instructions
+            double coverage = 100.0 * double(sorted[i].second * bucket.first) / double(totalInstructions);
+            std::cout << std::setw(8) << sorted[i].second << "  " << std::fixed << std::setprecision(1)
+                      << std::setw(5) << coverage << "%  " << sorted[i].first << "\n";
+        }
+    }
+    return 0;
+}
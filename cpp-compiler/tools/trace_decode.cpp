@@ -0,0 +1,125 @@
+// VM trace decoder
+// ================
+//
+// Turns a binary trace dumped by the VM (mycompiler --trace, a dump on
+// error, or SIGUSR1) back into instruction text, using the program the
+// trace was recorded from: either its .mcbc file or its source, which is
+// recompiled exactly as mycompiler does.
+//
+//   trace_decode [--no-fusion] <trace.bin> <program.mcbc | source-file>
+//
+// Pass --no-fusion when the trace came from a run with fusion disabled, so
+// that instruction indices line up.
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include "codegen.h"
+#include "assembler.h"
+#include "bytecode_file.h"
+#include "vm_trace.h"
+
+namespace {
+
+bool compileFile(const std::string& path, bool fusion, BytecodeProgram& program) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Cannot open " << path << "\n";
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    Lexer lexer(buffer.str());
+    Parser parser(lexer.tokenize());
+    std::unique_ptr<ASTNode> ast = parser.parseProgram();
+    SemanticAnalyzer sema;
+    sema.analyze(ast);
+    if (!sema.getErrors().empty()) {
+        std::cerr << path << ": " << sema.getErrors().front() << "\n";
+        return false;
+    }
+    CodeGenerator codegen;
+    codegen.setSymbolTable(&sema.getSymbolTable());
+    codegen.generate(ast);
+    Assembler assembler;
+    assembler.setFusion(fusion);
+    assembler.assemble(codegen.getInstructions());
+    program = assembler.getBytecode();
+    return true;
+}
+
+bool loadProgram(const std::string& path, bool fusion, BytecodeProgram& program) {
+    const std::string suffix = ".mcbc";
+    if (path.size() < suffix.size() || path.compare(path.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return compileFile(path, fusion, program);
+    }
+    std::unique_ptr<BytecodeFile> file = BytecodeFile::open(path);
+    program.code.assign(file->code(), file->code() + file->instructionCount());
+    program.slotNames = file->slotNames();
+    program.constants = file->constants();
+    program.stackBounds = file->stackBounds();
+    program.cachedVariants = file->cachedVariants();
+    program.codeHash = file->codeHash();
+    return true;
+}
+
+// String handles index the traced process's intern table, so only their
+// number is meaningful here
+std::string formatTop(uint64_t bits) {
+    Value top = Value::fromBits(bits);
+    if (top.isString()) return "<string #" + std::to_string(top.stringHandle()) + ">";
+    return top.toString();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool fusion = true;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-fusion") fusion = false;
+        else paths.push_back(arg);
+    }
+    if (paths.size() != 2) {
+        std::cerr << "Usage: " << argv[0] << " [--no-fusion] <trace.bin> <program.mcbc | source-file>\n";
+        return 2;
+    }
+
+    try {
+        uint64_t totalSteps = 0;
+        std::vector<TraceEntry> entries = readTraceFile(paths[0], &totalSteps);
+        BytecodeProgram program;
+        if (!loadProgram(paths[1], fusion, program)) return 1;
+
+        std::cout << "# " << entries.size() << " of " << totalSteps << " steps, oldest first\n";
+        std::cout << std::setw(12) << "step" << std::setw(8) << "ip" << "  " << std::left << std::setw(32)
+                  << "instruction" << std::right << std::setw(12) << "top" << "\n";
+        uint64_t step = totalSteps - entries.size();
+        for (const TraceEntry& entry : entries) {
+            std::string text;
+            if (entry.ip >= program.code.size()) {
+                text = "<ip outside program>";
+            } else {
+                const BytecodeInstruction& instr = program.code[entry.ip];
+                text = disassemble(instr, program.slotNames, &program.constants);
+                if (static_cast<uint8_t>(instr.opcode) != entry.opcode) text += "  <opcode mismatch>";
+            }
+            std::cout << std::setw(12) << step++ << std::setw(8) << entry.ip << "  " << std::left
+                      << std::setw(32) << text << std::right << std::setw(12) << formatTop(entry.top) << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}